@@ -0,0 +1,98 @@
+/*
+ * addrindextest.c - test program for CS50 Nuggets Final Project's addrindex
+ * module
+ *
+ * usage: commandline takes no arguments
+ *
+ * CS50 Nuggets Final Project Spring 2021
+ * Grace Wang, Neha Ramsurrun, Ryan Yong
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "addrindex.h"
+#include "message.h"
+#include "mem.h"
+
+/* returns the address 127.0.0.1 (or 127.0.0.2 if 'host' is 2) at 'port' */
+static addr_t
+makeAddr(int host, int port)
+{
+  addr_t addr = message_noAddr();
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(0x7f000000 + host);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+int
+main()
+{
+  addrindex_t* index = addrindex_new(4);
+  if (index == NULL) {
+    fprintf(stderr, "Error: addrindex_new failed\n");
+    exit(1);
+  }
+
+  // TESTING addrindex_set and addrindex_find
+  printf("Testing addrindex_set and addrindex_find:\n");
+  addrindex_set(index, makeAddr(1, 5000), 0);
+  addrindex_set(index, makeAddr(1, 5001), 1);
+  addrindex_set(index, makeAddr(2, 5000), 26);
+  printf("127.0.0.1:5000 (should be 0): %d\n",
+         addrindex_find(index, makeAddr(1, 5000)));
+  printf("127.0.0.1:5001 (should be 1): %d\n",
+         addrindex_find(index, makeAddr(1, 5001)));
+  printf("127.0.0.2:5000, same port on another host (should be 26): %d\n",
+         addrindex_find(index, makeAddr(2, 5000)));
+  printf("127.0.0.1:5002, never added (should be -1): %d\n",
+         addrindex_find(index, makeAddr(1, 5002)));
+
+  printf("\nReplacing the value of 127.0.0.1:5001 (should be 7, count 3): ");
+  addrindex_set(index, makeAddr(1, 5001), 7);
+  printf("%d, count %d\n", addrindex_find(index, makeAddr(1, 5001)),
+         addrindex_count(index));
+  printf("Negative value (should be rejected): %s\n",
+         addrindex_set(index, makeAddr(1, 5003), -1) ? "accepted" : "rejected");
+
+  // TESTING growth well past the expected size
+  printf("\nTesting 1000 addresses (should all be found):\n");
+  for (int i = 0; i < 1000; i++) {
+    addrindex_set(index, makeAddr(3, 10000 + i), i);
+  }
+  int found = 0;
+  for (int i = 0; i < 1000; i++) {
+    if (addrindex_find(index, makeAddr(3, 10000 + i)) == i) {
+      found++;
+    }
+  }
+  printf("found %d of 1000, count %d\n", found, addrindex_count(index));
+
+  // TESTING addrindex_remove, which must not lose the keys after it
+  printf("\nTesting addrindex_remove of every other address:\n");
+  for (int i = 0; i < 1000; i += 2) {
+    addrindex_remove(index, makeAddr(3, 10000 + i));
+  }
+  int removed = 0, kept = 0;
+  for (int i = 0; i < 1000; i++) {
+    int value = addrindex_find(index, makeAddr(3, 10000 + i));
+    if (i % 2 == 0 && value == -1) {
+      removed++;
+    } else if (i % 2 == 1 && value == i) {
+      kept++;
+    }
+  }
+  printf("removed %d of 500 (should be 500), kept %d of 500 (should be 500)\n",
+         removed, kept);
+  printf("Removing it again (should be false): %s\n",
+         addrindex_remove(index, makeAddr(3, 10000)) ? "true" : "false");
+  printf("Count (should be 503): %d\n", addrindex_count(index));
+
+  // TESTING addrindex_delete
+  printf("\nTesting addrindex_delete:\n");
+  addrindex_delete(index);
+  addrindex_delete(NULL);
+  printf("Net memory after delete (should be 0): %d\n", mem_net());
+
+  return 0;
+}
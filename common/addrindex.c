@@ -0,0 +1,237 @@
+/*
+ * addrindex.c - 'addrindex' module
+ *
+ * see addrindex.h for more documentation
+ *
+ * Slots are probed linearly from the key's hash. A removed key is not left
+ * behind as a marker: the keys after it in the same run are shifted back
+ * into the gap, so lookups never wade through dead slots.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "addrindex.h"
+#include "mem.h"
+
+/**************** global constants ****************/
+static const int MinSlots = 16;   // smallest table; always a power of 2
+static const int Empty = -1;      // value of an unused slot
+
+/**************** global types ****************/
+typedef struct addrindex {
+  uint64_t* keys;     // packed address in each slot
+  int* values;        // value in each slot; Empty if unused
+  int numSlots;       // a power of 2, at least twice count
+  int shift;          // 64 - log2(numSlots), for addrindex_home
+  int count;          // number of addresses in the index
+} addrindex_t;
+
+/**************** local functions ****************/
+static uint64_t addrindex_key(const addr_t addr);
+static int addrindex_home(const addrindex_t* index, uint64_t key);
+static int addrindex_slot(const addrindex_t* index, uint64_t key);
+static bool addrindex_alloc(addrindex_t* index, int numSlots);
+static bool addrindex_grow(addrindex_t* index);
+
+/**************** addrindex_new() ****************/
+/* see addrindex.h for description */
+addrindex_t*
+addrindex_new(const int expected)
+{
+  addrindex_t* index = mem_malloc(sizeof(addrindex_t));
+  if (index == NULL) {
+    return NULL;
+  }
+  int numSlots = MinSlots;
+  while (numSlots < 2 * expected) {
+    numSlots *= 2;
+  }
+  if (!addrindex_alloc(index, numSlots)) {
+    mem_free(index);
+    return NULL;
+  }
+  return index;
+}
+
+/**************** addrindex_set() ****************/
+/* see addrindex.h for description */
+bool
+addrindex_set(addrindex_t* index, const addr_t addr, const int value)
+{
+  if (index == NULL || value < 0) {
+    return false;
+  }
+  uint64_t key = addrindex_key(addr);
+  int slot = addrindex_slot(index, key);
+  if (index->values[slot] != Empty) { // already there: replace the value
+    index->values[slot] = value;
+    return true;
+  }
+  if (2 * (index->count + 1) > index->numSlots) { // keep it at most half full
+    if (!addrindex_grow(index)) {
+      return false;
+    }
+    slot = addrindex_slot(index, key);
+  }
+  index->keys[slot] = key;
+  index->values[slot] = value;
+  index->count++;
+  return true;
+}
+
+/**************** addrindex_find() ****************/
+/* see addrindex.h for description */
+int
+addrindex_find(addrindex_t* index, const addr_t addr)
+{
+  if (index == NULL) {
+    return -1;
+  }
+  int value = index->values[addrindex_slot(index, addrindex_key(addr))];
+  return value == Empty ? -1 : value;
+}
+
+/**************** addrindex_remove() ****************/
+/* see addrindex.h for description */
+bool
+addrindex_remove(addrindex_t* index, const addr_t addr)
+{
+  if (index == NULL) {
+    return false;
+  }
+  int gap = addrindex_slot(index, addrindex_key(addr));
+  if (index->values[gap] == Empty) {
+    return false;
+  }
+  index->values[gap] = Empty;
+  index->count--;
+
+  // shift back each later key of the run that may sit in the gap: one whose
+  // home slot is not between the gap and where it sits now
+  int mask = index->numSlots - 1;
+  for (int slot = (gap + 1) & mask; index->values[slot] != Empty;
+       slot = (slot + 1) & mask) {
+    int home = addrindex_home(index, index->keys[slot]);
+    if (((slot - home) & mask) >= ((slot - gap) & mask)) {
+      index->keys[gap] = index->keys[slot];
+      index->values[gap] = index->values[slot];
+      index->values[slot] = Empty;
+      gap = slot;
+    }
+  }
+  return true;
+}
+
+/**************** addrindex_count() ****************/
+/* see addrindex.h for description */
+int
+addrindex_count(addrindex_t* index)
+{
+  return index == NULL ? 0 : index->count;
+}
+
+/**************** addrindex_delete() ****************/
+/* see addrindex.h for description */
+void
+addrindex_delete(addrindex_t* index)
+{
+  if (index != NULL) {
+    mem_free(index->keys);
+    mem_free(index->values);
+    mem_free(index);
+  }
+}
+
+/**************** addrindex_key() **************** /
+ * packs the IP address and port of an address into one key.
+ */
+static uint64_t
+addrindex_key(const addr_t addr)
+{
+  return ((uint64_t)ntohl(addr.sin_addr.s_addr) << 16) | ntohs(addr.sin_port);
+}
+
+/**************** addrindex_home() **************** /
+ * returns the slot where probing for a key starts (Fibonacci hashing: the
+ * top bits of the key times 2^64 divided by the golden ratio).
+ */
+static int
+addrindex_home(const addrindex_t* index, uint64_t key)
+{
+  return (int)((key * UINT64_C(0x9E3779B97F4A7C15)) >> index->shift);
+}
+
+/**************** addrindex_slot() **************** /
+ * returns the slot holding the key, or the empty slot where it would go.
+ */
+static int
+addrindex_slot(const addrindex_t* index, uint64_t key)
+{
+  int mask = index->numSlots - 1;
+  int slot = addrindex_home(index, key);
+  while (index->values[slot] != Empty && index->keys[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/**************** addrindex_alloc() **************** /
+ * gives the index a new, empty table of numSlots slots; returns false if out
+ * of memory, leaving the index as it was.
+ */
+static bool
+addrindex_alloc(addrindex_t* index, int numSlots)
+{
+  uint64_t* keys = mem_malloc(numSlots * sizeof(uint64_t));
+  int* values = mem_malloc(numSlots * sizeof(int));
+  if (keys == NULL || values == NULL) {
+    if (keys != NULL) {
+      mem_free(keys);
+    }
+    if (values != NULL) {
+      mem_free(values);
+    }
+    return false;
+  }
+  for (int i = 0; i < numSlots; i++) {
+    values[i] = Empty;
+  }
+  index->keys = keys;
+  index->values = values;
+  index->numSlots = numSlots;
+  index->shift = 64;
+  for (int n = numSlots; n > 1; n /= 2) {
+    index->shift--;
+  }
+  index->count = 0;
+  return true;
+}
+
+/**************** addrindex_grow() **************** /
+ * doubles the table, moving every key to its slot in the new one; returns
+ * false if out of memory, leaving the index as it was.
+ */
+static bool
+addrindex_grow(addrindex_t* index)
+{
+  addrindex_t old = *index;
+  if (!addrindex_alloc(index, 2 * old.numSlots)) {
+    *index = old;
+    return false;
+  }
+  for (int i = 0; i < old.numSlots; i++) {
+    if (old.values[i] != Empty) {
+      int slot = addrindex_slot(index, old.keys[i]);
+      index->keys[slot] = old.keys[i];
+      index->values[slot] = old.values[i];
+      index->count++;
+    }
+  }
+  mem_free(old.keys);
+  mem_free(old.values);
+  return true;
+}
@@ -0,0 +1,87 @@
+/*
+ * addrindex.h - header file for CS50 'addrindex' module
+ *
+ * An addrindex_t maps client addresses to small non-negative integers (such
+ * as a player's slot, or a game number), so a client can be found from the
+ * address of its message in constant time instead of by comparing it with
+ * every address in turn.
+ *
+ * The IP address and port of each addr_t are packed into one 64-bit key,
+ * and the keys are kept in an open-addressing hash table that doubles in
+ * size whenever it becomes half full.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#ifndef __ADDRINDEX_H
+#define __ADDRINDEX_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "message.h"
+
+/**************** global types ****************/
+typedef struct addrindex addrindex_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** addrindex_new ****************/
+/* Create a new, empty index.
+ *
+ * Caller provides:
+ *   the number of addresses expected; the index grows past it if need be.
+ * We return:
+ *   pointer to a new addrindex_t; NULL if error.
+ * Caller is responsible for:
+ *   later calling addrindex_delete.
+ */
+addrindex_t* addrindex_new(const int expected);
+
+/**************** addrindex_set ****************/
+/* Map an address to a value, replacing any value it had.
+ *
+ * Caller provides:
+ *   valid pointer to an addrindex_t,
+ *   the address,
+ *   the value, which must not be negative.
+ * We return:
+ *   true if the address is now mapped to the value;
+ *   false if error (bad value, out of memory).
+ */
+bool addrindex_set(addrindex_t* index, const addr_t addr, const int value);
+
+/**************** addrindex_find ****************/
+/* Look up an address.
+ *
+ * Caller provides:
+ *   valid pointer to an addrindex_t,
+ *   the address.
+ * We return:
+ *   the value mapped to the address; -1 if it is not in the index.
+ */
+int addrindex_find(addrindex_t* index, const addr_t addr);
+
+/**************** addrindex_remove ****************/
+/* Take an address out of the index.
+ *
+ * Caller provides:
+ *   valid pointer to an addrindex_t,
+ *   the address.
+ * We return:
+ *   true if the address was in the index; false otherwise.
+ */
+bool addrindex_remove(addrindex_t* index, const addr_t addr);
+
+/**************** addrindex_count ****************/
+/* Return the number of addresses in the index; 0 if index is NULL. */
+int addrindex_count(addrindex_t* index);
+
+/**************** addrindex_delete ****************/
+/* Delete the index.
+ *
+ * Caller provides:
+ *   pointer to an addrindex_t; NULL is ignored.
+ */
+void addrindex_delete(addrindex_t* index);
+
+#endif // __ADDRINDEX_H
@@ -0,0 +1,283 @@
+/*
+ * delta.c - 'delta' module
+ *
+ * see delta.h for more documentation
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "delta.h"
+#include "mem.h"
+
+/**************** global constants ****************/
+#define DeltaHistory 8                    // frames kept as possible bases
+static const int KeyframeInterval = 64;   // frames between forced keyframes
+static const int MergeGap = 4;            // unchanged characters a run may span
+static const int HeaderBytes = 32;        // room for "DELTA n base\n"
+
+/**************** global types ****************/
+typedef struct delta {
+  char* frames[DeltaHistory];   // recent frames, in slot number % DeltaHistory
+  int sizes[DeltaHistory];      // bytes allocated for each slot
+  int numbers[DeltaHistory];    // number of the frame in each slot; 0 if none
+  char* message;                // the last message built, reused each frame
+  int messageSize;              // bytes allocated for the message
+  int last;                     // number of the last frame sent
+  int acked;                    // newest frame the client has; 0 if none
+  int lastKey;                  // number of the last keyframe sent
+} delta_t;
+
+/**************** local functions ****************/
+static bool delta_runs(delta_t* delta, const char* old, const char* new,
+                       int n, int base);
+static bool delta_addRun(char* message, int* length, int size,
+                         int row, int col, const char* text, int count);
+static void delta_keep(delta_t* delta, int n, const char* frame);
+static bool delta_reserve(char** buffer, int* size, int needed);
+
+/**************** delta_new() ****************/
+/* see delta.h for description */
+delta_t*
+delta_new(void)
+{
+  delta_t* delta = mem_malloc(sizeof(delta_t));
+  if (delta == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < DeltaHistory; i++) {
+    delta->frames[i] = NULL;
+    delta->sizes[i] = 0;
+    delta->numbers[i] = 0;
+  }
+  delta->message = NULL;
+  delta->messageSize = 0;
+  delta->last = 0;
+  delta->acked = 0;
+  delta->lastKey = 0;
+  return delta;
+}
+
+/**************** delta_encode() ****************/
+/* see delta.h for description */
+const char*
+delta_encode(delta_t* delta, const char* frame)
+{
+  if (delta == NULL || frame == NULL) {
+    return NULL;
+  }
+  int n = delta->last + 1;
+  int slot = delta->acked % DeltaHistory;
+  int length = strlen(frame);
+  if (!delta_reserve(&delta->message, &delta->messageSize,
+                     HeaderBytes + length + 1)) {
+    return NULL;
+  }
+
+  // send runs against the acknowledged frame, if it is still kept;
+  // otherwise send the whole frame
+  if (delta->acked == 0 || delta->numbers[slot] != delta->acked
+      || n - delta->lastKey >= KeyframeInterval
+      || !delta_runs(delta, delta->frames[slot], frame, n, delta->acked)) {
+    sprintf(delta->message, "DELTA %d 0\n%s", n, frame);
+    delta->lastKey = n;
+  }
+
+  delta_keep(delta, n, frame);
+  delta->last = n;
+  return delta->message;
+}
+
+/**************** delta_ack() ****************/
+/* see delta.h for description */
+bool
+delta_ack(delta_t* delta, int frame)
+{
+  if (delta == NULL || frame <= delta->acked || frame > delta->last
+      || delta->numbers[frame % DeltaHistory] != frame) {
+    return false;
+  }
+  delta->acked = frame;
+  return true;
+}
+
+/**************** delta_apply() ****************/
+/* see delta.h for description */
+int
+delta_apply(char* frame, const char* message)
+{
+  int n, base, used;
+  if (frame == NULL || message == NULL
+      || sscanf(message, "DELTA %d %d%n", &n, &base, &used) != 2
+      || n <= 0 || base < 0) {
+    return 0;
+  }
+  const char* p = message + used;
+  if (*p == '\n') {
+    p++;
+  }
+
+  if (base == 0) { // keyframe: the whole frame follows
+    strcpy(frame, p);
+    return n;
+  }
+
+  while (*p != '\0') {
+    int row, col;
+    if (sscanf(p, "%d %d%n", &row, &col, &used) != 2 || p[used] != ' '
+        || row < 0 || col < 0) {
+      return 0;
+    }
+    const char* text = p + used + 1;
+    const char* end = strchr(text, '\n');
+    int count = end == NULL ? strlen(text) : end - text;
+
+    // find the line in the frame, and check the run fits on it
+    char* line = frame;
+    for (int r = 0; r < row && line != NULL; r++) {
+      line = strchr(line, '\n');
+      if (line != NULL) {
+        line++;
+      }
+    }
+    if (line == NULL) {
+      return 0;
+    }
+    char* lineEnd = strchr(line, '\n');
+    int lineLength = lineEnd == NULL ? strlen(line) : lineEnd - line;
+    if (col + count > lineLength) {
+      return 0;
+    }
+    memcpy(line + col, text, count);
+
+    p = end == NULL ? text + count : end + 1;
+  }
+  return n;
+}
+
+/**************** delta_delete() ****************/
+/* see delta.h for description */
+void
+delta_delete(delta_t* delta)
+{
+  if (delta != NULL) {
+    for (int i = 0; i < DeltaHistory; i++) {
+      if (delta->frames[i] != NULL) {
+        mem_free(delta->frames[i]);
+      }
+    }
+    if (delta->message != NULL) {
+      mem_free(delta->message);
+    }
+    mem_free(delta);
+  }
+}
+
+/**************** delta_runs() **************** /
+ * builds, in delta->message, the DELTA message taking frame 'base' (old) to
+ * frame 'n' (new); returns false if the frames do not line up, or if the
+ * runs would not be shorter than a keyframe.
+ */
+static bool
+delta_runs(delta_t* delta, const char* old, const char* new, int n, int base)
+{
+  int size = strlen(new);
+  if ((int)strlen(old) != size) {
+    return false;
+  }
+  char* message = delta->message;     // room for a keyframe is reserved
+  int length = sprintf(message, "DELTA %d %d\n", n, base);
+  int limit = HeaderBytes + size;     // a keyframe would be no longer
+
+  int row = 0;
+  int lineStart = 0;
+  for (int i = 0; i <= size; i++) {
+    if (i < size && new[i] != '\n') {
+      continue;
+    }
+    // line 'row' is new[lineStart .. i-1]; send each run of changes on it
+    int j = lineStart;
+    while (j < i) {
+      if (new[j] == old[j]) {
+        j++;
+        continue;
+      }
+      int end = j;                    // last changed character in the run
+      for (int k = j + 1; k < i && k - end <= MergeGap; k++) {
+        if (new[k] != old[k]) {
+          end = k;
+        }
+      }
+      if (!delta_addRun(message, &length, limit, row, j - lineStart,
+                        new + j, end - j + 1)) {
+        return false;
+      }
+      j = end + 1;
+    }
+    row++;
+    lineStart = i + 1;
+  }
+  return true;
+}
+
+/**************** delta_addRun() **************** /
+ * appends the line "row col text" to the message if it fits in 'size'
+ * characters; returns false if it does not.
+ */
+static bool
+delta_addRun(char* message, int* length, int size,
+             int row, int col, const char* text, int count)
+{
+  char header[HeaderBytes];
+  int headerLength = sprintf(header, "%d %d ", row, col);
+  if (*length + headerLength + count + 1 > size) {
+    return false;
+  }
+  memcpy(message + *length, header, headerLength);
+  *length += headerLength;
+  memcpy(message + *length, text, count);
+  *length += count;
+  message[(*length)++] = '\n';
+  message[*length] = '\0';
+  return true;
+}
+
+/**************** delta_keep() **************** /
+ * keeps a copy of frame 'n', replacing the oldest frame kept.
+ */
+static void
+delta_keep(delta_t* delta, int n, const char* frame)
+{
+  int slot = n % DeltaHistory;
+  delta->numbers[slot] = 0;
+  if (delta_reserve(&delta->frames[slot], &delta->sizes[slot],
+                    strlen(frame) + 1)) {
+    strcpy(delta->frames[slot], frame);
+    delta->numbers[slot] = n;
+  }
+}
+
+/**************** delta_reserve() **************** /
+ * makes sure the buffer holds at least 'needed' bytes, replacing it with a
+ * larger one only if it is too small; returns false if out of memory.
+ */
+static bool
+delta_reserve(char** buffer, int* size, int needed)
+{
+  if (*size >= needed) {
+    return true;
+  }
+  char* larger = mem_malloc(needed);
+  if (larger == NULL) {
+    return false;
+  }
+  if (*buffer != NULL) {
+    mem_free(*buffer);
+  }
+  *buffer = larger;
+  *size = needed;
+  return true;
+}
@@ -0,0 +1,102 @@
+/*
+ * delta.h - header file for CS50 'delta' module
+ *
+ * A delta_t keeps the recent frames (grid strings, as made by
+ * grid_toString) sent to one client, so that each new frame can be sent as
+ * the runs of characters that changed since a frame the client has
+ * acknowledged, rather than as the whole grid.
+ *
+ * Each frame gets a number, starting at 1. A DELTA message looks like
+ *
+ *   DELTA n base
+ *   row col text
+ *   row col text
+ *   ...
+ *
+ * meaning: frame n is frame 'base' with 'text' written over each line 'row'
+ * starting at column 'col' (text runs to the end of its line and may contain
+ * spaces). If base is 0, the message is a keyframe and the whole of frame n
+ * follows the first line, exactly as in a DISPLAY message. A keyframe is
+ * sent when no acknowledged frame is still kept, every KeyframeInterval
+ * frames, and whenever it would be shorter than the runs.
+ *
+ * A client acknowledges frame n with "ACK n", and must keep each frame it
+ * has acknowledged until it sees a later base.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#ifndef __DELTA_H
+#define __DELTA_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/**************** global types ****************/
+typedef struct delta delta_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** delta_new ****************/
+/* Create a new, empty delta state for one client.
+ *
+ * We return:
+ *   pointer to a new delta_t; NULL if error.
+ * Caller is responsible for:
+ *   later calling delta_delete.
+ */
+delta_t* delta_new(void);
+
+/**************** delta_encode ****************/
+/* Number a new frame and build the DELTA message that sends it.
+ *
+ * Caller provides:
+ *   valid pointer to a delta_t,
+ *   the new frame as a string.
+ * We return:
+ *   the DELTA message, owned by the delta_t and valid until the next call
+ *   to delta_encode or delta_delete; NULL if error.
+ * We do:
+ *   keep a copy of the frame until it is too old to be used as a base.
+ *   Buffers are reused from frame to frame, so once they are large enough
+ *   no memory is allocated.
+ */
+const char* delta_encode(delta_t* delta, const char* frame);
+
+/**************** delta_ack ****************/
+/* Record that the client has the given frame.
+ *
+ * Caller provides:
+ *   valid pointer to a delta_t,
+ *   the frame number from the client's ACK message.
+ * We return:
+ *   true if the frame is kept and will be used as the next base;
+ *   false if it was never sent, is older than the current base, or is no
+ *   longer kept.
+ */
+bool delta_ack(delta_t* delta, int frame);
+
+/**************** delta_apply ****************/
+/* Apply a DELTA message to a frame, as a client would.
+ *
+ * Caller provides:
+ *   a frame buffer holding the message's base frame (for a keyframe, any
+ *   buffer large enough for the frame),
+ *   the DELTA message.
+ * We return:
+ *   the number of the new frame; 0 if the message is malformed or does not
+ *   fit the frame.
+ * We do:
+ *   overwrite the buffer with the new frame.
+ */
+int delta_apply(char* frame, const char* message);
+
+/**************** delta_delete ****************/
+/* Delete the delta state and every frame it keeps.
+ *
+ * Caller provides:
+ *   pointer to a delta_t; NULL is ignored.
+ */
+void delta_delete(delta_t* delta);
+
+#endif // __DELTA_H
@@ -0,0 +1,314 @@
+/*
+ * fov.c - 'fov' (field of view) module
+ *
+ * see fov.h for more documentation
+ *
+ * Each octant is scanned in its own coordinates: 'depth' counts lines away
+ * from the player and 'lateral' counts points along a line, 0 <= lateral <=
+ * depth. A point at (depth, lateral) lies in direction lateral/depth.
+ * Opaque cells (anything but a room spot) cast shadows in two ways:
+ *   - a run of opaque cells [a, b] on the line at depth k blocks every
+ *     direction in [a/k, b/k] for points deeper than k;
+ *   - a run of opaque cells at depths [a, b] along the lateral line k blocks
+ *     every direction in [k/b, k/a].
+ * A point is visible unless its direction lies in one of those shadows.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "fov.h"
+#include "grid.h"
+#include "mem.h"
+
+/**************** global constant ****************/
+static const char roomSpot = '.';   // character for the room spot
+#define ShadowStackSize 256         // shadows kept on the stack before malloc
+
+/**************** local types ****************/
+/* a closed range of directions [loNum/loDen, hiNum/hiDen], denominators > 0 */
+typedef struct shadow {
+  int loNum, loDen;
+  int hiNum, hiDen;
+} shadow_t;
+
+/* a growable array of shadows that starts out on the stack */
+typedef struct shadowlist {
+  shadow_t* items;
+  int count;
+  int size;
+  shadow_t stack[ShadowStackSize];
+} shadowlist_t;
+
+/* one octant, and the part of the grid it covers */
+typedef struct octant {
+  int rowStep, colStep;   // direction of the octant along rows and columns
+  bool swap;              // true if depth runs along rows instead of columns
+  bool ownsAxis;          // true if this octant decides points at lateral 0
+  bool ownsDiagonal;      // true if this octant decides points at lateral depth
+} octant_t;
+
+/**************** local functions ****************/
+static int fov_scanOctant(grid_t* staticGrid, const octant_t* oct, int row, int col,
+                          unsigned char* visible, int* runStart,
+                          shadowlist_t* shadows, shadowlist_t* added,
+                          shadowlist_t* merged);
+static void fov_add(shadowlist_t* list, int loNum, int loDen, int hiNum, int hiDen);
+static void fov_merge(shadowlist_t* shadows, shadowlist_t* added, shadowlist_t* merged);
+static int fov_compareLo(const void* a, const void* b);
+static void fov_initList(shadowlist_t* list);
+static void fov_freeList(shadowlist_t* list);
+
+/* The eight octants. Points on the row and column of the player belong to
+ * the octants that step down and right; points on the diagonals belong to
+ * the octants whose depth runs along columns.
+ */
+static const octant_t octants[8] = {
+  {  1,  1, false, true,  true  },
+  { -1,  1, false, false, true  },
+  {  1, -1, false, true,  true  },
+  { -1, -1, false, false, true  },
+  {  1,  1, true,  true,  false },
+  {  1, -1, true,  false, false },
+  { -1,  1, true,  true,  false },
+  { -1, -1, true,  false, false },
+};
+
+/**************** fov_scratchSize() ****************/
+/* see fov.h for description */
+int
+fov_scratchSize(grid_t* staticGrid)
+{
+  if (staticGrid == NULL) {
+    return 0;
+  }
+  int numRows = grid_getRows(staticGrid);
+  int numCols = grid_getCols(staticGrid);
+  return (numRows > numCols ? numRows : numCols) + 2;  // a run start per line
+}
+
+/**************** fov_compute() ****************/
+/* see fov.h for description */
+int
+fov_compute(grid_t* staticGrid, int row, int col, unsigned char* visible,
+            int* scratch)
+{
+  int numRows = grid_getRows(staticGrid);
+  int numCols = grid_getCols(staticGrid);
+  if (staticGrid == NULL || visible == NULL || scratch == NULL
+      || row < 0 || col < 0 || row > numRows || col > numCols) {
+    return 0;
+  }
+  memset(visible, 0, (numRows + 1) * (numCols + 1));
+
+  // the scratch space and shadow lists are shared by the octants
+  int* runStart = scratch;
+  shadowlist_t lists[3];
+  for (int i = 0; i < 3; i++) {
+    fov_initList(&lists[i]);
+  }
+
+  // the player always sees their own spot
+  visible[row * (numCols + 1) + col] = 1;
+  int count = 1;
+  for (int i = 0; i < 8; i++) {
+    count += fov_scanOctant(staticGrid, &octants[i], row, col, visible,
+                            runStart, &lists[0], &lists[1], &lists[2]);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    fov_freeList(&lists[i]);
+  }
+  return count;
+}
+
+/**************** fov_scanOctant() **************** /
+ * scans one octant outward from the player, marking the points it owns that
+ * are not in shadow, and returns how many it marked.
+ */
+static int
+fov_scanOctant(grid_t* staticGrid, const octant_t* oct, int row, int col,
+               unsigned char* visible, int* runStart,
+               shadowlist_t* shadows, shadowlist_t* added, shadowlist_t* merged)
+{
+  char** map = grid_getMap(staticGrid);
+  int width = grid_getCols(staticGrid) + 1;
+  int rowLimit = oct->rowStep > 0 ? grid_getRows(staticGrid) - row : row;
+  int colLimit = oct->colStep > 0 ? grid_getCols(staticGrid) - col : col;
+  int depthLimit = oct->swap ? rowLimit : colLimit;
+  int lateralLimit = oct->swap ? colLimit : rowLimit;
+  int count = 0;
+
+  shadows->count = 0;
+  for (int k = 0; k <= lateralLimit; k++) {
+    runStart[k] = -1;                   // no run of walls along line k yet
+  }
+
+  for (int depth = 1; depth <= depthLimit; depth++) {
+    int last = depth < lateralLimit ? depth : lateralLimit;
+
+    // decide each point at this depth, walking the shadows in order
+    int s = 0;
+    for (int lateral = 0; lateral <= last; lateral++) {
+      if ((lateral == 0 && !oct->ownsAxis)
+          || (lateral == depth && !oct->ownsDiagonal)) {
+        continue;
+      }
+      // skip shadows that end before this direction
+      while (s < shadows->count
+             && shadows->items[s].hiNum * depth < lateral * shadows->items[s].hiDen) {
+        s++;
+      }
+      bool inShadow = s < shadows->count
+             && shadows->items[s].loNum * depth <= lateral * shadows->items[s].loDen;
+      if (!inShadow) {
+        int r = row + oct->rowStep * (oct->swap ? depth : lateral);
+        int c = col + oct->colStep * (oct->swap ? lateral : depth);
+        visible[r * width + c] = 1;
+        count++;
+      }
+    }
+
+    // then collect the shadows cast by the walls at this depth
+    added->count = 0;
+    int start = -1;                     // start of the current run of walls
+    for (int lateral = 0; lateral <= last; lateral++) {
+      int r = row + oct->rowStep * (oct->swap ? depth : lateral);
+      int c = col + oct->colStep * (oct->swap ? lateral : depth);
+      bool opaque = map[r][c] != roomSpot;
+
+      // walls along this line of depth
+      if (opaque && start < 0) {
+        start = lateral;
+      } else if (!opaque && start >= 0) {
+        fov_add(added, start, depth, lateral - 1, depth);
+        start = -1;
+      }
+
+      // walls along lateral line 'lateral'
+      if (lateral > 0) {
+        if (opaque) {
+          if (runStart[lateral] < 0) {
+            runStart[lateral] = depth;
+          }
+          fov_add(added, lateral, depth, lateral, runStart[lateral]);
+        } else {
+          runStart[lateral] = -1;
+        }
+      }
+    }
+    if (start >= 0) {
+      fov_add(added, start, depth, last, depth);
+    }
+
+    if (added->count > 0) {
+      fov_merge(shadows, added, merged);
+      shadowlist_t* temp = shadows;   // the merged list becomes the shadows
+      shadows = merged;
+      merged = temp;
+    }
+
+    // stop once every direction in the octant is in shadow
+    if (shadows->count == 1 && shadows->items[0].loNum == 0
+        && shadows->items[0].hiNum >= shadows->items[0].hiDen) {
+      break;
+    }
+  }
+  return count;
+}
+
+/**************** fov_add() **************** /
+ * appends the shadow [loNum/loDen, hiNum/hiDen] to the list.
+ */
+static void
+fov_add(shadowlist_t* list, int loNum, int loDen, int hiNum, int hiDen)
+{
+  if (list->count == list->size) {
+    // move to the heap, doubling the room
+    shadow_t* items = mem_assert(malloc(2 * list->size * sizeof(shadow_t)),
+                                 "fov shadows");
+    memcpy(items, list->items, list->count * sizeof(shadow_t));
+    if (list->items != list->stack) {
+      free(list->items);
+    }
+    list->items = items;
+    list->size *= 2;
+  }
+  shadow_t* shadow = &list->items[list->count++];
+  shadow->loNum = loNum;
+  shadow->loDen = loDen;
+  shadow->hiNum = hiNum;
+  shadow->hiDen = hiDen;
+}
+
+/**************** fov_merge() **************** /
+ * merges the new shadows with the sorted, disjoint list of shadows into
+ * 'merged', joining any that overlap or touch.
+ */
+static void
+fov_merge(shadowlist_t* shadows, shadowlist_t* added, shadowlist_t* merged)
+{
+  qsort(added->items, added->count, sizeof(shadow_t), fov_compareLo);
+
+  merged->count = 0;
+  int i = 0, j = 0;
+  while (i < shadows->count || j < added->count) {
+    shadow_t* next;
+    if (j == added->count
+        || (i < shadows->count && fov_compareLo(&shadows->items[i], &added->items[j]) <= 0)) {
+      next = &shadows->items[i++];
+    } else {
+      next = &added->items[j++];
+    }
+    shadow_t* prev = merged->count > 0 ? &merged->items[merged->count - 1] : NULL;
+    if (prev != NULL && next->loNum * prev->hiDen <= prev->hiNum * next->loDen) {
+      // overlaps or touches the previous shadow; extend it if needed
+      if (next->hiNum * prev->hiDen > prev->hiNum * next->hiDen) {
+        prev->hiNum = next->hiNum;
+        prev->hiDen = next->hiDen;
+      }
+    } else {
+      fov_add(merged, next->loNum, next->loDen, next->hiNum, next->hiDen);
+    }
+  }
+
+}
+
+/**************** fov_compareLo() **************** /
+ * qsort comparator ordering shadows by where they begin.
+ */
+static int
+fov_compareLo(const void* a, const void* b)
+{
+  const shadow_t* x = a;
+  const shadow_t* y = b;
+  int lhs = x->loNum * y->loDen;
+  int rhs = y->loNum * x->loDen;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/**************** fov_initList() **************** /
+ * starts a shadow list empty, on the stack.
+ */
+static void
+fov_initList(shadowlist_t* list)
+{
+  list->items = list->stack;
+  list->count = 0;
+  list->size = ShadowStackSize;
+}
+
+/**************** fov_freeList() **************** /
+ * frees a shadow list that moved to the heap.
+ */
+static void
+fov_freeList(shadowlist_t* list)
+{
+  if (list->items != list->stack) {
+    free(list->items);
+  }
+  fov_initList(list);
+}
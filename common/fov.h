@@ -0,0 +1,58 @@
+/*
+ * fov.h - header file for CS50 'fov' (field of view) module
+ *
+ * Computes everything a player can see from one spot of the static grid
+ * by shadowcasting: the grid is split into eight octants around the player,
+ * and each octant is scanned outward one line at a time while keeping track
+ * of the directions that earlier walls have blocked. Each point is decided
+ * once, instead of tracing a separate line of sight to every point.
+ *
+ * The result is exactly the visible set given by the line-of-sight rules of
+ * the grid module: a point is visible if, wherever the straight line from
+ * the player to the point crosses an intermediate row or column, it passes
+ * through a room spot, or between two cells at least one of which is a room
+ * spot. Slopes are kept as exact fractions, so no rounding is involved.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#ifndef __FOV_H
+#define __FOV_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "grid.h"
+
+/**************** functions ****************/
+
+/**************** fov_scratchSize ****************/
+/* Caller provides:
+ *   valid pointer to the default grid (staticGrid).
+ * We return:
+ *   the number of ints of scratch space fov_compute needs for this grid;
+ *   0 if staticGrid is NULL.
+ */
+int fov_scratchSize(grid_t* staticGrid);
+
+/**************** fov_compute ****************/
+/* Find every point visible from a spot of the static grid.
+ *
+ * Caller provides:
+ *   valid pointer to the default grid (staticGrid),
+ *   the row and column of the player,
+ *   an array of (numRows + 1) * (numCols + 1) bytes, one per point in
+ *   row-major order,
+ *   an array of fov_scratchSize(staticGrid) ints for our own use.
+ * We do:
+ *   set visible[row * (numCols + 1) + col] to 1 for every visible point,
+ *   and to 0 for every other point.
+ * We return:
+ *   the number of visible points; 0 if error.
+ * Note:
+ *   we allocate nothing, unless a line holds more shadows than fit on the
+ *   stack; a caller that computes many views keeps one scratch array.
+ */
+int fov_compute(grid_t* staticGrid, int row, int col, unsigned char* visible,
+                int* scratch);
+
+#endif // __FOV_H
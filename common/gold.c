@@ -0,0 +1,184 @@
+/*
+ * gold.c - 'gold' module
+ *
+ * see gold.h for more documentation
+ *
+ * The piles are kept in a compact array, and every cell of the grid has the
+ * index of its pile in that array (or none), so a pile is found from its
+ * cell in constant time. A pile picked up is replaced in the array by the
+ * last pile.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "gold.h"
+#include "grid.h"
+#include "mem.h"
+
+/**************** global constants ****************/
+static const char goldPile = '*';   // character for the gold pile
+static const int NoPile = -1;       // pileAt of a cell without a pile
+
+/**************** local types ****************/
+typedef struct pile {
+  int cell;         // row * width + col
+  int nuggets;      // nuggets in the pile
+} pile_t;
+
+/**************** global types ****************/
+typedef struct gold {
+  int width;        // cells in a row: the grid's numCols + 1
+  int numCells;     // cells in the grid
+  int* pileAt;      // index in piles of the pile at each cell, or NoPile
+  pile_t* piles;    // piles not yet picked up, in no particular order
+  int numPiles;     // number of piles not yet picked up
+  int nuggetsLeft;  // nuggets in those piles
+} gold_t;
+
+/**************** local functions ****************/
+static int gold_cell(gold_t* gold, int row, int col);
+
+/**************** gold_new() ****************/
+/* see gold.h for description */
+gold_t*
+gold_new(grid_t* liveGrid, int totalNuggets, int minPiles, int maxPiles)
+{
+  if (liveGrid == NULL) {
+    return NULL;
+  }
+  int numPiles = grid_setGold(liveGrid, minPiles, maxPiles);
+  if (numPiles <= 0 || numPiles > totalNuggets) {
+    return NULL;
+  }
+
+  gold_t* gold = mem_malloc(sizeof(gold_t));
+  if (gold == NULL) {
+    return NULL;
+  }
+  gold->width = grid_getCols(liveGrid) + 1;
+  gold->numCells = (grid_getRows(liveGrid) + 1) * gold->width;
+  gold->pileAt = mem_malloc(gold->numCells * sizeof(int));
+  gold->piles = mem_malloc(numPiles * sizeof(pile_t));
+  if (gold->pileAt == NULL || gold->piles == NULL) {
+    gold_delete(gold);
+    return NULL;
+  }
+
+  // register every pile grid_setGold dropped, one nugget each to start
+  gold->numPiles = 0;
+  for (int cell = 0; cell < gold->numCells; cell++) {
+    gold->pileAt[cell] = NoPile;
+    char spot = grid_getChar(liveGrid, cell / gold->width, cell % gold->width);
+    if (spot == goldPile && gold->numPiles < numPiles) {
+      gold->pileAt[cell] = gold->numPiles;
+      gold->piles[gold->numPiles].cell = cell;
+      gold->piles[gold->numPiles].nuggets = 1;
+      gold->numPiles++;
+    }
+  }
+
+  // share out the rest of the nuggets
+  for (int i = gold->numPiles; i < totalNuggets; i++) {
+    gold->piles[rand() % gold->numPiles].nuggets++;
+  }
+  gold->nuggetsLeft = totalNuggets;
+  return gold;
+}
+
+/**************** gold_at() ****************/
+/* see gold.h for description */
+int
+gold_at(gold_t* gold, int row, int col)
+{
+  int cell = gold_cell(gold, row, col);
+  if (cell < 0 || gold->pileAt[cell] == NoPile) {
+    return 0;
+  }
+  return gold->piles[gold->pileAt[cell]].nuggets;
+}
+
+/**************** gold_pickup() ****************/
+/* see gold.h for description */
+int
+gold_pickup(gold_t* gold, int row, int col)
+{
+  int cell = gold_cell(gold, row, col);
+  if (cell < 0 || gold->pileAt[cell] == NoPile) {
+    return 0;
+  }
+  int index = gold->pileAt[cell];
+  int nuggets = gold->piles[index].nuggets;
+
+  // move the last pile into the hole
+  gold->numPiles--;
+  gold->piles[index] = gold->piles[gold->numPiles];
+  gold->pileAt[gold->piles[index].cell] = index;
+  gold->pileAt[cell] = NoPile;
+
+  gold->nuggetsLeft -= nuggets;
+  return nuggets;
+}
+
+/**************** gold_numPiles() ****************/
+/* see gold.h for description */
+int
+gold_numPiles(gold_t* gold)
+{
+  return gold == NULL ? 0 : gold->numPiles;
+}
+
+/**************** gold_nuggetsLeft() ****************/
+/* see gold.h for description */
+int
+gold_nuggetsLeft(gold_t* gold)
+{
+  return gold == NULL ? 0 : gold->nuggetsLeft;
+}
+
+/**************** gold_iterate() ****************/
+/* see gold.h for description */
+void
+gold_iterate(gold_t* gold, void* arg,
+             void (*itemfunc)(void* arg, int row, int col, int nuggets))
+{
+  if (gold != NULL && itemfunc != NULL) {
+    for (int i = 0; i < gold->numPiles; i++) {
+      pile_t* pile = &gold->piles[i];
+      (*itemfunc)(arg, pile->cell / gold->width, pile->cell % gold->width,
+                  pile->nuggets);
+    }
+  }
+}
+
+/**************** gold_delete() ****************/
+/* see gold.h for description */
+void
+gold_delete(gold_t* gold)
+{
+  if (gold != NULL) {
+    if (gold->pileAt != NULL) {
+      mem_free(gold->pileAt);
+    }
+    if (gold->piles != NULL) {
+      mem_free(gold->piles);
+    }
+    mem_free(gold);
+  }
+}
+
+/**************** gold_cell() **************** /
+ * returns the cell number of a row and column; -1 if gold is NULL or the
+ * position is outside the grid.
+ */
+static int
+gold_cell(gold_t* gold, int row, int col)
+{
+  if (gold == NULL || row < 0 || col < 0 || col >= gold->width) {
+    return -1;
+  }
+  int cell = row * gold->width + col;
+  return cell < gold->numCells ? cell : -1;
+}
@@ -0,0 +1,93 @@
+/*
+ * gold.h - header file for CS50 'gold' module
+ *
+ * A gold_t is the registry of the gold piles of one game. The piles are
+ * dropped in the live grid by grid_setGold, and each is given its number of
+ * nuggets right away, so that picking a pile up is a lookup by its cell
+ * rather than a draw at pickup time, and the same seed always gives the same
+ * piles with the same sizes whatever order they are found in.
+ *
+ * The registry, not the '*' characters of the live grid, holds the state of
+ * the gold: the characters only show where the piles are.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#ifndef __GOLD_H
+#define __GOLD_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "grid.h"
+
+/**************** global types ****************/
+typedef struct gold gold_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** gold_new ****************/
+/* Drop the gold piles in the live grid and give each its size.
+ *
+ * Caller provides:
+ *   valid pointer to the live grid,
+ *   the total number of nuggets,
+ *   the minimum and maximum number of piles.
+ * We return:
+ *   pointer to a new gold_t; NULL if error, or if there are more piles
+ *   than nuggets.
+ * We do:
+ *   call grid_setGold, then share the nuggets among the piles (at least one
+ *   each) using rand(), so the sizes follow from the seed.
+ * Caller is responsible for:
+ *   later calling gold_delete.
+ */
+gold_t* gold_new(grid_t* liveGrid, int totalNuggets,
+                 int minPiles, int maxPiles);
+
+/**************** gold_at ****************/
+/* Return the number of nuggets in the pile at a cell; 0 if there is none. */
+int gold_at(gold_t* gold, int row, int col);
+
+/**************** gold_pickup ****************/
+/* Take the pile at a cell.
+ *
+ * Caller provides:
+ *   valid pointer to a gold_t,
+ *   the row and column of the cell.
+ * We return:
+ *   the number of nuggets in the pile; 0 if there is none.
+ * We do:
+ *   remove the pile from the registry. The live grid is not changed.
+ */
+int gold_pickup(gold_t* gold, int row, int col);
+
+/**************** gold_numPiles ****************/
+/* Return the number of piles not yet picked up; 0 if gold is NULL. */
+int gold_numPiles(gold_t* gold);
+
+/**************** gold_nuggetsLeft ****************/
+/* Return the number of nuggets not yet picked up; 0 if gold is NULL. */
+int gold_nuggetsLeft(gold_t* gold);
+
+/**************** gold_iterate ****************/
+/* Call a function on every pile not yet picked up, in no particular order.
+ *
+ * Caller provides:
+ *   valid pointer to a gold_t,
+ *   an arbitrary argument passed through to itemfunc,
+ *   itemfunc, called with the arg and each pile's row, column and nuggets.
+ * Note:
+ *   itemfunc must not pick up piles.
+ */
+void gold_iterate(gold_t* gold, void* arg,
+                  void (*itemfunc)(void* arg, int row, int col, int nuggets));
+
+/**************** gold_delete ****************/
+/* Delete the registry.
+ *
+ * Caller provides:
+ *   pointer to a gold_t; NULL is ignored.
+ */
+void gold_delete(gold_t* gold);
+
+#endif // __GOLD_H
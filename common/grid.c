@@ -6,36 +6,145 @@
  * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
  */
 
+#define _POSIX_C_SOURCE 200809L   // for mmap under -std=c11
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
 #include <ctype.h> 
 #include <math.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "mem.h"
-#include "file.h"
+#include "grid.h"
+#include "fov.h"
 
 /**************** global constant ****************/
 static const char solidRock = ' ';  // character for the solid rock
 static const char goldPile = '*';   // character for the gold pile
 static const char roomSpot = '.';   // character for the room spot
 static const char playerChar = '@'; // character for the player character
+static const char passageSpot = '#';// character for the passage spot
+static const char nmapMagic[4] = { 'N', 'M', 'A', 'P' };
+static const int32_t nmapVersion = 1;  // changes whenever the layout does
+static const int wordBits = 64;        // points in a word of a view's bitsets
+
+/**************** file-local global variables ****************/
+/* how visibility is computed when a view is not in a visibility index;
+ * a module-wide setting so that the engines can be compared at runtime.
+ */
+static visEngine_t visEngine = visRays;
+
+/* visibility passes computed by grid_update and grid_reveal, and the cells
+ * those passes looked at (see grid_getVisCounts); threads may add at once.
+ */
+static _Atomic unsigned long visPasses = 0;
+static _Atomic unsigned long visCells = 0;
 
 /**************** local types ****************/
-/* none */
+/* one horizontal run of cells, [colStart, colEnd], visible from a viewpoint */
+typedef struct visrun {
+  short row;
+  short colStart;
+  short colEnd;
+} visrun_t;
+
+/* precomputed visibility for every room and passage spot of a static grid;
+ * the runs visible from cell i are runs[first[i]] up to runs[first[i+1]-1],
+ * and cells that are not viewpoints have no runs.
+ */
+typedef struct visindex {
+  int* first;       // index into runs for each cell, plus one end marker
+  visrun_t* runs;   // runs of visible cells, grouped by viewpoint
+  int numRuns;      // number of runs in use
+} visindex_t;
+
+/* the room spots of a live grid that nothing occupies, so a random one can
+ * be picked without trying cells at random; cells[0..count-1] are the free
+ * cells in no particular order, and slot[i] is where cell i is in cells, or
+ * -1 if it is not free.
+ */
+typedef struct freeindex {
+  int* cells;       // free cells, row * (numCols + 1) + col
+  int* slot;        // index into cells for each cell of the grid, or -1
+  int count;        // number of free cells
+} freeindex_t;
+
+/* the start of a compiled map (see grid_compile), followed by the cells of
+ * the grid as grid_getText gives them, padded to a multiple of 4 bytes; the
+ * free cells as numFree int32s; and, if numRuns is not negative, the first
+ * run of every cell plus an end marker as int32s, then numRuns visruns.
+ * Numbers are in the byte order of the machine that compiled the map.
+ */
+typedef struct nmapheader {
+  char magic[4];          // "NMAP"
+  int32_t version;        // nmapVersion
+  int32_t numRows;
+  int32_t numCols;
+  int32_t numFree;        // room spots, in the order of the free index
+  int32_t numRuns;        // runs in the visibility index; -1 if none
+  int32_t engine;         // visEngine_t the visibility index was built with
+  int32_t unused;
+  int64_t sourceSize;     // size of the map file compiled, in bytes
+  int64_t sourceSeconds;  // and when it was last modified
+  int64_t sourceNanos;
+} nmapheader_t;
 
 /**************** global types ****************/
+/* The cells live in one buffer laid out exactly as grid_toString prints
+ * them: each row is numCols + 1 cells followed by a newline, and the buffer
+ * ends with a null character. map[row] points at the start of each row.
+ */
 typedef struct grid{
     int numRows;
     int numCols;
     char** map;   
+    char* cells;            // all rows, stride numCols + 2, null-terminated
+    visindex_t* visIndex;   // NULL unless grid_buildVisIndex was called
+    freeindex_t* freeIndex; // NULL until grid_load or grid_randomFree
 } grid_t;
 
+/* What one player has seen, as two bitsets with a bit per point: seen holds
+ * every point the player has seen, and visible the points they saw at their
+ * last grid_update. Each row of a bitset starts on a new word, so a row of
+ * the player's grid is composed a word, that is 64 points, at a time.
+ */
+typedef struct gridview {
+  int numRows;
+  int numCols;
+  int wordsPerRow;
+  int row;                // the player's spot; -1 when not on the grid
+  int col;
+  uint64_t* seen;         // (numRows + 1) * wordsPerRow words
+  uint64_t* visible;      // as many more, in the same allocation
+  int* shadowScratch;     // fov_compute scratch, then a byte per point;
+                          // NULL until the first shadowcasting pass
+} gridview_t;
+
 /**************** local functions ****************/
-static void grid_calcVisibility(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, int rowPlayer, int colPlayer);
+static void grid_calcVisibility(grid_t* staticGrid, gridview_t* view, uint64_t* bits, int rowPlayer, int colPlayer);
 static bool grid_isVisible(grid_t* staticGrid, int row, int col, int rowPlayer, int colPlayer);
 static bool grid_rowVisibility(grid_t* staticGrid, int row, int col, int rowPlayer, int colPlayer);
 static bool grid_colVisibility(grid_t* staticGrid, int row, int col, int rowPlayer, int colPlayer);
+static void grid_indexVisibility(grid_t* staticGrid, gridview_t* view, uint64_t* bits, int rPlayer, int cPlayer);
+static void grid_addVisRun(visindex_t* index, int* size, int row, int colStart, int colEnd);
+static void grid_shadowVisibility(grid_t* staticGrid, gridview_t* view, uint64_t* bits, int rPlayer, int cPlayer);
+static grid_t* grid_loadText(const char* mapFile);
+static grid_t* grid_loadCompiled(const char* mapFile, const struct stat* source);
+static bool grid_checkCompiled(const char* data, size_t size,
+                               const struct stat* source);
+static char* grid_compiledName(const char* mapFile);
+static grid_t* grid_parse(const char* text, size_t size);
+static bool grid_buildFreeIndex(grid_t* grid);
+static void grid_setCell(grid_t* grid, int row, int col, char c);
+static void grid_countVisPass(unsigned long cells);
+static void grid_setBits(uint64_t* row, int colStart, int colEnd);
+static void grid_copyRuns(char* out, const char* from, uint64_t bits);
 
 /**************** grid_new() ****************/
 /* see grid.h for description */
@@ -45,26 +154,36 @@ grid_new(int numRows, int numCols)
   if (numCols > 0 && numRows > 0)
   {
     grid_t* grid = mem_malloc(sizeof(grid_t));
-    grid->numRows = numRows;
-    grid->numCols = numCols;
     
     if (grid == NULL) {
       return NULL;              // error allocating grid
     } else {
       // initialize contents of grid structure
+      grid->numRows = numRows;
+      grid->numCols = numCols;
+      grid->visIndex = NULL;
+      grid->freeIndex = NULL;
+      int stride = numCols + 2;  // cells of a row plus its newline
+      grid->cells = (char*)mem_malloc((numRows + 1) * stride + 1);
       grid->map = (char**)mem_calloc(numRows + 1, sizeof(char*));
-
-      // initialize each array within the 2D array
-      for (int i = 0; i <= numRows; i++){
-        grid->map[i] = (char*)mem_calloc(numCols + 1, sizeof(char));
+      if (grid->cells == NULL || grid->map == NULL) {
+        if (grid->cells != NULL) {    // error allocating rows
+          mem_free(grid->cells);
+        }
+        if (grid->map != NULL) {
+          mem_free(grid->map);
+        }
+        mem_free(grid);
+        return NULL;
       }
-      
-      // initialize with spaces
+
+      // point each row of the 2D array into the buffer, and fill with spaces
       for (int row = 0; row <= numRows; row++) {
-        for (int col = 0; col <= numCols; col++) {
-          grid->map[row][col] = solidRock;
-        }
+        grid->map[row] = grid->cells + row * stride;
+        memset(grid->map[row], solidRock, numCols + 1);
+        grid->map[row][numCols + 1] = '\n';
       }
+      grid->cells[(numRows + 1) * stride] = '\0';
       return grid;
     }
   } else {
@@ -77,76 +196,267 @@ grid_new(int numRows, int numCols)
 grid_t*
 grid_load(const char* mapFile)
 {
-  FILE *f = fopen(mapFile, "r");
+  struct stat source;
+  if (mapFile == NULL || stat(mapFile, &source) != 0) {
+    return NULL;
+  }
+  grid_t* grid = grid_loadCompiled(mapFile, &source);
+  if (grid == NULL) {
+    grid = grid_loadText(mapFile);  // no compiled map, or not up to date
+  }
+  return grid;
+}
+
+/**************** grid_copy() ****************/
+/* see grid.h for description */
+grid_t*
+grid_copy(grid_t* grid)
+{
+  if (grid == NULL) {
+    return NULL;
+  }
+  grid_t* copy = grid_new(grid->numRows, grid->numCols);
+  if (copy != NULL) {
+    memcpy(copy->cells, grid->cells,
+           (grid->numRows + 1) * (grid->numCols + 2) + 1);
+    grid_buildFreeIndex(copy);  // without it, grid_randomFree builds it
+  }
+  return copy;
+}
+
+/**************** grid_compile() ****************/
+/* see grid.h for description */
+bool
+grid_compile(const char* mapFile, const bool withIndex)
+{
+  // note the map file before reading it, so a change made meanwhile makes
+  // the compiled map out of date rather than wrong
+  struct stat source;
+  if (mapFile == NULL || stat(mapFile, &source) != 0) {
+    return false;
+  }
+  grid_t* grid = grid_loadText(mapFile);
+  if (grid == NULL || grid->freeIndex == NULL
+      || (withIndex && !grid_buildVisIndex(grid))) {
+    grid_delete(grid);
+    return false;
+  }
 
-  if (f != NULL) {
-    // get number of rows for the grid
-    int numRows = file_numLines(f);
+  nmapheader_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, nmapMagic, sizeof(header.magic));
+  header.version = nmapVersion;
+  header.numRows = grid->numRows;
+  header.numCols = grid->numCols;
+  header.numFree = grid->freeIndex->count;
+  header.numRuns = withIndex ? grid->visIndex->numRuns : -1;
+  header.engine = visEngine;
+  header.sourceSize = source.st_size;
+  header.sourceSeconds = source.st_mtim.tv_sec;
+  header.sourceNanos = source.st_mtim.tv_nsec;
 
-    // get number of columns for the grid
-    int numCols = 0;
-    char* line = NULL;
-    while ((line = file_readLine(f)) != NULL) {
-      if (strlen(line) > numCols) {
-        numCols = strlen(line) + 1;
-      }
-      free(line);
-    }
-    fclose(f);
-
-    grid_t* grid = grid_new(numRows, numCols);
-
-    // check if dimensions of grid is valid
-    if (numCols <= grid->numCols && numRows <= grid->numRows) {
-      // populate the grid with characters
-      int row = 0;
-      line = NULL;
-      f = fopen(mapFile, "r");
-      while ((line = file_readLine(f)) != NULL) {
-        // for each character in the line, add to 2D array
-        for (int col = 0; col <= strlen(line); col++) {
-          grid->map[row][col] = line[col];
-          if ( col == strlen(line) && col < numCols) {
-            while(col <= numCols) {
-              grid->map[row][col] = solidRock;
-              col++;
-            }
-          }
-        }
-        free(line);
-        row++;
-      }
-      fclose(f);
-      return grid;
+  int numCells = (grid->numRows + 1) * (grid->numCols + 1);
+  size_t textSize = (grid->numRows + 1) * (grid->numCols + 2) + 1;
+  const char padding[4] = { 0 };
+
+  // write a new file and rename it over the old, so that a server starting
+  // meanwhile sees one or the other whole
+  char* nmapFile = grid_compiledName(mapFile);
+  char* tempFile = mem_malloc(strlen(nmapFile) + 5);
+  if (nmapFile == NULL || tempFile == NULL) {
+    if (nmapFile != NULL) {
+      mem_free(nmapFile);
+    }
+    if (tempFile != NULL) {
+      mem_free(tempFile);
+    }
+    grid_delete(grid);
+    return false;
+  }
+  sprintf(tempFile, "%s.tmp", nmapFile);
+  FILE* fp = fopen(tempFile, "wb");
+  bool ok = fp != NULL;
+  if (ok) {
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1
+         && fwrite(grid->cells, textSize, 1, fp) == 1
+         && fwrite(padding, (4 - textSize % 4) % 4, 1, fp) <= 1
+         && fwrite(grid->freeIndex->cells, sizeof(int32_t), header.numFree,
+                   fp) == header.numFree;
+    if (ok && withIndex) {
+      ok = fwrite(grid->visIndex->first, sizeof(int32_t), numCells + 1, fp)
+             == numCells + 1
+           && fwrite(grid->visIndex->runs, sizeof(visrun_t), header.numRuns,
+                     fp) == header.numRuns;
+    }
+    ok = (fclose(fp) == 0) && ok;
+    ok = ok && rename(tempFile, nmapFile) == 0;
+    if (!ok) {
+      remove(tempFile);
     }
   }
-  return NULL;
+  mem_free(tempFile);
+  mem_free(nmapFile);
+  grid_delete(grid);
+  return ok;
+}
 
+/**************** grid_newView() ****************/
+/* see grid.h for description */
+gridview_t*
+grid_newView(grid_t* staticGrid)
+{
+  if (staticGrid == NULL) {
+    return NULL;
+  }
+  gridview_t* view = mem_malloc(sizeof(gridview_t));
+  if (view == NULL) {
+    return NULL;
+  }
+  view->numRows = staticGrid->numRows;
+  view->numCols = staticGrid->numCols;
+  view->wordsPerRow = (staticGrid->numCols + wordBits) / wordBits;
+  int words = (view->numRows + 1) * view->wordsPerRow;
+  view->seen = mem_calloc(2 * words, sizeof(uint64_t));
+  if (view->seen == NULL) {
+    mem_free(view);
+    return NULL;
+  }
+  view->visible = view->seen + words;
+  view->shadowScratch = NULL;
+  view->row = -1;
+  view->col = -1;
+  return view;
 }
 
 /**************** grid_update() ****************/
 /* see grid.h for description */
 void
-grid_update(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, char id, int row, int col ) 
+grid_update(grid_t* staticGrid, grid_t* liveGrid, gridview_t* view, char id, int row, int col ) 
 { 
   if (row >= 0 && col >= 0) {
     // move player to new position
-    liveGrid->map[row][col] = id;  
-    grid_calcVisibility(staticGrid, liveGrid, playerGrid, row, col);
-    playerGrid->map[row][col] = playerChar;
+    grid_setCell(liveGrid, row, col, id);
+    int words = (view->numRows + 1) * view->wordsPerRow;
+    memset(view->visible, 0, words * sizeof(uint64_t));
+    grid_calcVisibility(staticGrid, view, view->visible, row, col);
+    // what is visible is now seen, as is the player's own spot
+    for (int w = 0; w < words; w++) {
+      view->seen[w] |= view->visible[w];
+    }
+    view->seen[row * view->wordsPerRow + col / wordBits]
+      |= (uint64_t)1 << (col % wordBits);
+    view->row = row;
+    view->col = col;
   }
 }
 
 /**************** grid_remove() ****************/
 /* see grid.h for description */
 void
-grid_remove(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, int row, int col) 
+grid_remove(grid_t* staticGrid, grid_t* liveGrid, gridview_t* view, int row, int col) 
 {
   // remove player from the position
-  liveGrid->map[row][col] = staticGrid->map[row][col];
-  if (playerGrid->map[row][col] != solidRock) {
-    playerGrid->map[row][col] = staticGrid->map[row][col];
-  } 
+  grid_setCell(liveGrid, row, col, staticGrid->map[row][col]);
+  if (view != NULL && row <= view->numRows && col <= view->numCols) {
+    // the spot shows as remembered, not live, until the next update
+    view->visible[row * view->wordsPerRow + col / wordBits]
+      &= ~((uint64_t)1 << (col % wordBits));
+    if (view->row == row && view->col == col) {
+      view->row = -1;
+      view->col = -1;
+    }
+  }
+}
+
+/**************** grid_reveal() ****************/
+/* see grid.h for description */
+void
+grid_reveal(grid_t* staticGrid, gridview_t* view, int row, int col)
+{
+  if (staticGrid == NULL || view == NULL || row < 0 || col < 0
+      || row > staticGrid->numRows || col > staticGrid->numCols) {
+    return;
+  }
+  grid_calcVisibility(staticGrid, view, view->seen, row, col);
+  // the player stood here, whether or not the spot counts as visible
+  view->seen[row * view->wordsPerRow + col / wordBits]
+    |= (uint64_t)1 << (col % wordBits);
+}
+
+/**************** grid_composeView() ****************/
+/* see grid.h for description */
+char*
+grid_composeView(grid_t* staticGrid, grid_t* liveGrid, gridview_t* view, char* text)
+{
+  if (staticGrid == NULL || liveGrid == NULL || view == NULL || text == NULL
+      || view->numRows != staticGrid->numRows
+      || view->numCols != staticGrid->numCols
+      || liveGrid->numRows != staticGrid->numRows
+      || liveGrid->numCols != staticGrid->numCols) {
+    return NULL;
+  }
+  int stride = view->numCols + 2;
+  for (int r = 0; r <= view->numRows; r++) {
+    char* out = text + r * stride;
+    const char* staticRow = staticGrid->map[r];
+    const char* liveRow = liveGrid->map[r];
+    for (int w = 0; w < view->wordsPerRow; w++) {
+      int c0 = w * wordBits;
+      int n = view->numCols + 1 - c0;
+      if (n > wordBits) {
+        n = wordBits;
+      }
+      uint64_t all = (n == wordBits) ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+      uint64_t seen = view->seen[r * view->wordsPerRow + w] & all;
+      uint64_t visible = view->visible[r * view->wordsPerRow + w] & all;
+      if (seen == 0) {
+        memset(out + c0, solidRock, n);
+      } else if (visible == all) {
+        memcpy(out + c0, liveRow + c0, n);
+      } else if (visible == 0 && seen == all) {
+        memcpy(out + c0, staticRow + c0, n);
+      } else {
+        // a mix: copy what is remembered, then patch the runs of points
+        // not yet seen and of points visible
+        memcpy(out + c0, staticRow + c0, n);
+        grid_copyRuns(out + c0, NULL, all & ~seen);
+        grid_copyRuns(out + c0, liveRow + c0, visible);
+      }
+    }
+    out[view->numCols + 1] = '\n';
+  }
+  text[(view->numRows + 1) * stride] = '\0';
+  if (view->row >= 0) {
+    text[view->row * stride + view->col] = playerChar;
+  }
+  return text;
+}
+
+/**************** grid_viewCanSee() ****************/
+/* see grid.h for description */
+bool
+grid_viewCanSee(gridview_t* view, int row, int col)
+{
+  if (view == NULL || row < 0 || col < 0
+      || row > view->numRows || col > view->numCols) {
+    return false;
+  }
+  return (view->visible[row * view->wordsPerRow + col / wordBits]
+          >> (col % wordBits)) & 1;
+}
+
+/**************** grid_deleteView() ****************/
+/* see grid.h for description */
+void
+grid_deleteView(gridview_t* view)
+{
+  if (view != NULL) {
+    mem_free(view->seen);     // visible shares its allocation
+    if (view->shadowScratch != NULL) {
+      mem_free(view->shadowScratch);
+    }
+    mem_free(view);
+  }
 }
 
 /**************** grid_toString() ****************/
@@ -156,23 +466,27 @@ grid_toString(grid_t* grid){
   if (grid == NULL) {
     return NULL;
   } else {
-    char* string = (char*)(malloc((grid->numCols + 1) * (grid->numRows + 1) + grid->numRows + 2));
-    int idx = 0;
-    for (int row = 0; row <= grid->numRows; row++) {
-      for (int col = 0; col <= grid->numCols; col++) {
-        if (&grid->map[row][col] != NULL){
-          string[idx] = grid->map[row][col];
-          idx++;
-        }
-      }
-      string[idx] = '\n';
-      idx ++;
+    // the cells are already laid out as the string; copy them in one go
+    size_t length = (grid->numRows + 1) * (grid->numCols + 2) + 1;
+    char* string = (char*)(malloc(length));
+    if (string != NULL) {
+      memcpy(string, grid->cells, length);
     }
-    string[idx] = '\0';
     return string;
   }
 }
 
+/**************** grid_getText() ****************/
+/* see grid.h for description */
+const char*
+grid_getText(grid_t* grid)
+{
+  if (grid == NULL) {
+    return NULL;
+  }
+  return grid->cells;
+}
+
 /**************** grid_setGold() ****************/
 /* see grid.h for description */
 int
@@ -182,20 +496,186 @@ grid_setGold(grid_t* liveGrid, int minGoldPiles, int maxGoldPiles) {
   } else {
     int count = 0;
     int numPiles = (rand() % (maxGoldPiles - minGoldPiles + 1)) + minGoldPiles;
-    for (int i = 0; i <= numPiles; i++) {
-      int row = (rand() % (liveGrid->numRows + 1));
-      int col = (rand() % (liveGrid->numCols +1));
-      if (liveGrid->map[row][col] == roomSpot) {
-        liveGrid->map[row][col] = goldPile;
-        count++;
-      } else {
-        i--;
-      }
+    int row, col;
+    // each pile goes on a free room spot; stop early if there are none left
+    for (int i = 0; i <= numPiles && grid_randomFree(liveGrid, &row, &col); i++) {
+      grid_setCell(liveGrid, row, col, goldPile);
+      count++;
     }
     return count;
   }
 }
 
+/**************** grid_randomFree() ****************/
+/* see grid.h for description */
+bool
+grid_randomFree(grid_t* grid, int* row, int* col)
+{
+  if (grid == NULL || row == NULL || col == NULL) {
+    return false;
+  }
+  if (grid->freeIndex == NULL && !grid_buildFreeIndex(grid)) {
+    return false;
+  }
+  freeindex_t* index = grid->freeIndex;
+  if (index->count == 0) {
+    return false;
+  }
+  int cell = index->cells[rand() % index->count];
+  *row = cell / (grid->numCols + 1);
+  *col = cell % (grid->numCols + 1);
+  return true;
+}
+
+/**************** grid_numFree() ****************/
+/* see grid.h for description */
+int
+grid_numFree(grid_t* grid)
+{
+  if (grid == NULL) {
+    return 0;
+  }
+  if (grid->freeIndex == NULL && !grid_buildFreeIndex(grid)) {
+    return 0;
+  }
+  return grid->freeIndex->count;
+}
+
+/**************** grid_buildVisIndex() ****************/
+/* see grid.h for description */
+bool
+grid_buildVisIndex(grid_t* staticGrid)
+{
+  if (staticGrid == NULL) {
+    return false;
+  }
+  if (staticGrid->visIndex != NULL) {
+    return true;                // already built
+  }
+  if (staticGrid->numRows > SHRT_MAX || staticGrid->numCols > SHRT_MAX) {
+    return false;               // runs could not hold the rows and columns
+  }
+
+  int width = staticGrid->numCols + 1;
+  int numCells = (staticGrid->numRows + 1) * width;
+  visindex_t* index = mem_malloc(sizeof(visindex_t));
+  if (index == NULL) {
+    return false;
+  }
+  index->first = mem_calloc(numCells + 1, sizeof(int));
+  if (index->first == NULL) {
+    mem_free(index);
+    return false;
+  }
+  index->runs = NULL;
+  index->numRuns = 0;
+  int size = 0;                 // number of runs allocated
+  int scratchSize = fov_scratchSize(staticGrid);
+  int* scratch = mem_malloc(scratchSize * sizeof(int) + numCells);
+  if (scratch == NULL) {
+    mem_free(index->first);
+    mem_free(index);
+    return false;
+  }
+  unsigned char* visible = (unsigned char*)(scratch + scratchSize);
+
+  // compute the view from every spot a player can stand on, once
+  for (int cell = 0; cell < numCells; cell++) {
+    int rPlayer = cell / width;
+    int cPlayer = cell % width;
+    index->first[cell] = index->numRuns;
+    char spot = staticGrid->map[rPlayer][cPlayer];
+    if (spot != roomSpot && spot != passageSpot) {
+      continue;                 // not a viewpoint
+    }
+    if (visEngine == visShadow) {
+      fov_compute(staticGrid, rPlayer, cPlayer, visible, scratch);
+    }
+    for (int r = 0; r <= staticGrid->numRows; r++) {
+      int start = -1;           // start of the current run, if any
+      for (int c = 0; c <= staticGrid->numCols; c++) {
+        bool isVisible = (visEngine == visShadow)
+                         ? visible[r * width + c]
+                         : grid_isVisible(staticGrid, r, c, rPlayer, cPlayer);
+        if (isVisible) {
+          if (start < 0) {
+            start = c;
+          }
+        } else if (start >= 0) {
+          grid_addVisRun(index, &size, r, start, c - 1);
+          start = -1;
+        }
+      }
+      if (start >= 0) {
+        grid_addVisRun(index, &size, r, start, staticGrid->numCols);
+      }
+    }
+  }
+  index->first[numCells] = index->numRuns;
+  mem_free(scratch);
+
+  staticGrid->visIndex = index;
+  return true;
+}
+
+/**************** grid_canSee() ****************/
+/* see grid.h for description */
+bool
+grid_canSee(grid_t* staticGrid, int rowPlayer, int colPlayer, int row, int col)
+{
+  if (staticGrid == NULL || row < 0 || col < 0 || rowPlayer < 0 || colPlayer < 0
+      || row > staticGrid->numRows || col > staticGrid->numCols
+      || rowPlayer > staticGrid->numRows || colPlayer > staticGrid->numCols) {
+    return false;
+  }
+  // look the point up among the runs visible from the player, if indexed
+  visindex_t* index = staticGrid->visIndex;
+  if (index != NULL) {
+    int cell = rowPlayer * (staticGrid->numCols + 1) + colPlayer;
+    if (index->first[cell] < index->first[cell + 1]) {
+      for (int i = index->first[cell]; i < index->first[cell + 1]; i++) {
+        visrun_t* run = &index->runs[i];
+        if (run->row > row) {
+          break;              // runs are in row order
+        }
+        if (run->row == row && run->colStart <= col && col <= run->colEnd) {
+          return true;
+        }
+      }
+      return false;
+    }
+  }
+  return grid_isVisible(staticGrid, row, col, rowPlayer, colPlayer);
+}
+
+/**************** grid_setVisEngine() ****************/
+/* see grid.h for description */
+void
+grid_setVisEngine(visEngine_t engine)
+{
+  visEngine = engine;
+}
+
+/**************** grid_getVisEngine() ****************/
+/* see grid.h for description */
+visEngine_t
+grid_getVisEngine(void)
+{
+  return visEngine;
+}
+
+/**************** grid_getVisCounts() ****************/
+/* see grid.h for description */
+void
+grid_getVisCounts(unsigned long* passes, unsigned long* cells)
+{
+  if (passes != NULL) {
+    *passes = atomic_load_explicit(&visPasses, memory_order_relaxed);
+  }
+  if (cells != NULL) {
+    *cells = atomic_load_explicit(&visCells, memory_order_relaxed);
+  }
+}
 
 /**************** grid_delete() ****************/
 /* see grid.h for description */
@@ -203,11 +683,19 @@ void
 grid_delete(grid_t* grid) 
 {
   if (grid != NULL) {
-    // loop through each array in map
-    for(int i = 0; i <= grid->numRows; i++) {
-      mem_free(grid->map[i]);
-    }
+    // the rows all live in one buffer
+    mem_free(grid->cells);
     mem_free(grid->map);
+    if (grid->visIndex != NULL) {
+      mem_free(grid->visIndex->first);
+      free(grid->visIndex->runs);
+      mem_free(grid->visIndex);
+    }
+    if (grid->freeIndex != NULL) {
+      mem_free(grid->freeIndex->cells);
+      mem_free(grid->freeIndex->slot);
+      mem_free(grid->freeIndex);
+    }
     mem_free(grid);
   }
 }
@@ -261,28 +749,534 @@ grid_getCols(grid_t* grid)
 }
 
 /**************** grid_calcVisibility() **************** /
- * loops through each point in the grid map. If the point is visible, it is
- * added to our player's grid map.
+ * loops through each point in the grid map. If the point is visible, its bit
+ * is set in bits, the seen or visible bitset of the player's view.
  */
 static void
-grid_calcVisibility(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, int rPlayer, int cPlayer) 
+grid_calcVisibility(grid_t* staticGrid, gridview_t* view, uint64_t* bits, int rPlayer, int cPlayer) 
 {
-  if (staticGrid == NULL || liveGrid == NULL || playerGrid == NULL){
+  if (staticGrid == NULL || view == NULL){
     exit(1);
   }
+  // use the precomputed view from this spot, if there is one
+  if (staticGrid->visIndex != NULL) {
+    int cell = rPlayer * (staticGrid->numCols + 1) + cPlayer;
+    if (staticGrid->visIndex->first[cell] < staticGrid->visIndex->first[cell + 1]) {
+      grid_indexVisibility(staticGrid, view, bits, rPlayer, cPlayer);
+      return;
+    }
+  }
+  if (visEngine == visShadow) {
+    grid_shadowVisibility(staticGrid, view, bits, rPlayer, cPlayer);
+    return;
+  }
+  grid_countVisPass((staticGrid->numRows + 1) * (staticGrid->numCols + 1));
   // loop through each point and determine if it is visible
-  for (int r = 0; r <= liveGrid->numRows; r++) {
-    for (int c = 0; c <= liveGrid->numCols; c++) {
-      // if it is visible add it to the player grid
-        if (grid_isVisible(staticGrid, r, c, rPlayer, cPlayer )) {
-          playerGrid->map[r][c] = liveGrid->map[r][c];
-        } 
-        // if it is no longer visible, change to what it has remembered
-        else if (playerGrid->map[r][c] != solidRock && playerGrid->map[r][c] != playerChar) {
-          playerGrid->map[r][c] = staticGrid->map[r][c];
-        } 
+  for (int r = 0; r <= staticGrid->numRows; r++) {
+    uint64_t* row = bits + r * view->wordsPerRow;
+    for (int c = 0; c <= staticGrid->numCols; c++) {
+      // points already set need no line of sight
+      uint64_t bit = (uint64_t)1 << (c % wordBits);
+      if ((row[c / wordBits] & bit) == 0
+          && grid_isVisible(staticGrid, r, c, rPlayer, cPlayer)) {
+        row[c / wordBits] |= bit;
+      }
+    }
+  }
+}
+
+/**************** grid_indexVisibility() **************** /
+ * same result as grid_calcVisibility, setting the bits of the runs the
+ * visibility index of the static grid holds for the player's position.
+ */
+static void
+grid_indexVisibility(grid_t* staticGrid, gridview_t* view, uint64_t* bits, int rPlayer, int cPlayer)
+{
+  visindex_t* index = staticGrid->visIndex;
+  int cell = rPlayer * (staticGrid->numCols + 1) + cPlayer;
+
+  unsigned long cells = 0;
+  for (int i = index->first[cell]; i < index->first[cell + 1]; i++) {
+    visrun_t* run = &index->runs[i];
+    grid_setBits(bits + run->row * view->wordsPerRow,
+                 run->colStart, run->colEnd);
+    cells += run->colEnd - run->colStart + 1;
+  }
+  grid_countVisPass(cells);
+}
+
+/**************** grid_shadowVisibility() **************** /
+ * same result as grid_calcVisibility, finding the visible points with one
+ * shadowcasting pass (see fov.h) instead of a line of sight per point.
+ * The view's scratch space is allocated on its first pass and kept, so
+ * later passes allocate nothing.
+ */
+static void
+grid_shadowVisibility(grid_t* staticGrid, gridview_t* view, uint64_t* bits, int rPlayer, int cPlayer)
+{
+  int width = staticGrid->numCols + 1;
+  int scratchSize = fov_scratchSize(staticGrid);
+  if (view->shadowScratch == NULL) {
+    view->shadowScratch = mem_malloc(scratchSize * sizeof(int)
+                                     + (staticGrid->numRows + 1) * width);
+    if (view->shadowScratch == NULL) {
+      exit(1);
     }
   }
+  unsigned char* visible = (unsigned char*)(view->shadowScratch + scratchSize);
+  fov_compute(staticGrid, rPlayer, cPlayer, visible, view->shadowScratch);
+  grid_countVisPass((staticGrid->numRows + 1) * width);
+
+  for (int r = 0; r <= staticGrid->numRows; r++) {
+    uint64_t* row = bits + r * view->wordsPerRow;
+    for (int c = 0; c <= staticGrid->numCols; c++) {
+      if (visible[r * width + c]) {
+        row[c / wordBits] |= (uint64_t)1 << (c % wordBits);
+      }
+    }
+  }
+}
+
+/**************** grid_countVisPass() **************** /
+ * counts one visibility pass that looked at the given number of cells.
+ */
+static void
+grid_countVisPass(unsigned long cells)
+{
+  atomic_fetch_add_explicit(&visPasses, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&visCells, cells, memory_order_relaxed);
+}
+
+/**************** grid_setBits() **************** /
+ * sets the bits of columns colStart to colEnd in one row of a view's bitset.
+ */
+static void
+grid_setBits(uint64_t* row, int colStart, int colEnd)
+{
+  int first = colStart / wordBits;
+  int last = colEnd / wordBits;
+  uint64_t firstMask = ~(uint64_t)0 << (colStart % wordBits);
+  uint64_t lastMask = ~(uint64_t)0 >> (wordBits - 1 - colEnd % wordBits);
+  if (first == last) {
+    row[first] |= firstMask & lastMask;
+    return;
+  }
+  row[first] |= firstMask;
+  for (int w = first + 1; w < last; w++) {
+    row[w] = ~(uint64_t)0;
+  }
+  row[last] |= lastMask;
+}
+
+/**************** grid_copyRuns() **************** /
+ * copies the points of each run of set bits in a word of a view's bitset
+ * from the same points of a row, or makes them solid rock if from is NULL.
+ */
+static void
+grid_copyRuns(char* out, const char* from, uint64_t bits)
+{
+  while (bits != 0) {
+    int start = __builtin_ctzll(bits);
+    uint64_t after = ~(bits >> start);    // zero only if every bit is set
+    int length = (after == 0) ? wordBits : __builtin_ctzll(after);
+    if (from == NULL) {
+      memset(out + start, solidRock, length);
+    } else {
+      memcpy(out + start, from + start, length);
+    }
+    if (start + length == wordBits) {
+      break;
+    }
+    bits &= ~(uint64_t)0 << (start + length);
+  }
+}
+
+/**************** grid_loadText() **************** /
+ * loads a map from its text, mapping the file into memory to read it once;
+ * returns NULL if error.
+ */
+static grid_t*
+grid_loadText(const char* mapFile)
+{
+  int fd = open(mapFile, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = info.st_size;
+  char* text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);                    // the mapping stays valid without it
+  if (text == MAP_FAILED) {
+    return NULL;
+  }
+  grid_t* grid = grid_parse(text, size);
+  munmap(text, size);
+  return grid;
+}
+
+/**************** grid_loadCompiled() **************** /
+ * loads a map from the compiled map made from it by grid_compile, with its
+ * free index and, if it was built with the visibility engine now chosen,
+ * its visibility index; returns NULL if there is no compiled map, it is not
+ * up to date with the map file described by source, or error.
+ */
+static grid_t*
+grid_loadCompiled(const char* mapFile, const struct stat* source)
+{
+  char* nmapFile = grid_compiledName(mapFile);
+  if (nmapFile == NULL) {
+    return NULL;
+  }
+  int fd = open(nmapFile, O_RDONLY);
+  mem_free(nmapFile);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < sizeof(nmapheader_t)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = info.st_size;
+  char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  if (!grid_checkCompiled(data, size, source)) {
+    munmap(data, size);
+    return NULL;
+  }
+
+  // the sections follow the header, each 4-byte aligned
+  const nmapheader_t* header = (const nmapheader_t*)data;
+  int numCells = (header->numRows + 1) * (header->numCols + 1);
+  size_t textSize = (header->numRows + 1) * (header->numCols + 2) + 1;
+  const char* text = data + sizeof(nmapheader_t);
+  const int32_t* freeCells = (const int32_t*)(text + (textSize + 3) / 4 * 4);
+  const int32_t* first = freeCells + header->numFree;
+  const visrun_t* runs = (const visrun_t*)(first + numCells + 1);
+
+  grid_t* grid = grid_new(header->numRows, header->numCols);
+  freeindex_t* freeIndex = mem_malloc(sizeof(freeindex_t));
+  int* cells = mem_malloc(numCells * sizeof(int));
+  int* slot = mem_malloc(numCells * sizeof(int));
+  bool ok = grid != NULL && freeIndex != NULL && cells != NULL
+            && slot != NULL;
+  if (ok) {
+    memcpy(grid->cells, text, textSize);
+    memcpy(cells, freeCells, header->numFree * sizeof(int));
+    memset(slot, -1, numCells * sizeof(int));
+    for (int i = 0; i < header->numFree && ok; i++) {
+      ok = slot[cells[i]] < 0;  // each free cell is listed once
+      slot[cells[i]] = i;
+    }
+  }
+  if (ok) {
+    freeIndex->cells = cells;
+    freeIndex->slot = slot;
+    freeIndex->count = header->numFree;
+    grid->freeIndex = freeIndex;
+  } else {
+    if (freeIndex != NULL) {
+      mem_free(freeIndex);
+    }
+    if (cells != NULL) {
+      mem_free(cells);
+    }
+    if (slot != NULL) {
+      mem_free(slot);
+    }
+    grid_delete(grid);
+    grid = NULL;
+  }
+
+  // an index traced by another engine could disagree with this one
+  if (ok && header->numRuns >= 0 && header->engine == visEngine) {
+    visindex_t* visIndex = mem_malloc(sizeof(visindex_t));
+    int* runFirst = mem_malloc((numCells + 1) * sizeof(int));
+    visrun_t* visRuns = malloc((header->numRuns + 1) * sizeof(visrun_t));
+    if (visIndex != NULL && runFirst != NULL && visRuns != NULL) {
+      memcpy(runFirst, first, (numCells + 1) * sizeof(int));
+      memcpy(visRuns, runs, header->numRuns * sizeof(visrun_t));
+      visIndex->first = runFirst;
+      visIndex->runs = visRuns;
+      visIndex->numRuns = header->numRuns;
+      grid->visIndex = visIndex;
+    } else {                    // grid_buildVisIndex can still build it
+      if (visIndex != NULL) {
+        mem_free(visIndex);
+      }
+      if (runFirst != NULL) {
+        mem_free(runFirst);
+      }
+      free(visRuns);
+    }
+  }
+  munmap(data, size);
+  return grid;
+}
+
+/**************** grid_checkCompiled() **************** /
+ * returns true if data, size bytes long, is a whole compiled map made by
+ * this version of the module from the map file described by source, with
+ * every number in it in range, so that it can be loaded without further
+ * checks; false otherwise.
+ */
+static bool
+grid_checkCompiled(const char* data, size_t size, const struct stat* source)
+{
+  const nmapheader_t* header = (const nmapheader_t*)data;
+  if (memcmp(header->magic, nmapMagic, sizeof(header->magic)) != 0
+      || header->version != nmapVersion
+      || header->sourceSize != source->st_size
+      || header->sourceSeconds != source->st_mtim.tv_sec
+      || header->sourceNanos != source->st_mtim.tv_nsec
+      || header->numRows <= 0 || header->numCols <= 0
+      || header->numRows > SHRT_MAX || header->numCols > SHRT_MAX) {
+    return false;
+  }
+
+  // the file must be exactly as long as its sections
+  int width = header->numCols + 1;
+  int numCells = (header->numRows + 1) * width;
+  size_t textSize = (header->numRows + 1) * (header->numCols + 2) + 1;
+  size_t expected = sizeof(nmapheader_t) + (textSize + 3) / 4 * 4;
+  if (header->numFree < 0 || header->numFree > numCells) {
+    return false;
+  }
+  expected += header->numFree * sizeof(int32_t);
+  if (header->numRuns >= 0) {
+    expected += (numCells + 1) * sizeof(int32_t)
+                + (size_t)header->numRuns * sizeof(visrun_t);
+  }
+  if (size != expected) {
+    return false;
+  }
+
+  // the cells must be laid out as grid_new lays them out
+  const char* text = data + sizeof(nmapheader_t);
+  for (int row = 0; row <= header->numRows; row++) {
+    if (text[row * (width + 1) + width] != '\n') {
+      return false;
+    }
+  }
+  if (text[textSize - 1] != '\0') {
+    return false;
+  }
+
+  // the free cells must be the room spots (grid_loadCompiled checks that
+  // none is listed twice)
+  const int32_t* freeCells = (const int32_t*)(text + (textSize + 3) / 4 * 4);
+  for (int i = 0; i < header->numFree; i++) {
+    int cell = freeCells[i];
+    if (cell < 0 || cell >= numCells
+        || text[cell / width * (width + 1) + cell % width] != roomSpot) {
+      return false;
+    }
+  }
+  int roomSpots = 0;
+  for (size_t i = 0; i < textSize; i++) {  // newlines are not room spots
+    roomSpots += (text[i] == roomSpot);
+  }
+  if (roomSpots != header->numFree) {
+    return false;
+  }
+
+  // each cell's runs must follow the last cell's, and lie in the grid
+  if (header->numRuns >= 0) {
+    const int32_t* first = freeCells + header->numFree;
+    const visrun_t* runs = (const visrun_t*)(first + numCells + 1);
+    if (first[0] != 0 || first[numCells] != header->numRuns) {
+      return false;
+    }
+    for (int cell = 0; cell < numCells; cell++) {
+      if (first[cell] > first[cell + 1]) {
+        return false;
+      }
+    }
+    for (int i = 0; i < header->numRuns; i++) {
+      if (runs[i].row < 0 || runs[i].row > header->numRows
+          || runs[i].colStart < 0 || runs[i].colStart > runs[i].colEnd
+          || runs[i].colEnd > header->numCols) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**************** grid_compiledName() **************** /
+ * returns the name of the compiled form of a map file: its name with .nmap
+ * in place of .txt, or added if it does not end in .txt; NULL if error.
+ * The caller frees it with mem_free.
+ */
+static char*
+grid_compiledName(const char* mapFile)
+{
+  size_t length = strlen(mapFile);
+  if (length >= 4 && strcmp(mapFile + length - 4, ".txt") == 0) {
+    length -= 4;
+  }
+  char* name = mem_malloc(length + strlen(".nmap") + 1);
+  if (name != NULL) {
+    memcpy(name, mapFile, length);
+    strcpy(name + length, ".nmap");
+  }
+  return name;
+}
+
+/**************** grid_parse() **************** /
+ * makes a grid from the text of a map file, size bytes long, finding the
+ * lines with memchr in one pass; returns NULL if error.
+ * The grid has a row for every newline; a line longer than every line
+ * before it sets the width to its length plus one. The text after the last
+ * newline, if any, goes in the extra row at the bottom.
+ */
+static grid_t*
+grid_parse(const char* text, size_t size)
+{
+  // the start and length of every line, growing as more are found
+  int maxLines = 16;
+  int numLines = 0;
+  int* starts = malloc(maxLines * sizeof(int));
+  int* lengths = malloc(maxLines * sizeof(int));
+  if (starts == NULL || lengths == NULL) {
+    free(starts);
+    free(lengths);
+    return NULL;
+  }
+
+  int numRows = 0;    // newlines seen
+  int numCols = 0;
+  const char* end = text + size;
+  for (const char* line = text; line < end; ) {
+    const char* newline = memchr(line, '\n', end - line);
+    int length = (newline != NULL ? newline : end) - line;
+    if (numLines == maxLines) {
+      maxLines *= 2;
+      int* moreStarts = realloc(starts, maxLines * sizeof(int));
+      int* moreLengths = realloc(lengths, maxLines * sizeof(int));
+      if (moreStarts != NULL) {
+        starts = moreStarts;
+      }
+      if (moreLengths != NULL) {
+        lengths = moreLengths;
+      }
+      if (moreStarts == NULL || moreLengths == NULL) {
+        free(starts);
+        free(lengths);
+        return NULL;
+      }
+    }
+    starts[numLines] = line - text;
+    lengths[numLines++] = length;
+    if (length > numCols) {
+      numCols = length + 1;
+    }
+    if (newline == NULL) {
+      break;
+    }
+    numRows++;
+    line = newline + 1;
+  }
+
+  grid_t* grid = grid_new(numRows, numCols);
+  if (grid != NULL) {
+    // grid_new filled every row with solid rock; copy each line over it
+    for (int row = 0; row < numLines; row++) {
+      memcpy(grid->map[row], text + starts[row], lengths[row]);
+    }
+    grid_buildFreeIndex(grid);  // without it, grid_randomFree builds it
+  }
+  free(starts);
+  free(lengths);
+  return grid;
+}
+
+/**************** grid_buildFreeIndex() **************** /
+ * indexes the room spots of the grid that nothing occupies; returns false if
+ * out of memory, leaving the grid without an index.
+ */
+static bool
+grid_buildFreeIndex(grid_t* grid)
+{
+  int width = grid->numCols + 1;
+  int numCells = (grid->numRows + 1) * width;
+  freeindex_t* index = mem_malloc(sizeof(freeindex_t));
+  int* cells = mem_malloc(numCells * sizeof(int));
+  int* slot = mem_malloc(numCells * sizeof(int));
+  if (index == NULL || cells == NULL || slot == NULL) {
+    if (index != NULL) {
+      mem_free(index);
+    }
+    if (cells != NULL) {
+      mem_free(cells);
+    }
+    if (slot != NULL) {
+      mem_free(slot);
+    }
+    return false;
+  }
+  index->cells = cells;
+  index->slot = slot;
+  index->count = 0;
+  for (int cell = 0; cell < numCells; cell++) {
+    if (grid->map[cell / width][cell % width] == roomSpot) {
+      slot[cell] = index->count;
+      cells[index->count++] = cell;
+    } else {
+      slot[cell] = -1;
+    }
+  }
+  grid->freeIndex = index;
+  return true;
+}
+
+/**************** grid_setCell() **************** /
+ * writes a character into a cell, keeping the free index (if any) up to
+ * date: a cell is free exactly when it holds a room spot.
+ */
+static void
+grid_setCell(grid_t* grid, int row, int col, char c)
+{
+  freeindex_t* index = grid->freeIndex;
+  if (index != NULL) {
+    int cell = row * (grid->numCols + 1) + col;
+    bool wasFree = index->slot[cell] >= 0;
+    if (c == roomSpot && !wasFree) {
+      index->slot[cell] = index->count;
+      index->cells[index->count++] = cell;
+    } else if (c != roomSpot && wasFree) {
+      // move the last free cell into the hole
+      int last = index->cells[--index->count];
+      index->cells[index->slot[cell]] = last;
+      index->slot[last] = index->slot[cell];
+      index->slot[cell] = -1;
+    }
+  }
+  grid->map[row][col] = c;
+}
+
+/**************** grid_addVisRun() **************** /
+ * appends one run to the visibility index, growing the run array as needed.
+ */
+static void
+grid_addVisRun(visindex_t* index, int* size, int row, int colStart, int colEnd)
+{
+  if (index->numRuns == *size) {
+    *size = (*size == 0) ? 1024 : *size * 2;
+    index->runs = mem_assert(realloc(index->runs, *size * sizeof(visrun_t)),
+                             "visibility index");
+  }
+  visrun_t* run = &index->runs[index->numRuns++];
+  run->row = row;
+  run->colStart = colStart;
+  run->colEnd = colEnd;
 }
 
 /* *************** grid_isVisible() **************** /
@@ -16,6 +16,13 @@
 
 /**************** global types ****************/
 typedef struct grid grid_t;  // opaque to users of the module
+typedef struct gridview gridview_t;  // what one player has seen; opaque
+
+/* ways to compute what a player can see; both give the same visible set */
+typedef enum {
+  visRays,      // trace a line of sight to every point of the grid
+  visShadow     // one shadowcasting pass over the grid (see fov.h)
+} visEngine_t;
 
 /**************** functions ****************/
 
@@ -40,23 +47,77 @@ grid_t* grid_new(int numRows, int numCols);
  *   valid name to a valid map file.
  * We return:
  *  the grid with the loaded map; return NULL if error
+ * Note:
+ *   if grid_compile has compiled the map file since it last changed, the
+ *   compiled map is loaded instead, with its free spots already indexed and,
+ *   if it has one built with the visibility engine now chosen, its
+ *   visibility index; otherwise the text is mapped into memory and read
+ *   once, finding its lines with memchr.
  */
 grid_t* grid_load(const char* mapFile);
 
+/**************** grid_copy ****************/
+/* Makes a new grid holding the same map as another, without reading the
+ * map file again.
+ *
+ * Caller provides:
+ *   valid pointer to the grid to copy.
+ * We return:
+ *   the new grid, without a visibility index; NULL if error.
+ * Caller is responsible for:
+ *   later calling grid_delete.
+ */
+grid_t* grid_copy(grid_t* grid);
+
+/**************** grid_compile ****************/
+/* Compile a map file, so that grid_load can load it without reading the
+ * text or indexing it again.
+ *
+ * Caller provides:
+ *   valid name to a valid map file,
+ *   whether to build a visibility index, with the visibility engine now
+ *   chosen, and keep it in the compiled map.
+ * We return:
+ *   true if the compiled map was written; false if error.
+ * We do:
+ *   write the map, with its free spots and perhaps its visibility index, to
+ *   a binary file named like the map file with .nmap in place of .txt
+ *   (or added). The compiled map records the size and modification time of
+ *   the map file; grid_load ignores it once either changes, and on a machine
+ *   of another byte order.
+ */
+bool grid_compile(const char* mapFile, const bool withIndex);
+
+/**************** grid_newView ****************/
+/* Create a view of a grid for a player who has seen nothing yet.
+ *
+ * Caller provides:
+ *   valid pointer to the default grid (staticGrid) the player is on.
+ * We return:
+ *   pointer to the new view; return NULL if error.
+ * Note:
+ *   a view keeps one bit per cell for the points the player has seen, and
+ *   one for the points they saw at their last grid_update, rather than a
+ *   grid of its own; grid_composeView makes the player's grid from it.
+ * Caller is responsible for:
+ *   later calling grid_deleteView.
+ */
+gridview_t* grid_newView(grid_t* staticGrid);
+
 /**************** grid_update ****************/
 /* Changes characters in the proper grid to reflect current state and changes
- * updates the live grid and changes player's grid based on visibility
+ * updates the live grid and changes player's view based on visibility
  *
  * Caller provides:
  *   valid pointer to a grid that will be the default (staticGrid), 
  *   valid pointer to a grid that reflects current game (liveGrid),
- *   valid pointer to a grid that reflects what a player sees,
+ *   valid pointer to the view of what a player has seen,
  *   the character ID of a player,
  *   the row and column position that we are manipulating in the grids.
  * We return:
  *   nothing
  */
-void grid_update(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, char id, int row, int col );
+void grid_update(grid_t* staticGrid, grid_t* liveGrid, gridview_t* view, char id, int row, int col );
 
 /**************** grid_remove ****************/
 /* Removes an item from the live grid and sets it back to the default at the row and column positions
@@ -64,12 +125,69 @@ void grid_update(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, char
  * Caller provides:
  *   valid pointer to the default grid (staticGrid),
  *   valid pointer to the live grid,
- *   valid pointer to the player grid,
+ *   valid pointer to the player's view,
  *   valid row and position we are removing a character from
  * We return:
  *   nothing
+ * Note:
+ *   the player's view shows the spot as the default grid does until their
+ *   next grid_update.
+ */
+void grid_remove(grid_t* staticGrid, grid_t* liveGrid, gridview_t* view, int row, int col );
+
+/**************** grid_reveal ****************/
+/* Marks as seen everything visible from a spot a player only passes through,
+ * without refreshing the rest of the player's view
+ *
+ * Caller provides:
+ *   valid pointer to the default grid (staticGrid),
+ *   valid pointer to the player's view,
+ *   valid row and column position the player passed through.
+ * We return:
+ *   nothing
+ * Note:
+ *   a point seen only in passing is remembered as the default grid shows it,
+ *   so a later grid_update gives the same view as if grid_update had
+ *   been called at the spot; with a visibility index this costs only the
+ *   visible runs rather than a pass over the whole grid.
+ */
+void grid_reveal(grid_t* staticGrid, gridview_t* view, int row, int col);
+
+/**************** grid_composeView ****************/
+/* Write the player's grid, as grid_toString would print it, from their view
+ *
+ * Caller provides:
+ *   valid pointer to the default grid (staticGrid),
+ *   valid pointer to the live grid,
+ *   valid pointer to the player's view,
+ *   a buffer with room for a string as long as grid_getText(staticGrid).
+ * We return:
+ *   the buffer; return NULL if error.
+ * Note:
+ *   points visible at the last grid_update show the live grid, other points
+ *   the player has seen show the default grid, the rest are spaces, and the
+ *   player's own spot is '@'. Runs of 64 points seen alike are copied whole.
+ */
+char* grid_composeView(grid_t* staticGrid, grid_t* liveGrid, gridview_t* view, char* text);
+
+/**************** grid_viewCanSee ****************/
+/* Tells whether a point was visible to the player at their last grid_update.
+ *
+ * Caller provides:
+ *   valid pointer to the player's view,
+ *   the row and column position of the point.
+ * We return:
+ *   true if the point was visible;
+ *   false if not, or if the position is outside the grid.
+ * Note:
+ *   while the player stays where they were updated, this is grid_canSee from
+ *   their position, at the cost of one bit test.
  */
-void grid_remove(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, int row, int col );
+bool grid_viewCanSee(gridview_t* view, int row, int col);
+
+/**************** grid_deleteView ****************/
+/* Delete a view made by grid_newView; NULL is ignored. */
+void grid_deleteView(gridview_t* view);
 
 /**************** grid_toString ****************/
 /* Return the grid's 2D array as a single string
@@ -83,6 +201,18 @@ void grid_remove(grid_t* staticGrid, grid_t* liveGrid, grid_t* playerGrid, int r
  */
 char* grid_toString(grid_t* grid);
 
+/**************** grid_getText ****************/
+/* Return the grid's 2D array as a string, without copying it
+ *
+ * Caller provides:
+ *   valid pointer to the grid
+ * We return:
+ *  the same string grid_toString would make, owned by the grid; it reflects
+ *  later changes to the grid and is valid until grid_delete.
+ *  return NULL if error
+ */
+const char* grid_getText(grid_t* grid);
+
 /**************** grid_setGold ****************/
 /* Set random positions in the grid as gold piles.
  * 
@@ -91,10 +221,94 @@ char* grid_toString(grid_t* grid);
  *   minimum number of piles,
  *   maximum number of piles.
  * We return:
- *   number of gold piles generated
+ *   number of gold piles generated; fewer than asked for if the grid runs
+ *   out of free room spots
+ * Note:
+ *   piles are placed with grid_randomFree, so each pile takes one draw.
  */
 int grid_setGold(grid_t* liveGrid, int minGoldPiles, int maxGoldPiles);
 
+/**************** grid_randomFree ****************/
+/* Pick a random room spot that nothing (player or gold) occupies.
+ *
+ * Caller provides:
+ *   valid pointer to the live grid,
+ *   where to store the row and column of the spot.
+ * We return:
+ *   true if a spot was picked; false if there is none free, or error.
+ * Note:
+ *   the free spots are indexed by grid_load and kept up to date by
+ *   grid_update, grid_remove and grid_setGold, so this takes constant time
+ *   however few spots are free. Changes made through grid_getMap are not
+ *   seen by the index.
+ */
+bool grid_randomFree(grid_t* grid, int* row, int* col);
+
+/**************** grid_numFree ****************/
+/* Return the number of room spots nothing occupies; 0 if error. */
+int grid_numFree(grid_t* grid);
+
+/**************** grid_buildVisIndex ****************/
+/* Precompute, once, which points are visible from every room and passage
+ * spot of the static grid, so later calls to grid_update look the view up
+ * instead of tracing a line of sight to every point in the grid.
+ *
+ * Caller provides:
+ *   valid pointer to the default grid (staticGrid), which must not change
+ *   afterwards.
+ * We return:
+ *   true if the index is available; false if error (out of memory, or a
+ *   grid with more than SHRT_MAX rows or columns, which the index's runs
+ *   cannot hold).
+ * Note:
+ *   the index is optional; grid_update gives the same result without it.
+ *   it is freed by grid_delete.
+ */
+bool grid_buildVisIndex(grid_t* staticGrid);
+
+/**************** grid_canSee ****************/
+/* Tells whether a point can be seen from a player's position.
+ *
+ * Caller provides:
+ *   valid pointer to the default grid (staticGrid),
+ *   the row and column position of the player,
+ *   the row and column position of the point.
+ * We return:
+ *   true if the point is visible from the player's position;
+ *   false if not, or if either position is outside the grid.
+ * Note:
+ *   uses the visibility index when the static grid has one.
+ */
+bool grid_canSee(grid_t* staticGrid, int rowPlayer, int colPlayer, int row, int col);
+
+/**************** grid_setVisEngine ****************/
+/* Choose how grid_update and grid_buildVisIndex compute visibility.
+ *
+ * Caller provides:
+ *   visRays (the default) or visShadow.
+ * Note:
+ *   the setting applies to the whole module; grid_update still prefers a
+ *   visibility index when the static grid has one.
+ */
+void grid_setVisEngine(visEngine_t engine);
+
+/**************** grid_getVisEngine ****************/
+/* returns the engine chosen by grid_setVisEngine */
+visEngine_t grid_getVisEngine(void);
+
+/**************** grid_getVisCounts ****************/
+/* Report the visibility work done by the module since the program started.
+ *
+ * Caller provides:
+ *   where to put the number of visibility passes (one per grid_update or
+ *   grid_reveal), and the number of cells those passes looked at; either
+ *   may be NULL.
+ * Note:
+ *   a pass over the whole grid (rays or shadow) looks at every cell; a pass
+ *   from a visibility index looks at the cells of the visible runs only.
+ */
+void grid_getVisCounts(unsigned long* passes, unsigned long* cells);
+
 /**************** grid_delete ****************/
 /* Delete grid, deleting each array in the 2D array
  *
@@ -0,0 +1,233 @@
+/*
+ * histo.c - 'histo' module
+ *
+ * see histo.h for more documentation
+ *
+ * A value v of 16 or more has its bucket from the position of its highest
+ * set bit and the 4 bits after it; smaller values are their own bucket.
+ * Values of 2^MaxBits or more share the last bucket.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#define _POSIX_C_SOURCE 200809L   // for clock_gettime under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "histo.h"
+#include "mem.h"
+
+/**************** global constants ****************/
+#define SubBits 4                     // each power of 2 has 2^SubBits buckets
+#define SubBuckets (1 << SubBits)
+#define MaxBits 42                    // 2^42 ns is over an hour
+#define NumBuckets (SubBuckets + (MaxBits - SubBits) * SubBuckets)
+#define NameLength 24
+
+/**************** global types ****************/
+typedef struct histo {
+  char name[NameLength];
+  _Atomic uint64_t counts[NumBuckets];  // values in each bucket
+  _Atomic uint64_t sum;                 // of every value, for the mean
+  _Atomic uint64_t max;                 // largest value
+} histo_t;
+
+/**************** local functions ****************/
+static int histo_bucket(uint64_t value);
+static uint64_t histo_low(int bucket);
+static uint64_t histo_width(int bucket);
+
+/**************** histo_new() ****************/
+/* see histo.h for description */
+histo_t*
+histo_new(const char* name)
+{
+  histo_t* histo = mem_calloc(1, sizeof(histo_t));
+  if (histo == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < NumBuckets; i++) {
+    atomic_init(&histo->counts[i], 0);
+  }
+  atomic_init(&histo->sum, 0);
+  atomic_init(&histo->max, 0);
+  if (name != NULL) {
+    strncat(histo->name, name, NameLength - 1);
+  }
+  return histo;
+}
+
+/**************** histo_add() ****************/
+/* see histo.h for description */
+void
+histo_add(histo_t* histo, const uint64_t value)
+{
+  if (histo == NULL) {
+    return;
+  }
+  atomic_fetch_add_explicit(&histo->counts[histo_bucket(value)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&histo->sum, value, memory_order_relaxed);
+  uint64_t max = atomic_load_explicit(&histo->max, memory_order_relaxed);
+  while (value > max
+         && !atomic_compare_exchange_weak_explicit(&histo->max, &max, value,
+                                                   memory_order_relaxed,
+                                                   memory_order_relaxed)) {
+    // max now holds the latest maximum; try again if still smaller
+  }
+}
+
+/**************** histo_count() ****************/
+/* see histo.h for description */
+uint64_t
+histo_count(histo_t* histo)
+{
+  uint64_t count = 0;
+  if (histo != NULL) {
+    for (int i = 0; i < NumBuckets; i++) {
+      count += atomic_load_explicit(&histo->counts[i], memory_order_relaxed);
+    }
+  }
+  return count;
+}
+
+/**************** histo_max() ****************/
+/* see histo.h for description */
+uint64_t
+histo_max(histo_t* histo)
+{
+  return histo == NULL ? 0
+         : atomic_load_explicit(&histo->max, memory_order_relaxed);
+}
+
+/**************** histo_percentile() ****************/
+/* see histo.h for description */
+uint64_t
+histo_percentile(histo_t* histo, const double fraction)
+{
+  if (histo == NULL) {
+    return 0;
+  }
+  // read the buckets once, so that values added meanwhile cannot move
+  // the target past the end
+  uint64_t counts[NumBuckets];
+  uint64_t count = 0;
+  for (int i = 0; i < NumBuckets; i++) {
+    counts[i] = atomic_load_explicit(&histo->counts[i], memory_order_relaxed);
+    count += counts[i];
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  // the rank of the value wanted, from 1 to count
+  uint64_t rank = (uint64_t)(fraction * count);
+  if (rank < fraction * count) {
+    rank++;
+  }
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > count) {
+    rank = count;
+  }
+
+  int bucket = 0;
+  for (uint64_t seen = counts[0]; seen < rank; seen += counts[bucket]) {
+    bucket++;
+  }
+  uint64_t value = histo_low(bucket) + histo_width(bucket) / 2;
+  uint64_t max = histo_max(histo);
+  return value < max ? value : max;
+}
+
+/**************** histo_printHeader() ****************/
+/* see histo.h for description */
+void
+histo_printHeader(FILE* fp)
+{
+  fprintf(fp, "%-16s %10s %10s %10s %10s %10s %10s\n", "(microseconds)",
+          "count", "mean", "p50", "p99", "p99.9", "max");
+}
+
+/**************** histo_print() ****************/
+/* see histo.h for description */
+void
+histo_print(histo_t* histo, FILE* fp)
+{
+  if (histo == NULL) {
+    return;
+  }
+  uint64_t count = histo_count(histo);
+  uint64_t sum = atomic_load_explicit(&histo->sum, memory_order_relaxed);
+  fprintf(fp, "%-16s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+          histo->name, (unsigned long long)count,
+          count == 0 ? 0.0 : sum / 1e3 / count,
+          histo_percentile(histo, 0.5) / 1e3,
+          histo_percentile(histo, 0.99) / 1e3,
+          histo_percentile(histo, 0.999) / 1e3,
+          histo_max(histo) / 1e3);
+}
+
+/**************** histo_now() ****************/
+/* see histo.h for description */
+uint64_t
+histo_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**************** histo_delete() ****************/
+/* see histo.h for description */
+void
+histo_delete(histo_t* histo)
+{
+  if (histo != NULL) {
+    mem_free(histo);
+  }
+}
+
+/**************** histo_bucket() ****************/
+/* Return the bucket a value is counted in. */
+static int
+histo_bucket(uint64_t value)
+{
+  if (value < SubBuckets) {
+    return (int)value;
+  }
+  int top = 63 - __builtin_clzll(value);    // position of the highest bit
+  if (top >= MaxBits) {
+    return NumBuckets - 1;
+  }
+  int shift = top - SubBits;
+  return SubBuckets + shift * SubBuckets
+         + (int)((value >> shift) - SubBuckets);
+}
+
+/**************** histo_low() ****************/
+/* Return the smallest value counted in a bucket. */
+static uint64_t
+histo_low(int bucket)
+{
+  if (bucket < SubBuckets) {
+    return bucket;
+  }
+  int shift = (bucket - SubBuckets) / SubBuckets;
+  uint64_t sub = (bucket - SubBuckets) % SubBuckets;
+  return (SubBuckets + sub) << shift;
+}
+
+/**************** histo_width() ****************/
+/* Return the number of values counted in a bucket. */
+static uint64_t
+histo_width(int bucket)
+{
+  if (bucket < SubBuckets) {
+    return 1;
+  }
+  return (uint64_t)1 << ((bucket - SubBuckets) / SubBuckets);
+}
@@ -0,0 +1,90 @@
+/*
+ * histo.h - header file for CS50 'histo' module
+ *
+ * A histo_t counts how long something took, in nanoseconds, so that its
+ * percentiles can be read off while the program runs. The buckets are fixed
+ * and log-linear: values below 16 have a bucket each, and every power of two
+ * above that is split into 16 buckets of equal width, so a percentile is
+ * known to within 1/32 of its value, from nanoseconds to over an hour.
+ *
+ * Adding a value is a few instructions and takes no lock, so threads may add
+ * to the same histogram at once, and read it while others add to it.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#ifndef __HISTO_H
+#define __HISTO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**************** global types ****************/
+typedef struct histo histo_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** histo_new ****************/
+/* Create a new, empty histogram.
+ *
+ * Caller provides:
+ *   a name for the histogram, printed by histo_print; only its first 23
+ *   characters are kept.
+ * We return:
+ *   pointer to a new histo_t; NULL if error.
+ * Caller is responsible for:
+ *   later calling histo_delete.
+ */
+histo_t* histo_new(const char* name);
+
+/**************** histo_add ****************/
+/* Count one value, such as a time in nanoseconds; NULL is ignored.
+ */
+void histo_add(histo_t* histo, const uint64_t value);
+
+/**************** histo_count ****************/
+/* Return the number of values added; 0 if histo is NULL. */
+uint64_t histo_count(histo_t* histo);
+
+/**************** histo_max ****************/
+/* Return the largest value added; 0 if none, or histo is NULL. */
+uint64_t histo_max(histo_t* histo);
+
+/**************** histo_percentile ****************/
+/* Estimate a percentile of the values added.
+ *
+ * Caller provides:
+ *   valid pointer to a histo_t,
+ *   the fraction of values that should be at or below the result, such as
+ *   0.5 for the median or 0.999 for p99.9.
+ * We return:
+ *   the middle of the bucket holding that value, but no more than the
+ *   largest value added; 0 if no values were added.
+ */
+uint64_t histo_percentile(histo_t* histo, const double fraction);
+
+/**************** histo_printHeader ****************/
+/* Print the column headings for the lines histo_print prints. */
+void histo_printHeader(FILE* fp);
+
+/**************** histo_print ****************/
+/* Print one line for the histogram: its name, count, mean, p50, p99, p99.9
+ * and maximum, the times in microseconds. NULL is ignored.
+ */
+void histo_print(histo_t* histo, FILE* fp);
+
+/**************** histo_now ****************/
+/* Return the time on a monotonic clock, in nanoseconds, for timing what is
+ * added to a histogram.
+ */
+uint64_t histo_now(void);
+
+/**************** histo_delete ****************/
+/* Delete the histogram.
+ *
+ * Caller provides:
+ *   pointer to a histo_t; NULL is ignored.
+ */
+void histo_delete(histo_t* histo);
+
+#endif // __HISTO_H
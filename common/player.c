@@ -22,7 +22,7 @@ typedef struct player{
   int col;            // current column location of player
   int row;            // current row location of player
   int numGold;        // gold possessed by player
-  grid_t* visGrid;    // player's specific grid
+  gridview_t* view;   // what the player has seen, and sees now
   bool quit;          // player's quit status
 }player_t;
 
@@ -51,8 +51,8 @@ int player_getGold(const player_t* player)   {
   return player ? player->numGold   : 0; 
 }
 
-grid_t* player_getVisGrid(const player_t* player) {
-  return player ? player->visGrid   : NULL; 
+gridview_t* player_getView(const player_t* player) {
+  return player ? player->view   : NULL; 
 }
 
 bool player_getQuit(const player_t* player) {
@@ -64,9 +64,9 @@ bool player_getQuit(const player_t* player) {
 /* see player.h for documentation */
 player_t*
 player_newPlayer(char ID, addr_t address, char* name, int col, int row,
-                 grid_t* playerGrid)
+                 gridview_t* view)
 {
-  if (ID == '\0' || name == NULL || col < 0 || row < 0 || playerGrid == NULL){
+  if (ID == '\0' || name == NULL || col < 0 || row < 0 || view == NULL){
     return NULL; // player could not be initialized
   }
 
@@ -78,7 +78,7 @@ player_newPlayer(char ID, addr_t address, char* name, int col, int row,
   player->col = col;
   player->row = row;
   player->numGold = 0;
-  player->visGrid = playerGrid;
+  player->view = view;
   player->quit = false;
 
   return player;
@@ -88,15 +88,15 @@ player_newPlayer(char ID, addr_t address, char* name, int col, int row,
 /**************** player_newSpect ****************/
 /* see player.h for documentation */
 player_t*
-player_newSpect(grid_t* liveGrid, addr_t address)
+player_newSpect(addr_t address)
 {
-  if (liveGrid == NULL || (message_eqAddr(address, message_noAddr()))) {
+  if (message_eqAddr(address, message_noAddr())) {
     return NULL; // spectator could not be initialized
   }
 
   player_t* spectator = mem_assert(malloc(sizeof(player_t)), "player_t");
   spectator->address = address;
-  spectator->visGrid = liveGrid;
+  spectator->view = NULL;
   return spectator;
 }
 
@@ -120,8 +120,8 @@ player_delete(void* player)
   if (playerTemp != NULL){
 
     // then free all malloc'd memory
-    if (playerTemp->visGrid != NULL){
-      grid_delete(playerTemp->visGrid);
+    if (playerTemp->view != NULL){
+      grid_deleteView(playerTemp->view);
     } 
     if (playerTemp->name != NULL){
       free(playerTemp->name);
@@ -9,7 +9,7 @@
  *      player's address
  *      player's current (col,row) location
  *      player's number of gold nuggets collected  
- *      player's custom grid based on visibility
+ *      player's view: what they have seen, and see now
  *      player's quit status
  *
  * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
@@ -36,7 +36,7 @@ addr_t player_getAddress(const player_t* player);
 int player_getCol(const player_t* player);
 int player_getRow(const player_t* player);
 int player_getGold(const player_t* player);
-grid_t* player_getVisGrid(const player_t* player);
+gridview_t* player_getView(const player_t* player);
 bool player_getQuit(const player_t* player);
 
 /**************** player_newPlayer ****************/
@@ -46,7 +46,7 @@ bool player_getQuit(const player_t* player);
  *   address: player's address
  *   name: must be a non-null pointer to malloc'd memory.
  *   col,row: non-negative integers pertaining to location of player
- *   playerGrid: non-null pointer to a grid_t
+ *   view: non-null pointer to a gridview_t from grid_newView
  *
   * We return:
  *   pointer to new player_t, or NULL on any error.
@@ -55,13 +55,12 @@ bool player_getQuit(const player_t* player);
  *   later calling player_delete with the returned pointer.
  */
 player_t* player_newPlayer(char ID, addr_t address, char* name, int col, int row,
-                           grid_t* playerGrid);
+                           gridview_t* view);
 
 
 /**************** player_newSpect ****************/
 /* Allocate and initialize a new player_t structure for a spectator.
  * Caller provides:
- *   liveGrid: non-null pointer to a grid_t
  *   address: spectator's address
  *
  * We return:
@@ -70,7 +69,7 @@ player_t* player_newPlayer(char ID, addr_t address, char* name, int col, int row
  * Caller is responsible for:
  *   later calling player_deleteSpect with the returned pointer.
  */
-player_t* player_newSpect(grid_t* liveGrid, addr_t address);
+player_t* player_newSpect(addr_t address);
 
 
 /**************** player_quit ****************/
@@ -95,7 +94,7 @@ void player_quit(player_t* player);
  *
  * We do:
  *   we free the malloc'd name of the player, if not NULL
- *   we call grid_delete on the player's grid, if not NULL.
+ *   we call grid_deleteView on the player's view, if not NULL.
  *   we free pointer to the player_t provided, if not NULL
  */
 void player_delete(void* player);
@@ -109,9 +108,6 @@ void player_delete(void* player);
  *
  * We do:
  *   we free pointer to the player_t provided, if not NULL.
- *
- * IMPORTANT:
- *   liveMap should be free'd later on.
  */
 void player_deleteSpect(player_t* spectator);
 
@@ -0,0 +1,98 @@
+/*
+ * deltatest.c - test program for CS50 Nuggets Final Project's delta module
+ *
+ * usage: commandline takes no arguments
+ *
+ * CS50 Nuggets Final Project Spring 2021
+ * Grace Wang, Neha Ramsurrun, Ryan Yong
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "delta.h"
+#include "mem.h"
+
+/* prints the message, applies it to the client's frame, and checks the
+ * result against the frame the server sent; returns the new frame number.
+ */
+static int
+check(char* clientFrame, const char* message, const char* serverFrame)
+{
+    printf("%s", message);
+    int n = delta_apply(clientFrame, message);
+    printf("-> frame %d %s\n", n,
+           strcmp(clientFrame, serverFrame) == 0 ? "matches" : "DOES NOT MATCH");
+    return n;
+}
+
+int
+main()
+{
+    const char* frames[] = {
+        "+-----+\n|.....|\n|..@..|\n+-----+\n",
+        "+-----+\n|.....|\n|...@.|\n+-----+\n",
+        "+-----+\n|*....|\n|...@.|\n+-----+\n",
+        "+-----+\n|A....|\n|....@|\n+-----+\n",
+    };
+    char clientFrame[100] = "";
+    char baseFrame[100] = "";
+
+    delta_t* delta = delta_new();
+    if (delta == NULL) {
+        fprintf(stderr, "Error: delta_new failed\n");
+        exit(1);
+    }
+
+    // TESTING delta_encode before any ACK: always a keyframe
+    printf("Testing first frame (should be a keyframe, base 0):\n");
+    const char* message = delta_encode(delta, frames[0]);
+    int n = check(clientFrame, message, frames[0]);
+
+    // TESTING delta_ack
+    printf("\nTesting delta_ack:\n");
+    printf("ACK of unsent frame 5 (should be rejected): %s\n",
+           delta_ack(delta, 5) ? "accepted" : "rejected");
+    printf("ACK of frame %d (should be accepted): %s\n", n,
+           delta_ack(delta, n) ? "accepted" : "rejected");
+    strcpy(baseFrame, clientFrame);
+
+    // TESTING delta_encode after an ACK: only the changed runs
+    printf("\nTesting frame 2 (should be one run on row 2, base 1):\n");
+    message = delta_encode(delta, frames[1]);
+    check(clientFrame, message, frames[1]);
+
+    // without acknowledging frame 2, frame 3 still builds on frame 1
+    printf("\nTesting frame 3 without ACK of frame 2 (should have base 1):\n");
+    strcpy(clientFrame, baseFrame);
+    message = delta_encode(delta, frames[2]);
+    check(clientFrame, message, frames[2]);
+
+    printf("\nACK of frame 3, then stale ACK of frame 2 (should be accepted, rejected): ");
+    printf("%s, ", delta_ack(delta, 3) ? "accepted" : "rejected");
+    printf("%s\n", delta_ack(delta, 2) ? "accepted" : "rejected");
+
+    printf("\nTesting frame 4 (should have base 3, runs on rows 1 and 2):\n");
+    message = delta_encode(delta, frames[3]);
+    check(clientFrame, message, frames[3]);
+
+    // TESTING a frame that does not line up with the base
+    printf("\nTesting frame of a different size (should be a keyframe):\n");
+    delta_ack(delta, 4);
+    message = delta_encode(delta, "+--+\n|@.|\n+--+\n");
+    check(clientFrame, message, "+--+\n|@.|\n+--+\n");
+
+    // TESTING delta_apply with bad messages
+    printf("\nTesting delta_apply on malformed messages (should all be 0):\n");
+    printf("%d ", delta_apply(clientFrame, "DISPLAY\n"));
+    printf("%d ", delta_apply(clientFrame, "DELTA 9 5\n7 0 x\n"));
+    printf("%d\n", delta_apply(clientFrame, "DELTA 9 5\n0 2 xyz\n"));
+
+    // TESTING delta_delete
+    printf("\nTesting delta_delete:\n");
+    delta_delete(delta);
+    delta_delete(NULL);
+    printf("Net memory after delete (should be 0): %d\n", mem_net());
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * goldtest.c - test program for CS50 Nuggets Final Project's gold module
+ *
+ * usage: commandline takes no arguments
+ *
+ * CS50 Nuggets Final Project Spring 2021
+ * Grace Wang, Neha Ramsurrun, Ryan Yong
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gold.h"
+#include "grid.h"
+#include "mem.h"
+
+/* adds one pile's nuggets to the total in arg */
+static void
+sumNuggets(void* arg, int row, int col, int nuggets)
+{
+  *(int*)arg += nuggets;
+}
+
+/* counts the piles whose cell does not show a gold pile in the grid in arg */
+static void
+checkPile(void* arg, int row, int col, int nuggets)
+{
+  if (grid_getChar(arg, row, col) != '*' || nuggets < 1) {
+    printf("pile at (%d, %d) with %d nuggets is not on the grid\n",
+           row, col, nuggets);
+  }
+}
+
+/* returns the piles of a game on maps/main.txt seeded with seed, as text */
+static void
+describePiles(int seed, char* text, size_t size)
+{
+  srand(seed);
+  grid_t* grid = grid_load("maps/main.txt");
+  gold_t* gold = gold_new(grid, 250, 10, 30);
+  text[0] = '\0';
+  for (int row = 0; row <= grid_getRows(grid); row++) {
+    for (int col = 0; col <= grid_getCols(grid); col++) {
+      int nuggets = gold_at(gold, row, col);
+      if (nuggets > 0 && strlen(text) + 20 < size) {
+        sprintf(text + strlen(text), "(%d,%d)=%d ", row, col, nuggets);
+      }
+    }
+  }
+  gold_delete(gold);
+  grid_delete(grid);
+}
+
+int
+main()
+{
+  srand(1);
+  grid_t* grid = grid_load("maps/main.txt");
+  gold_t* gold = gold_new(grid, 250, 10, 30);
+  if (grid == NULL || gold == NULL) {
+    fprintf(stderr, "Error: gold_new failed\n");
+    exit(1);
+  }
+
+  // TESTING gold_new: every pile is on the grid, and the sizes add up
+  printf("Testing gold_new:\n");
+  int piles = gold_numPiles(gold);
+  printf("piles: %d (should be between 10 and 31)\n", piles);
+  int total = 0;
+  gold_iterate(gold, &total, sumNuggets);
+  printf("nuggets in piles: %d, left: %d (should both be 250)\n",
+         total, gold_nuggetsLeft(gold));
+  gold_iterate(gold, grid, checkPile);
+
+  // TESTING gold_at and gold_pickup on every cell
+  printf("\nTesting gold_pickup on every cell:\n");
+  int picked = 0, found = 0, mismatches = 0;
+  for (int row = 0; row <= grid_getRows(grid); row++) {
+    for (int col = 0; col <= grid_getCols(grid); col++) {
+      int expected = gold_at(gold, row, col);
+      int nuggets = gold_pickup(gold, row, col);
+      if (nuggets != expected || gold_at(gold, row, col) != 0) {
+        mismatches++;
+      }
+      if (nuggets > 0) {
+        picked += nuggets;
+        found++;
+      }
+    }
+  }
+  printf("found %d piles with %d nuggets, %d mismatches (should be %d, 250, 0)\n",
+         found, picked, mismatches, piles);
+  printf("piles left: %d, nuggets left: %d (should be 0, 0)\n",
+         gold_numPiles(gold), gold_nuggetsLeft(gold));
+  printf("pickup of an empty cell, and off the grid (should be 0, 0): %d, %d\n",
+         gold_pickup(gold, 3, 3), gold_pickup(gold, -1, 500));
+
+  // TESTING gold_new with more piles than nuggets
+  printf("\nTesting gold_new with 5 nuggets for at least 10 piles "
+         "(should be NULL): %s\n",
+         gold_new(grid, 5, 10, 30) == NULL ? "NULL" : "not NULL");
+
+  // TESTING that the same seed gives the same piles and sizes
+  char first[2000], second[2000];
+  describePiles(42, first, sizeof(first));
+  describePiles(42, second, sizeof(second));
+  printf("\nSame seed gives the same piles (should be same): %s\n",
+         strcmp(first, second) == 0 ? "same" : "different");
+
+  // TESTING gold_delete
+  printf("\nTesting gold_delete:\n");
+  gold_delete(gold);
+  gold_delete(NULL);
+  grid_delete(grid);
+  printf("Net memory after delete (should be 0): %d\n", mem_net());
+
+  return 0;
+}
@@ -0,0 +1,339 @@
+/*
+ * gridbench.c - micro-benchmarks for the grid module
+ *
+ * usage: gridbench [--csv] [--ms n] [--positions n] map.txt...
+ *
+ * Times grid_load (of the compiled map, if mapcompile has made one that is
+ * up to date), grid_buildVisIndex, grid_setGold, grid_update,
+ * grid_reveal, grid_composeView and grid_toString on each map, grid_update
+ * and grid_reveal at several player positions with each visibility engine
+ * (rays, shadow, and a visibility index). For each it reports the time per operation, the grid
+ * cells handled per second, and the allocations per operation counted by
+ * the mem module (mem_malloc and mem_calloc; plain malloc is not counted).
+ *
+ * Each case runs in batches, doubling in size until a batch takes at least
+ * n milliseconds (--ms, default 20); the last batch is the one reported.
+ * With --csv, the report is comma-separated values with a header line, for
+ * comparing runs with other tools.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#define _POSIX_C_SOURCE 200809L   // for clock_gettime under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "grid.h"
+#include "mem.h"
+
+/**************** constants ****************/
+#define MaxPositions 64                 // most player positions per map
+static const int MaxBatch = 1 << 24;    // most operations in one batch
+
+/**************** types ****************/
+/* what a benchmark works on */
+typedef struct bstate {
+  const char* mapFile;
+  grid_t* staticGrid;       // without a visibility index
+  grid_t* indexedGrid;      // the same map, with one
+  grid_t* viewGrid;         // the static grid for the engine being timed
+  grid_t* liveGrid;
+  gridview_t* playerView;
+  char* frame;              // where runCompose writes the player's grid
+  int rows[MaxPositions];   // player positions
+  int cols[MaxPositions];
+  int numPositions;
+  grid_t** spares;          // fresh grids made by a setup function
+} bstate_t;
+
+/* one benchmark: setup and teardown are not timed, and may be NULL */
+typedef struct bench {
+  const char* op;
+  void (*setup)(bstate_t* state, int n);
+  void (*run)(bstate_t* state, int i);
+  void (*teardown)(bstate_t* state, int n);
+} bench_t;
+
+/**************** global variables ****************/
+static bool csv = false;        // report as comma-separated values
+static int64_t targetNs = 20000000;   // shortest batch reported
+
+/**************** functions ****************/
+static void benchMap(const char* mapFile, int numPositions);
+static void runBench(bstate_t* state, const bench_t* bench,
+                     const char* engine);
+static void setupSpares(bstate_t* state, int n);
+static void deleteSpares(bstate_t* state, int n);
+static void makeSpares(bstate_t* state, int n);
+static void runLoad(bstate_t* state, int i);
+static void runBuildIndex(bstate_t* state, int i);
+static void runSetGold(bstate_t* state, int i);
+static void runUpdate(bstate_t* state, int i);
+static void runReveal(bstate_t* state, int i);
+static void runCompose(bstate_t* state, int i);
+static void runToString(bstate_t* state, int i);
+static int memAllocs(void);
+static int64_t now(void);
+
+int
+main(const int argc, char* argv[])
+{
+  int numPositions = 8;
+  int first = 1;  // first map argument
+  while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+    if (strcmp(argv[first], "--csv") == 0) {
+      csv = true;
+      first++;
+    } else if (strcmp(argv[first], "--ms") == 0 && first + 1 < argc
+               && atoi(argv[first + 1]) > 0) {
+      targetNs = atoi(argv[first + 1]) * (int64_t)1000000;
+      first += 2;
+    } else if (strcmp(argv[first], "--positions") == 0 && first + 1 < argc
+               && atoi(argv[first + 1]) > 0
+               && atoi(argv[first + 1]) <= MaxPositions) {
+      numPositions = atoi(argv[first + 1]);
+      first += 2;
+    } else {
+      break;
+    }
+  }
+  if (first == argc) {
+    fprintf(stderr, "usage: %s [--csv] [--ms n] [--positions n] map.txt...\n",
+            argv[0]);
+    exit(1);
+  }
+
+  if (csv) {
+    printf("map,op,engine,cells,ops,ns_per_op,cells_per_s,allocs_per_op\n");
+  } else {
+    printf("%-40s %-11s %-7s %12s %14s %10s\n", "map", "op", "engine",
+           "ns/op", "cells/s", "allocs/op");
+  }
+  for (int i = first; i < argc; i++) { // loops through maps
+    benchMap(argv[i], numPositions);
+  }
+  return 0;
+}
+
+/* runs every benchmark on one map */
+static void
+benchMap(const char* mapFile, int numPositions)
+{
+  bstate_t state;
+  memset(&state, 0, sizeof(state));
+  state.mapFile = mapFile;
+  // a compiled map may come with its visibility index; copies do not
+  state.indexedGrid = grid_load(mapFile);
+  state.staticGrid = grid_copy(state.indexedGrid);
+  state.liveGrid = grid_copy(state.indexedGrid);
+  if (state.staticGrid == NULL || state.indexedGrid == NULL
+      || state.liveGrid == NULL) {
+    fprintf(stderr, "gridbench: cannot load %s; skipped\n", mapFile);
+    grid_delete(state.staticGrid);
+    grid_delete(state.indexedGrid);
+    grid_delete(state.liveGrid);
+    return;
+  }
+  state.playerView = grid_newView(state.staticGrid);
+  state.frame = grid_toString(state.staticGrid);
+  grid_buildVisIndex(state.indexedGrid);
+
+  // the same positions every run: free spots drawn with a fixed seed
+  srand(1);
+  int freeSpots = grid_numFree(state.staticGrid);
+  state.numPositions = numPositions < freeSpots ? numPositions : freeSpots;
+  for (int p = 0; p < state.numPositions; p++) {
+    grid_randomFree(state.staticGrid, &state.rows[p], &state.cols[p]);
+  }
+
+  const bench_t load = { "load", setupSpares, runLoad, deleteSpares };
+  const bench_t index = { "buildIndex", makeSpares, runBuildIndex,
+                          deleteSpares };
+  const bench_t gold = { "setGold", makeSpares, runSetGold, deleteSpares };
+  const bench_t update = { "update", NULL, runUpdate, NULL };
+  const bench_t reveal = { "reveal", NULL, runReveal, NULL };
+  const bench_t compose = { "compose", NULL, runCompose, NULL };
+  const bench_t toString = { "toString", NULL, runToString, NULL };
+
+  runBench(&state, &load, "-");
+  runBench(&state, &gold, "-");
+  runBench(&state, &toString, "-");
+  const visEngine_t engines[] = { visRays, visShadow };
+  const char* engineNames[] = { "rays", "shadow" };
+  for (int e = 0; e < 2; e++) { // loops through engines
+    grid_setVisEngine(engines[e]);
+    runBench(&state, &index, engineNames[e]);
+    state.viewGrid = state.staticGrid;
+    if (state.numPositions > 0) {
+      runBench(&state, &update, engineNames[e]);
+      runBench(&state, &reveal, engineNames[e]);
+    }
+  }
+  state.viewGrid = state.indexedGrid;
+  if (state.numPositions > 0) {
+    runBench(&state, &update, "index");
+    runBench(&state, &reveal, "index");
+    // by now the view has seen what every position sees
+    runBench(&state, &compose, "-");
+  }
+
+  grid_delete(state.staticGrid);
+  grid_delete(state.indexedGrid);
+  grid_delete(state.liveGrid);
+  grid_deleteView(state.playerView);
+  free(state.frame);
+}
+
+/* times one benchmark in doubling batches, and reports the last */
+static void
+runBench(bstate_t* state, const bench_t* bench, const char* engine)
+{
+  int n = 1;
+  int64_t elapsed;
+  int allocs;
+  while (true) {
+    if (bench->setup != NULL) {
+      bench->setup(state, n);
+    }
+    int allocsBefore = memAllocs();
+    int64_t start = now();
+    for (int i = 0; i < n; i++) {
+      bench->run(state, i);
+    }
+    elapsed = now() - start;
+    allocs = memAllocs() - allocsBefore;
+    if (bench->teardown != NULL) {
+      bench->teardown(state, n);
+    }
+    if (elapsed >= targetNs || n >= MaxBatch) {
+      break;
+    }
+    // aim a little past the target, but no more than 16 times the batch
+    int64_t next = elapsed > 0 ? n * (targetNs * 5 / 4) / elapsed : 16 * n;
+    n = next > 16 * (int64_t)n ? 16 * n : next > n ? next : 2 * n;
+  }
+
+  int cells = (grid_getRows(state->staticGrid) + 1)
+              * (grid_getCols(state->staticGrid) + 1);
+  double nsPerOp = (double)elapsed / n;
+  double cellsPerSecond = nsPerOp > 0 ? cells * 1e9 / nsPerOp : 0;
+  double allocsPerOp = (double)allocs / n;
+  if (csv) {
+    printf("%s,%s,%s,%d,%d,%.1f,%.0f,%.2f\n", state->mapFile, bench->op,
+           engine, cells, n, nsPerOp, cellsPerSecond, allocsPerOp);
+  } else {
+    printf("%-40s %-11s %-7s %12.1f %14.0f %10.2f\n", state->mapFile,
+           bench->op, engine, nsPerOp, cellsPerSecond, allocsPerOp);
+  }
+  fflush(stdout);
+}
+
+/* makes room for n grids, to be loaded by runLoad */
+static void
+setupSpares(bstate_t* state, int n)
+{
+  state->spares = mem_calloc_assert(n, sizeof(grid_t*), "spares");
+}
+
+/* frees the n spare grids, and the room for them */
+static void
+deleteSpares(bstate_t* state, int n)
+{
+  for (int i = 0; i < n; i++) {
+    grid_delete(state->spares[i]);
+  }
+  mem_free(state->spares);
+  state->spares = NULL;
+}
+
+/* makes n fresh copies of the map, without a visibility index */
+static void
+makeSpares(bstate_t* state, int n)
+{
+  setupSpares(state, n);
+  for (int i = 0; i < n; i++) {
+    state->spares[i] = grid_copy(state->staticGrid);
+  }
+}
+
+static void
+runLoad(bstate_t* state, int i)
+{
+  state->spares[i] = grid_load(state->mapFile);
+}
+
+static void
+runBuildIndex(bstate_t* state, int i)
+{
+  grid_buildVisIndex(state->spares[i]);
+}
+
+static void
+runSetGold(bstate_t* state, int i)
+{
+  grid_setGold(state->spares[i], 10, 30);
+}
+
+/* a player appears at one of the positions, sees from there, and leaves */
+static void
+runUpdate(bstate_t* state, int i)
+{
+  int p = i % state->numPositions;
+  grid_update(state->viewGrid, state->liveGrid, state->playerView, 'A',
+              state->rows[p], state->cols[p]);
+  grid_remove(state->viewGrid, state->liveGrid, state->playerView,
+              state->rows[p], state->cols[p]);
+}
+
+static void
+runReveal(bstate_t* state, int i)
+{
+  int p = i % state->numPositions;
+  grid_reveal(state->viewGrid, state->playerView,
+              state->rows[p], state->cols[p]);
+}
+
+/* the player's grid, from what the view has seen and sees */
+static void
+runCompose(bstate_t* state, int i)
+{
+  grid_composeView(state->staticGrid, state->liveGrid, state->playerView,
+                   state->frame);
+}
+
+static void
+runToString(bstate_t* state, int i)
+{
+  free(grid_toString(state->liveGrid));
+}
+
+/* returns the number of mem_malloc and mem_calloc calls so far, which the
+ * mem module only reports in the text of mem_report
+ */
+static int
+memAllocs(void)
+{
+  FILE* fp = tmpfile();
+  int allocs = 0;
+  if (fp != NULL) {
+    mem_report(fp, "gridbench");
+    rewind(fp);
+    if (fscanf(fp, "gridbench: %d malloc", &allocs) != 1) {
+      allocs = 0;
+    }
+    fclose(fp);
+  }
+  return allocs;
+}
+
+/* returns a monotonic time in nanoseconds */
+static int64_t
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
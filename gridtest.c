@@ -11,6 +11,15 @@
 #include "file.h"
 #include "mem.h"
 
+/* returns the player's grid composed from their view, as a new string */
+static char*
+viewString(grid_t* staticGrid, grid_t* liveGrid, gridview_t* view)
+{
+  char* string = grid_toString(staticGrid);
+  grid_composeView(staticGrid, liveGrid, view, string);
+  return string;
+}
+
 int
 main()
 {
@@ -47,7 +56,7 @@ main()
   mem_free(string);
 
   grid_t* liveGrid = grid_load("maps/big.txt" );
-  grid_t* playerAGrid = grid_new(numRows, numCols);
+  gridview_t* playerAView = grid_newView(grid);
 
   // test grid_setGold
   grid_setGold(liveGrid, 1, 5);
@@ -56,26 +65,26 @@ main()
   mem_free(gold);
 
   // creating another player 
-  grid_t* playerBGrid = grid_new(numRows, numCols);
-  grid_update(grid, liveGrid, playerBGrid, 'B', 3, 6 );
+  gridview_t* playerBView = grid_newView(grid);
+  grid_update(grid, liveGrid, playerBView, 'B', 3, 6 );
 
 
   char* playerA;
-  playerA = grid_toString(playerAGrid);
+  playerA = viewString(grid, liveGrid, playerAView);
   printf("initial player grid:\n%s", playerA);
   mem_free(playerA);
 
   //test grid_update
-  grid_update(grid, liveGrid, playerAGrid, 'A', 2, 5 );
+  grid_update(grid, liveGrid, playerAView, 'A', 2, 5 );
   char* updated = grid_toString(liveGrid);
   printf("updated grid:\n%s", updated);
   mem_free(updated);
-  playerA = grid_toString(playerAGrid);
+  playerA = viewString(grid, liveGrid, playerAView);
   printf("playerA grid:\n%s", playerA);
   mem_free(playerA);
 
   // test grid_remove on playerA
-  grid_remove(grid, liveGrid, playerAGrid, 2, 5);
+  grid_remove(grid, liveGrid, playerAView, 2, 5);
   char* removed = grid_toString(liveGrid);
   printf("removed from grid:\n%s", removed);
   mem_free(removed);
@@ -89,6 +98,16 @@ main()
   char p = grid_getMap(grid)[2][5];
   printf("character at row 2, column 5: %c (should be '.')\n",p);
 
+  // test grid_getText, and that the rows sit one after another in one buffer
+  char* text = grid_toString(liveGrid);
+  printf("grid_getText %s grid_toString\n",
+         strcmp(grid_getText(liveGrid), text) == 0 ? "matches" : "DOES NOT MATCH");
+  free(text);
+  char** rows = grid_getMap(grid);
+  printf("rows are %s\n", rows[1] - rows[0] == numCols + 2
+         && rows[numRows] - rows[0] == numRows * (numCols + 2)
+         ? "contiguous" : "NOT contiguous");
+
   // test grid_getRows
   printf("rows: %d (should be %d)\n", grid_getRows(grid), numRows);
 
@@ -97,10 +116,236 @@ main()
 
   // test grid_delete
   grid_delete(grid);
-  grid_delete(playerAGrid);
-  grid_delete(playerBGrid);
+  grid_deleteView(playerAView);
+  grid_deleteView(playerBView);
   grid_delete(liveGrid);
 
   grid_t* emptyGrid = grid_new(numRows, numCols);
   grid_delete(emptyGrid);
+
+  // a grid wider than a visibility run can describe gets no index
+  grid_t* wideGrid = grid_new(2, 40000);
+  printf("grid_buildVisIndex on a 40000-column grid: %s (should be refused)\n",
+         grid_buildVisIndex(wideGrid) ? "built" : "refused");
+  grid_delete(wideGrid);
+
+  // test grid_buildVisIndex and grid_setVisEngine: walking a player over
+  // every room spot must give the same player grid with and without the
+  // visibility index, and with either visibility engine; what the view
+  // marks visible must be what grid_canSee tells
+  grid_t* traced = grid_load("maps/big.txt");
+  grid_t* indexed = grid_load("maps/big.txt");
+  grid_t* live = grid_load("maps/big.txt");
+  gridview_t* tracedPlayer = grid_newView(traced);
+  gridview_t* indexedPlayer = grid_newView(indexed);
+  gridview_t* shadowPlayer = grid_newView(traced);
+  if (!grid_buildVisIndex(indexed)) {
+    printf("grid_buildVisIndex failed\n");
+  }
+  int positions = 0;
+  int mismatches = 0;
+  int shadowMismatches = 0;
+  int canSeeMismatches = 0;
+  for (int row = 0; row < numRows; row++) {
+    for (int col = 0; col < numCols; col++) {
+      char spot = grid_getChar(traced, row, col);
+      if (spot == '.' || spot == '#') {
+        grid_setVisEngine(visRays);
+        grid_update(traced, live, tracedPlayer, 'A', row, col);
+        grid_update(indexed, live, indexedPlayer, 'A', row, col);
+        grid_setVisEngine(visShadow);
+        grid_update(traced, live, shadowPlayer, 'A', row, col);
+        char* tracedView = viewString(traced, live, tracedPlayer);
+        char* indexedView = viewString(indexed, live, indexedPlayer);
+        char* shadowView = viewString(traced, live, shadowPlayer);
+        if (strcmp(tracedView, indexedView) != 0) {
+          mismatches++;
+        }
+        if (strcmp(tracedView, shadowView) != 0) {
+          shadowMismatches++;
+        }
+        free(tracedView);
+        free(indexedView);
+        free(shadowView);
+        for (int r = 0; r <= numRows; r++) {
+          for (int c = 0; c <= numCols; c++) {
+            if (grid_viewCanSee(indexedPlayer, r, c)
+                != grid_canSee(indexed, row, col, r, c)) {
+              canSeeMismatches++;
+            }
+          }
+        }
+        grid_remove(traced, live, tracedPlayer, row, col);
+        grid_remove(indexed, live, indexedPlayer, row, col);
+        grid_remove(traced, live, shadowPlayer, row, col);
+        positions++;
+      }
+    }
+  }
+  grid_setVisEngine(visRays);
+  printf("visibility index: %d mismatches in %d positions (should be 0)\n",
+         mismatches, positions);
+  printf("shadowcasting: %d mismatches in %d positions (should be 0)\n",
+         shadowMismatches, positions);
+  printf("grid_viewCanSee: %d mismatches in %d positions (should be 0)\n",
+         canSeeMismatches, positions);
+
+  // test grid_reveal: passing along the spots of each row and updating only
+  // at the last one must give the same player grid as updating at each spot,
+  // with and without the visibility index
+  int slides = 0;
+  int revealMismatches = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    grid_t* map = (pass == 0) ? traced : indexed;
+    for (int row = 0; row < numRows; row++) {
+      gridview_t* stepped = grid_newView(map);
+      gridview_t* revealed = grid_newView(map);
+      int lastCol = -1;
+      for (int col = 0; col < numCols; col++) {
+        char spot = grid_getChar(map, row, col);
+        if (spot == '.' || spot == '#') {
+          if (lastCol >= 0) {
+            grid_remove(map, live, stepped, row, lastCol);
+            grid_remove(map, live, revealed, row, lastCol);
+            grid_reveal(map, revealed, row, lastCol);
+          }
+          grid_update(map, live, stepped, 'A', row, col);
+          lastCol = col;
+        }
+      }
+      if (lastCol >= 0) {
+        grid_update(map, live, revealed, 'A', row, lastCol);
+        char* steppedView = viewString(map, live, stepped);
+        char* revealedView = viewString(map, live, revealed);
+        if (strcmp(steppedView, revealedView) != 0) {
+          revealMismatches++;
+        }
+        free(steppedView);
+        free(revealedView);
+        grid_remove(map, live, stepped, row, lastCol);
+        slides++;
+      }
+      grid_deleteView(stepped);
+      grid_deleteView(revealed);
+    }
+  }
+  printf("grid_reveal: %d mismatches in %d slides (should be 0)\n",
+         revealMismatches, slides);
+
+  // test grid_randomFree and grid_numFree: fill every free room spot of a
+  // live grid with a player, then take them all off again
+  grid_t* crowded = grid_load("maps/big.txt");
+  int roomSpots = 0;
+  for (int row = 0; row <= numRows; row++) {
+    for (int col = 0; col <= numCols; col++) {
+      if (grid_getChar(crowded, row, col) == '.') {
+        roomSpots++;
+      }
+    }
+  }
+  printf("free spots: %d (should be %d)\n", grid_numFree(crowded), roomSpots);
+  int placed = 0;
+  int badSpots = 0;
+  int freeRow, freeCol;
+  while (grid_randomFree(crowded, &freeRow, &freeCol)) {
+    if (grid_getChar(crowded, freeRow, freeCol) != '.') {
+      badSpots++;
+    }
+    grid_update(traced, crowded, tracedPlayer, 'A', freeRow, freeCol);
+    placed++;
+  }
+  printf("placed %d players, %d on occupied spots, %d free after "
+         "(should be %d, 0, 0)\n",
+         placed, badSpots, grid_numFree(crowded), roomSpots);
+  for (int row = 0; row <= numRows; row++) {
+    for (int col = 0; col <= numCols; col++) {
+      if (grid_getChar(crowded, row, col) == 'A') {
+        grid_remove(traced, crowded, tracedPlayer, row, col);
+      }
+    }
+  }
+  printf("free spots after removing them: %d (should be %d)\n",
+         grid_numFree(crowded), roomSpots);
+  grid_delete(crowded);
+
+  grid_delete(traced);
+  grid_delete(indexed);
+  grid_delete(live);
+  grid_deleteView(tracedPlayer);
+  grid_deleteView(indexedPlayer);
+  grid_deleteView(shadowPlayer);
+
+  // test grid_compile: the compiled map of a copy of main.txt must load as
+  // the same grid, giving the same views, until the copy changes
+  const char* copyFile = "gridtest-map.txt";
+  const char* compiledFile = "gridtest-map.nmap";
+  FILE* in = fopen("maps/main.txt", "r");
+  FILE* out = fopen(copyFile, "w");
+  int ch;
+  while ((ch = fgetc(in)) != EOF) {
+    fputc(ch, out);
+  }
+  fclose(in);
+  fclose(out);
+  grid_t* textGrid = grid_load(copyFile);
+  printf("grid_compile: %s (should be ok)\n",
+         grid_compile(copyFile, true) ? "ok" : "failed");
+  grid_t* compiled = grid_load(copyFile);
+  printf("compiled map: same cells %s, %d free spots (should be yes, %d)\n",
+         strcmp(grid_getText(textGrid), grid_getText(compiled)) == 0 ? "yes" : "no",
+         grid_numFree(compiled), grid_numFree(textGrid));
+  gridview_t* textPlayer = grid_newView(textGrid);
+  gridview_t* compiledPlayer = grid_newView(compiled);
+  grid_t* compiledLive = grid_copy(compiled);
+  int views = 0;
+  int viewMismatches = 0;
+  for (int row = 0; row <= grid_getRows(textGrid); row++) {
+    for (int col = 0; col <= grid_getCols(textGrid); col++) {
+      char spot = grid_getChar(textGrid, row, col);
+      if (spot == '.' || spot == '#') {
+        grid_update(textGrid, compiledLive, textPlayer, 'A', row, col);
+        grid_update(compiled, compiledLive, compiledPlayer, 'A', row, col);
+        char* textView = viewString(textGrid, compiledLive, textPlayer);
+        char* compiledView = viewString(compiled, compiledLive, compiledPlayer);
+        if (strcmp(textView, compiledView) != 0) {
+          viewMismatches++;
+        }
+        free(textView);
+        free(compiledView);
+        grid_remove(textGrid, compiledLive, textPlayer, row, col);
+        grid_remove(compiled, compiledLive, compiledPlayer, row, col);
+        views++;
+      }
+    }
+  }
+  printf("compiled map: %d mismatches in %d positions (should be 0)\n",
+         viewMismatches, views);
+  grid_delete(compiled);
+  grid_delete(compiledLive);
+  grid_deleteView(textPlayer);
+  grid_deleteView(compiledPlayer);
+
+  // a compiled map that is damaged is ignored, and the text loaded instead
+  FILE* damage = fopen(compiledFile, "r+");
+  fputc('X', damage);
+  fclose(damage);
+  compiled = grid_load(copyFile);
+  printf("damaged compiled map: same cells %s (should be yes)\n",
+         compiled != NULL
+         && strcmp(grid_getText(textGrid), grid_getText(compiled)) == 0
+         ? "yes" : "no");
+  grid_delete(compiled);
+
+  // once the map file changes, its compiled map is out of date
+  grid_compile(copyFile, false);
+  out = fopen(copyFile, "a");
+  fputs("+--+\n", out);
+  fclose(out);
+  compiled = grid_load(copyFile);
+  printf("changed map file: %d rows (should be %d)\n",
+         grid_getRows(compiled), grid_getRows(textGrid) + 1);
+  grid_delete(compiled);
+  grid_delete(textGrid);
+  remove(copyFile);
+  remove(compiledFile);
 }
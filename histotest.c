@@ -0,0 +1,121 @@
+/*
+ * histotest.c - test program for CS50 Nuggets Final Project's histo module
+ *
+ * usage: commandline takes no arguments
+ *
+ * CS50 Nuggets Final Project Spring 2021
+ * Grace Wang, Neha Ramsurrun, Ryan Yong
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "histo.h"
+#include "mem.h"
+
+/* returns "yes" if estimate is within 1/32 of exact, "no" otherwise */
+static const char*
+isClose(uint64_t estimate, uint64_t exact)
+{
+  uint64_t error = estimate > exact ? estimate - exact : exact - estimate;
+  return error * 32 <= exact ? "yes" : "no";
+}
+
+/* adds 1 to 100000 to the histogram in arg */
+static void*
+addValues(void* arg)
+{
+  for (uint64_t value = 1; value <= 100000; value++) {
+    histo_add(arg, value);
+  }
+  return NULL;
+}
+
+int
+main()
+{
+  // TESTING an empty histogram
+  printf("Testing an empty histogram:\n");
+  histo_t* histo = histo_new("empty");
+  if (histo == NULL) {
+    fprintf(stderr, "Error: histo_new failed\n");
+    exit(1);
+  }
+  printf("count %llu, p50 %llu, max %llu (should be 0, 0, 0)\n",
+         (unsigned long long)histo_count(histo),
+         (unsigned long long)histo_percentile(histo, 0.5),
+         (unsigned long long)histo_max(histo));
+  histo_delete(histo);
+
+  // TESTING small values, which each have their own bucket
+  printf("\nTesting values 0 to 15, each once:\n");
+  histo = histo_new("small");
+  for (int value = 0; value < 16; value++) {
+    histo_add(histo, value);
+  }
+  printf("p50 %llu, p100 %llu (should be 7, 15)\n",
+         (unsigned long long)histo_percentile(histo, 0.5),
+         (unsigned long long)histo_percentile(histo, 1.0));
+  histo_delete(histo);
+
+  // TESTING percentiles of 1 to 100000
+  printf("\nTesting values 1 to 100000, each once:\n");
+  histo = histo_new("range");
+  addValues(histo);
+  printf("count %llu, max %llu (should be 100000, 100000)\n",
+         (unsigned long long)histo_count(histo),
+         (unsigned long long)histo_max(histo));
+  printf("p50 %llu, within 1/32 of 50000: %s\n",
+         (unsigned long long)histo_percentile(histo, 0.5),
+         isClose(histo_percentile(histo, 0.5), 50000));
+  printf("p99 %llu, within 1/32 of 99000: %s\n",
+         (unsigned long long)histo_percentile(histo, 0.99),
+         isClose(histo_percentile(histo, 0.99), 99000));
+  printf("p99.9 %llu, within 1/32 of 99900: %s\n",
+         (unsigned long long)histo_percentile(histo, 0.999),
+         isClose(histo_percentile(histo, 0.999), 99900));
+  printf("p100 %llu (should be 100000, the maximum)\n",
+         (unsigned long long)histo_percentile(histo, 1.0));
+  histo_delete(histo);
+
+  // TESTING huge values, which share the last bucket
+  printf("\nTesting a value of 2^50:\n");
+  histo = histo_new("huge");
+  histo_add(histo, (uint64_t)1 << 50);
+  printf("count %llu, p50 at most the maximum: %s\n",
+         (unsigned long long)histo_count(histo),
+         histo_percentile(histo, 0.5) <= histo_max(histo) ? "yes" : "no");
+  histo_delete(histo);
+
+  // TESTING four threads adding at once
+  printf("\nTesting four threads each adding 1 to 100000:\n");
+  histo = histo_new("threads");
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, addValues, histo);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  printf("count %llu, max %llu (should be 400000, 100000)\n",
+         (unsigned long long)histo_count(histo),
+         (unsigned long long)histo_max(histo));
+  printf("p50 %llu, within 1/32 of 50000: %s\n",
+         (unsigned long long)histo_percentile(histo, 0.5),
+         isClose(histo_percentile(histo, 0.5), 50000));
+
+  // TESTING histo_print
+  printf("\nTesting histo_print:\n");
+  histo_printHeader(stdout);
+  histo_print(histo, stdout);
+  histo_print(NULL, stdout);
+
+  // TESTING histo_delete
+  printf("\nTesting histo_delete:\n");
+  histo_delete(histo);
+  histo_delete(NULL);
+  printf("Net memory after delete (should be 0): %d\n", mem_net());
+
+  return 0;
+}
@@ -13,13 +13,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include "mem.h"
 
 /**************** file-local global variables ****************/
 // track malloc and free across *all* calls within this program.
-static int nmalloc = 0;         // number of successful malloc calls
-static int nfree = 0;           // number of free calls
-static int nfreenull = 0;       // number of free(NULL) calls
+// Atomic, as threads may allocate and free at once; the counts need no
+// ordering with other memory, so relaxed operations are enough.
+static atomic_int nmalloc = 0;         // number of successful malloc calls
+static atomic_int nfree = 0;           // number of free calls
+static atomic_int nfreenull = 0;       // number of free(NULL) calls
 
 
 /**************** mem_assert ****************/
@@ -56,7 +59,7 @@ mem_malloc_assert(const size_t size, const char* message)
     fprintf(stderr, "Out of memory: %s\n", message);
     exit (99);
   }
-  nmalloc++;
+  atomic_fetch_add_explicit(&nmalloc, 1, memory_order_relaxed);
   return ptr;
 }
 
@@ -68,7 +71,7 @@ mem_malloc(const size_t size)
 {
   void* ptr = malloc(size);
   if (ptr != NULL) {
-    nmalloc++;
+    atomic_fetch_add_explicit(&nmalloc, 1, memory_order_relaxed);
   }
   return ptr;
 }
@@ -79,7 +82,7 @@ void*
 mem_calloc_assert(const size_t nmemb, const size_t size, const char* message)
 {
   void* ptr = mem_assert(calloc(nmemb, size), message);
-  nmalloc++;
+  atomic_fetch_add_explicit(&nmalloc, 1, memory_order_relaxed);
   return ptr;
 }
 
@@ -90,7 +93,7 @@ mem_calloc(const size_t nmemb, const size_t size)
 {
   void* ptr = calloc(nmemb, size);
   if (ptr != NULL) {
-    nmalloc++;
+    atomic_fetch_add_explicit(&nmalloc, 1, memory_order_relaxed);
   }
   return ptr;
 }
@@ -102,10 +105,10 @@ mem_free(void* ptr)
 {
   if (ptr != NULL) {
     free(ptr);
-    nfree++;
+    atomic_fetch_add_explicit(&nfree, 1, memory_order_relaxed);
   } else {
     // it's an error to call free(NULL)!
-    nfreenull++;
+    atomic_fetch_add_explicit(&nfreenull, 1, memory_order_relaxed);
   }
 }
 
@@ -114,8 +117,11 @@ mem_free(void* ptr)
 void 
 mem_report(FILE* fp, const char* message)
 {
+  int mallocs = atomic_load_explicit(&nmalloc, memory_order_relaxed);
+  int frees = atomic_load_explicit(&nfree, memory_order_relaxed);
+  int freenulls = atomic_load_explicit(&nfreenull, memory_order_relaxed);
   fprintf(fp, "%s: %d malloc, %d free, %d free(NULL), %d net\n", 
-          message, nmalloc, nfree, nfreenull, nmalloc - nfree - nfreenull);
+          message, mallocs, frees, freenulls, mallocs - frees - freenulls);
 }
 
 /**************** mem_net() ****************/
@@ -123,5 +129,7 @@ mem_report(FILE* fp, const char* message)
 int
 mem_net(void)
 {
-  return nmalloc - nfree - nfreenull;
+  return atomic_load_explicit(&nmalloc, memory_order_relaxed)
+         - atomic_load_explicit(&nfree, memory_order_relaxed)
+         - atomic_load_explicit(&nfreenull, memory_order_relaxed);
 }
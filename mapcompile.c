@@ -0,0 +1,63 @@
+/*
+ * mapcompile.c - compile map files for fast loading
+ *
+ * usage: mapcompile [--no-index] [--vis rays|shadow] map.txt...
+ *
+ * Writes the compiled form of each map next to it, named like the map with
+ * .nmap in place of .txt (see grid_compile in grid.h). grid_load, and so the
+ * server, then loads the compiled map, until the map file changes, without
+ * reading the text or indexing its free spots again.
+ *
+ * The compiled map also keeps a visibility index, traced with the engine
+ * chosen by --vis (default shadow, as the server), unless --no-index is
+ * given. The server uses it only when run with the same engine.
+ *
+ * Exits 0 if every map was compiled, 1 on a usage error, and 2 if any map
+ * could not be.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "grid.h"
+
+int
+main(const int argc, char* argv[])
+{
+  bool withIndex = true;
+  visEngine_t engine = visShadow;
+  int first = 1;  // first map argument
+  while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+    if (strcmp(argv[first], "--no-index") == 0) {
+      withIndex = false;
+      first++;
+    } else if (strcmp(argv[first], "--vis") == 0 && first + 1 < argc
+               && (strcmp(argv[first + 1], "rays") == 0
+                   || strcmp(argv[first + 1], "shadow") == 0)) {
+      engine = (strcmp(argv[first + 1], "rays") == 0) ? visRays : visShadow;
+      first += 2;
+    } else {
+      break;
+    }
+  }
+  if (first == argc) {
+    fprintf(stderr, "usage: %s [--no-index] [--vis rays|shadow] map.txt...\n",
+            argv[0]);
+    exit(1);
+  }
+
+  grid_setVisEngine(engine);
+  int failed = 0;
+  for (int i = first; i < argc; i++) { // loops through maps
+    if (grid_compile(argv[i], withIndex)) {
+      printf("compiled %s\n", argv[i]);
+    } else {
+      fprintf(stderr, "mapcompile: cannot compile %s\n", argv[i]);
+      failed++;
+    }
+  }
+  return failed == 0 ? 0 : 2;
+}
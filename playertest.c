@@ -30,17 +30,17 @@ main()
     }
     strcpy(name, "neha rsn");
     
-    // create new grid for player
-    grid_t* playerGrid;
-    playerGrid = grid_new(20,20);
-    if (playerGrid == NULL){
-        fprintf(stderr, "Error: grid_new failed\n");
+    // create new view for player, of an empty grid
+    grid_t* staticGrid = grid_new(20,20);
+    gridview_t* view = grid_newView(staticGrid);
+    if (staticGrid == NULL || view == NULL){
+        fprintf(stderr, "Error: grid_newView failed\n");
         exit(2);
     }
 
     // TESTING player_newPlayer
     printf("Creating new player A\n");
-    player = player_newPlayer('A', address, name, 0, 0, playerGrid);
+    player = player_newPlayer('A', address, name, 0, 0, view);
     if (player == NULL) {
         fprintf(stderr, "Error: player_new failed\n");
         exit(3);
@@ -51,7 +51,8 @@ main()
     printf("Player ID: %c\n", player_getID(player));
     printf("Player name: %s\n", player_getName(player));
     printf("Player location: (%d, %d)\n",player_getCol(player), player_getRow(player));
-    char* gridstring = grid_toString(player_getVisGrid(player));
+    char* gridstring = grid_toString(staticGrid);
+    grid_composeView(staticGrid, staticGrid, player_getView(player), gridstring);
     printf("Player's empty grid:\n%s\n", gridstring);
     printf("End of player's empty grid\n");
 
@@ -94,6 +95,7 @@ main()
     printf("Now deleting player.\n");
     free(gridstring);
     player_delete(player);
+    grid_delete(staticGrid);
 
     return 0;
 }
@@ -2,7 +2,38 @@
  * server.c - server portion of the nuggets game that allows for clients to
  * join in and handles game logic.
  *
- * usage - User must provide map filename and an optional seed.
+ * usage - User must provide map filename and an optional seed, followed or
+ * preceded by options:
+ *   --vis rays|shadow   how player visibility is computed (default shadow)
+ *   --batch n           datagrams handled per wakeup, 1 to 32 (default 1)
+ *   --tick-hz n         apply keys and send displays n times a second,
+ *                       instead of after every message (default off)
+ *   --games n           games hosted at once on the one port (default 1)
+ *   --threads n         threads running the games; with more than 1, each
+ *                       worker thread runs a shard of the games (default 1)
+ *   --async-log kb      write logs/run.log from a thread, through a ring
+ *                       buffer of kb KiB
+ *   --event-log path    record the messages sent and received in a binary
+ *                       event log at path, rather than as text in run.log
+ *   --record path       record the seed, the options above that change what
+ *                       the games do, and every message, tick and signal
+ *                       the server takes in, to be replayed; only with
+ *                       --threads 1
+ *   --replay path       take input from a recording instead of the network,
+ *                       as fast as possible, with the seed and options it
+ *                       was made with
+ *   --stats-port n      answer "STATS" on UDP port n of the loopback address
+ *                       only, with a snapshot of the server's counters
+ *
+ * Sending the server SIGUSR1 prints, to stderr, latency percentiles of the
+ * messages handled so far: by message type, by phase of the work (logic,
+ * visibility, serialization, send), and for single calls of moveHelper,
+ * slideHelper, reposPlayers and grid_update.
+ *
+ * One process hosts every game. A client picks a game with "JOIN n" (or
+ * "JOIN" for the first game with room) before PLAY or SPECTATE; a client that
+ * does not is put in the first game with room. The server exits once every
+ * game is over.
  *
  * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
  */
@@ -12,15 +43,28 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include "message.h"
+#include "log.h"
+#include "eventlog.h"
 #include "player.h"
 #include "grid.h"
+#include "delta.h"
+#include "addrindex.h"
+#include "gold.h"
+#include "histo.h"
+#include "mem.h"
 
 /************ global constants *************/
 static const int MaxNameLength = 50;    // maximum character count for a name
-static const int MaxPlayers = 26;       // maximum player count
+#define MaxPlayers 26                   // maximum player count
+#define MaxSpectators 16                // most spectators watching one game
 static const int GoldTotal = 250;       // starting gold count
 static const int GoldMinNumPiles = 10;  // minimum gold piles count
 static const int GoldMaxNumPiles = 30;  // maximum gold piles count
@@ -28,42 +72,204 @@ static const char solidRock = ' ';      // character for the solid rock
 static const char horiBound = '-';      // character for the horizontal boundary
 static const char vertBound = '|';      // character for the vertical boundary
 static const char cornerBound = '+';    // character for the corner boundary
-static const char goldPile = '*';       // character for the gold pile
 static const char roomSpot = '.';       // character for the room spot
 static const char passageSpot = '#';    // character for the passage spot
+#define MaxDirty 256                    // changed spots tracked per message
+#define MaxQueuedKeys 32                // keys a player may queue per tick
+static const int MaxTickHz = 1000;      // fastest tick rate allowed
+static const int MaxAsyncLogKB = 65536; // largest async log buffer, in KiB
+static const int MinStatsPort = 1024;   // range of ports for --stats-port
+static const int MaxStatsPort = 65535;
+#define MaxStatsBytes 2048              // longest STATS reply
+#define MaxGames 64                     // most games one server hosts
+#define MaxThreads 16                   // most worker threads
+#define MaxClients (MaxGames * (MaxPlayers + 1 + MaxSpectators)) // routed
+#define ShardQueueSize 1024             // events waiting for one worker
+#define MaxEventBytes 256               // longest message passed to a worker
 
 /************ global types ************/
-static struct {           // only visible to server.c
+typedef struct game {     // one game; only visible to server.c
   grid_t* staticGrid;     // starting grid based on provided map file
   grid_t* liveGrid;       // ongoing version of grid with players and gold
-  int numPiles;           // number of gold piles left to find
+  gold_t* gold;           // gold piles left to find, and their sizes
   
-  player_t* players[27];  // all players and one spectator in a game
-  addr_t spectatorAddr;   // address for the spectator
+  player_t* players[MaxPlayers];  // all players in a game
+  player_t* spectators[MaxSpectators]; // everyone watching; NULL if free
+  unsigned long spectatorSeen[MaxSpectators]; // frame version each last got
+  int numSpectators;      // number of spectators watching
+  delta_t* deltas[MaxPlayers + MaxSpectators]; // of clients that asked for
+                          // DELTA: players, then spectators (see findClient)
+  addrindex_t* playerIndex; // slot in players of each player still playing
+  addrindex_t* spectatorIndex; // slot in spectators of each spectator
   int playerCount;        // number of players in game so far
   char playerID;          // next available player ID
-  int nuggetsLeft;        // number of nuggets left to find
-} gameState;
+
+  int dirtyRows[MaxDirty];  // rows of spots changed since the last update
+  int dirtyCols[MaxDirty];  // columns of spots changed since the last update
+  int numDirty;             // number of changed spots recorded
+  bool allDirty;            // true if too many changes to track one by one
+  unsigned long frameVersion; // bumped whenever the live grid changes
+  char* spectatorFrame;     // DISPLAY of the live grid, shared by spectators
+  unsigned long spectatorFrameVersion; // frameVersion it shows; 0 if none
+  char* playerFrame;        // a player's grid, composed to be sent to them
+
+  char keys[MaxPlayers][MaxQueuedKeys]; // keys each player sent since the
+                                        // last tick
+  int numKeys[MaxPlayers];  // number of keys queued for each player
+  bool over;                // true once the game has ended
+  int index;                // position in serverState.games
+} game_t;
+
+/* something for a worker thread to do */
+typedef enum { eventMessage, eventTick, eventStop } eventType_t;
+
+typedef struct event {
+  eventType_t type;
+  int game;                   // index of the game, for eventMessage
+  addr_t from;                // sender, for eventMessage
+  char text[MaxEventBytes];   // the message, for eventMessage
+} event_t;
+
+/* something a worker tells the message loop, through the report pipe */
+typedef enum { reportDone, reportPlayer, reportSpectator } reportType_t;
+
+typedef struct report {
+  reportType_t type;          // game ended, or a seat of this kind is free
+  int game;                   // index of the game
+  addr_t from;                // client giving the seat back, if a seat
+} report_t;
+
+/* a worker thread and the queue of events for the games it runs */
+typedef struct shard {
+  int index;                  // games with index % numThreads == this
+  pthread_t thread;
+  pthread_mutex_t lock;       // guards the queue
+  pthread_cond_t ready;       // signalled when an event is queued
+  pthread_cond_t room;        // signalled when an event is taken
+  event_t events[ShardQueueSize];
+  int head;                   // oldest event in the queue
+  int count;                  // number of events in the queue
+} shard_t;
+
+/* latency histograms, in the order they are printed */
+typedef enum {
+  timePlay, timeKey, timeSpectate, timeOther, timeTick, // whole messages, ticks
+  timeLogic, timeVisibility, timeSerialize, timeSend,   // phases of those
+  timeMove, timeSlide, timeRepos, timeGridUpdate,       // single calls
+  NumTimings
+} timing_t;
+
+static const char* timingNames[NumTimings] = {
+  "PLAY", "KEY", "SPECTATE", "other", "tick",
+  "logic", "visibility", "serialization", "send",
+  "moveHelper", "slideHelper", "reposPlayers", "grid_update"
+};
+
+/* a client and the game it was routed to */
+typedef struct client {
+  addr_t addr;
+  int game;
+  int seats;              // seats it holds or asked for; 0 if only joined
+} client_t;
+
+static struct {           // only visible to server.c
+  grid_t* staticGrid;     // map shared by every game; never changed
+  game_t* games[MaxGames];
+  int numGames;           // number of games hosted
+  int gamesOver;          // number of games that have ended
+  bool over[MaxGames];    // which games have ended, as seen by the loop
+  int tickHz;             // ticks per second; 0 if not ticking
+  int batchSize;          // datagrams handled per wakeup (--batch)
+  int asyncLogKB;         // async log buffer in KiB; 0 if logging directly
+  const char* eventLogPath; // binary event log of traffic; NULL if none
+  const char* recordPath; // where input is recorded; NULL if not recording
+  const char* replayPath; // recording input is taken from; NULL if network
+  eventlog_t* recording;  // input recorded so far, if recording
+  int statsPort;          // loopback port answering STATS; 0 if none
+  int statsFd;            // socket on that port
+
+  client_t clients[MaxClients]; // where each client's messages go
+  int numClients;
+  addrindex_t* clientIndex; // slot in clients of each client, by address
+  int playing[MaxGames];  // player seats each game gave or was asked for
+  int watching[MaxGames]; // spectator seats, likewise
+
+  int numThreads;         // threads running games; 1 means the loop itself
+  shard_t* shards;        // one per worker thread, if numThreads > 1
+  int reportFds[2];       // pipe on which workers send reports (report_t)
+
+  histo_t* timings[NumTimings]; // latency of the work, in nanoseconds
+  _Atomic int activePlayers;    // players in games still going, not quit
+  _Atomic int quitPlayers;      // players who quit with Q
+  uint64_t startTime;     // when the server started, for STATS
+  uint64_t lastStatsTime; // when the last STATS was answered
+  unsigned long lastLoops;  // turns of the message loop by then
+} serverState;
+
+/* time spent in each phase by the message or tick this thread is handling */
+static _Thread_local uint64_t phaseNs[NumTimings];
 
 /************ function prototypes **************/
-static void initGameState(char* mapFilename);
+static void initServer(char* mapFilename);
+static game_t* newGame(void);
 static int parseArgs(const int argc, char* argv[],
                       char** mapFilename, int* seed);
+static bool parseOption(const char* option, const char* value);
+static void usage(const char* program);
+static bool openStats(int port);
+static bool handleStats(void* arg, int fd);
+static int formatStats(char* buf, int size);
+static eventreader_t* openReplay(FILE* fp);
+static bool replayInput(eventreader_t* reader);
 static bool handleMessage(void* arg, const addr_t from, const char* message);
-static void handleSpectate(addr_t from);
-static void handlePlay(addr_t from, const char* content);
-static void handleKey(addr_t from, const char* content);
-static bool moveHelper(player_t* player, int col, int row);
-static void reposPlayers(void);
-static void resetLiveGrid(void);
+static int routeClient(const addr_t from, const char* message);
+static int openGame(const bool spectate);
+static void takeSeat(client_t* client, const bool spectate);
+static void freeSeat(int index, const addr_t from, const bool spectate);
+static void releaseSeat(game_t* game, const addr_t from, const bool spectate);
+static bool finishGame(int index);
+static bool handleGameMessage(game_t* game, const addr_t from,
+                              const char* message);
+static bool handleSignal(void* arg, int signum);
+static bool handleDump(void* arg, int signum);
+static uint64_t startTiming(void);
+static void finishTiming(timing_t type, uint64_t start);
+static bool handleTick(void* arg);
+static bool tickGame(game_t* game);
+static bool queueKey(game_t* game, addr_t from, const char* content);
+static void startShards(void);
+static void stopShards(void);
+static void postEvent(shard_t* shard, eventType_t type, int game,
+                      const addr_t from, const char* message);
+static void* runShard(void* arg);
+static bool handleReport(void* arg, int fd);
+static void endGame(game_t* game);
+static void handleSpectate(game_t* game, addr_t from);
+static void removeSpectator(game_t* game, int slot);
+static void handlePlay(game_t* game, addr_t from, const char* content);
+static void handleKey(game_t* game, addr_t from, const char* content);
+static void handleDelta(game_t* game, addr_t from);
+static void handleAck(game_t* game, addr_t from, const char* content);
+static bool moveHelper(game_t* game, player_t* player, int col, int row);
+static void slideHelper(game_t* game, player_t* player, int col, int row);
+static bool stepHelper(game_t* game, player_t* player, int col, int row,
+                       player_t** swapped);
+static void reposPlayers(game_t* game);
+static void sendSpectatorFrames(game_t* game);
+static void updateVisGrid(game_t* game, player_t* player);
+static void markDirty(game_t* game, int row, int col);
+static bool seesChange(game_t* game, player_t* player);
 static bool formatName(const char* name, int length, char* result);
-static void sendSummaryMsg(void);
+static void sendSummaryMsg(game_t* game);
 static void sendGoldMsg(addr_t from, int n1, int n2, int n3);
 static void sendGridMsg(addr_t from, int n1, int n2);
-static void sendDisplayMsg(addr_t from, char* gridStr);
+static void sendDisplayMsg(addr_t from, const char* gridStr);
+static void sendFrame(game_t* game, int index, addr_t to, const char* gridStr);
+static const char* composeFrame(game_t* game, player_t* player);
 static void sendOkMsg(addr_t from, char c);
 static int calcDigits(int n);
-static player_t* findPlayer(char c);
+static player_t* findPlayer(game_t* game, char c);
+static int findClient(game_t* game, addr_t from);
 static bool str2int(const char string[], int* number);
 
 /************ main *************/
@@ -72,169 +278,1355 @@ main(const int argc, char* argv[])
 {
   char* mapFilename = NULL; // path to map provided by user
   int seed = 0; // seed value for randomization
+  grid_setVisEngine(visShadow); // default, unless --vis says otherwise
+  serverState.numGames = 1; // defaults, unless options say otherwise
+  serverState.numThreads = 1;
+  serverState.batchSize = 1;
   parseArgs(argc, argv, &mapFilename, &seed); // parses user-inputted arguments
+  if (serverState.recordPath != NULL && serverState.numThreads > 1) {
+    // workers take random numbers in whatever order they are scheduled
+    fprintf(stderr, "error: --record cannot be used with --threads\n");
+    exit(1);
+  }
 
-  initGameState(mapFilename); // initializes global variables for the game
+  FILE* replayFp = NULL; // recording to replay, if input is not the network
+  eventreader_t* replay = NULL;
+  if (serverState.replayPath != NULL) { // check if replaying a recording
+    if ((replayFp=fopen(serverState.replayPath, "rb")) == NULL
+        || (replay=openReplay(replayFp)) == NULL) {
+      fprintf(stderr, "error: cannot replay %s\n", serverState.replayPath);
+      exit(1);
+    }
+    serverState.numThreads = 1; // replayed games run in order, on this thread
+  }
+
+  initServer(mapFilename); // loads the map and starts every game
 
   const float timeout = 0;
   int port = 0;
   const char* logPath = "logs/run.log"; // output path for actions in server
   FILE* fp = fopen(logPath, "w");
+  if (serverState.asyncLogKB > 0) { // check if the log is written by a thread
+    log_asyncStart(fp, serverState.asyncLogKB * 1024);
+  }
+  FILE* eventFp = NULL; // event log, if traffic is recorded in binary
+  if (serverState.eventLogPath != NULL) { // check if event log requested
+    if ((eventFp=fopen(serverState.eventLogPath, "wb")) == NULL
+        || !message_setEventLog(eventFp)) {
+      fprintf(stderr, "error: cannot write event log %s\n",
+              serverState.eventLogPath);
+      exit(1);
+    }
+  }
+  FILE* recordFp = NULL; // recording of the input, if requested
+  if (serverState.recordPath != NULL) { // check if recording requested
+    if ((recordFp=fopen(serverState.recordPath, "wb")) == NULL
+        || (serverState.recording=eventlog_new(recordFp)) == NULL) {
+      fprintf(stderr, "error: cannot write recording %s\n",
+              serverState.recordPath);
+      exit(1);
+    }
+    // the options that change what the games do, then the seed, which
+    // ends them
+    eventlog_recordValue(serverState.recording, EventGames,
+                         serverState.numGames);
+    eventlog_recordValue(serverState.recording, EventVis, grid_getVisEngine());
+    eventlog_recordValue(serverState.recording, EventTickHz,
+                         serverState.tickHz);
+    eventlog_recordValue(serverState.recording, EventBatch,
+                         serverState.batchSize);
+    eventlog_recordValue(serverState.recording, EventSeed, seed);
+  }
 
-  if ((port=message_init(fp)) > 0) { // check if port is valid
-    if (! message_loop(NULL, timeout, NULL,
-                        NULL, handleMessage)) { // check if fatal error in loop
+  if (replay != NULL) { // check if input comes from a recording
+    bool ok = message_initOffline(fp) && replayInput(replay);
+    message_done(); // also writes what is left of the event log
+    log_asyncStop();
+    if (! ok) { // check if the recording could not be read to the end
+      fclose(fp);
+      exit(2);
+    }
+    eventlog_closeReader(replay);
+    fclose(replayFp);
+  } else if ((port=message_init(fp)) > 0) { // check if port is valid
+    // end the games cleanly if the server is interrupted
+    message_watchSignal(SIGINT, handleSignal);
+    message_watchSignal(SIGTERM, handleSignal);
+    message_watchSignal(SIGUSR1, handleDump);
+    if (serverState.statsPort > 0 && !openStats(serverState.statsPort)) {
+      fprintf(stderr, "error: cannot answer STATS on port %d\n",
+              serverState.statsPort);
+      exit(1);
+    }
+    if (serverState.tickHz > 0) { // check if keys wait for the next tick
+      message_watchTimer(1.0 / serverState.tickHz, handleTick);
+    }
+    if (serverState.numThreads > 1) { // check if games run on workers
+      startShards();
+    }
+    bool ok = message_loopEpoll(NULL, timeout, NULL, NULL, handleMessage);
+    if (serverState.numThreads > 1) {
+      stopShards(); // ends any game still going, then joins the workers
+    }
+    if (serverState.statsPort > 0) {
+      message_unwatch(serverState.statsFd);
+      close(serverState.statsFd);
+    }
+    if (! ok) { // check if fatal error in loop
       fprintf(stderr, "Fatal error: unable to continue looping\n");
+      message_setEventLog(NULL);
+      log_asyncStop();
       fclose(fp);
       exit(2);
     }
-    message_done();
+    message_done(); // also writes what is left of the event log
+    log_asyncStop(); // writes what is left of the log
   } else { // runs if message loop ended cleanly
+    message_setEventLog(NULL);
+    log_asyncStop();
+    fclose(fp);
+    exit(1);
+  }
+  if (eventFp != NULL) {
+    fclose(eventFp);
+  }
+  if (recordFp != NULL) {
+    eventlog_delete(serverState.recording); // writes what is left of it
+    fclose(recordFp);
+  }
+
+  for (int i = 0; i < serverState.numGames; i++) { // loops through games
+    free(serverState.games[i]);
+  }
+  addrindex_delete(serverState.clientIndex);
+  grid_delete(serverState.staticGrid);
+  for (int i = 0; i < NumTimings; i++) { // loops through histograms
+    histo_delete(serverState.timings[i]);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/*********** initServer **************/
+/* Initializes everything the server needs before clients can join.
+ *
+ * Caller provides:
+ *  mapFilename: valid pathname to a map file
+ *
+ * We do:
+ *  Load the map shared by every game, start each game, and make the latency
+ *  histograms.
+ */
+static void
+initServer(char* mapFilename)
+{
+  serverState.staticGrid = grid_load(mapFilename); // load initial map
+  if (serverState.staticGrid == NULL) {
+    fprintf(stderr, "error: cannot load map '%s'.\n", mapFilename);
+    exit(1);
+  }
+  grid_buildVisIndex(serverState.staticGrid); // trace every view up front
+  for (int i = 0; i < serverState.numGames; i++) { // loops through games
+    serverState.games[i] = newGame();
+    serverState.games[i]->index = i;
+    serverState.over[i] = false;
+    serverState.playing[i] = 0;
+    serverState.watching[i] = 0;
+  }
+  serverState.gamesOver = 0;
+  serverState.numClients = 0;
+  serverState.clientIndex = addrindex_new(MaxClients);
+  if (serverState.clientIndex == NULL) {
+    fprintf(stderr, "error: out of memory for clients.\n");
+    exit(1);
+  }
+  for (int i = 0; i < NumTimings; i++) { // loops through histograms
+    if ((serverState.timings[i] = histo_new(timingNames[i])) == NULL) {
+      fprintf(stderr, "error: out of memory for latency histograms.\n");
+      exit(1);
+    }
+  }
+  serverState.startTime = histo_now();
+  serverState.lastStatsTime = serverState.startTime;
+}
+
+/*********** newGame **************/
+/* Creates one game, ready for players.
+ *
+ * We do:
+ *  Copy the static grid into the game's own live grid, drop gold in it, and set the starting
+ *  values for count and ID. The static grid is shared by every game.
+ *
+ * We return:
+ *  the new game; the caller frees it with free() after endGame.
+ */
+static game_t*
+newGame(void)
+{
+  game_t* game = calloc(1, sizeof(game_t));
+  if (game == NULL) {
+    fprintf(stderr, "error: out of memory for games.\n");
+    exit(1);
+  }
+  game->staticGrid = serverState.staticGrid; // shared, never changed
+  game->liveGrid = grid_copy(serverState.staticGrid); // the map, unplayed
+  if (game->liveGrid == NULL) {
+    fprintf(stderr, "error: out of memory for games.\n");
+    exit(1);
+  }
+  // drop gold piles in live grid, each with its number of nuggets
+  game->gold = gold_new(game->liveGrid, GoldTotal,
+                        GoldMinNumPiles, GoldMaxNumPiles);
+  if (game->gold == NULL) {
+    fprintf(stderr, "error: cannot place the gold.\n");
+    exit(1);
+  }
+  
+  // initialize each player in the array of players
+  for (int i = 0; i < MaxPlayers; i++) { // loops through all players
+    game->players[i] = NULL;
+    game->numKeys[i] = 0;
+  }
+  for (int i = 0; i < MaxSpectators; i++) { // loops through all spectators
+    game->spectators[i] = NULL;
+    game->spectatorSeen[i] = 0;
+  }
+  for (int i = 0; i < MaxPlayers + MaxSpectators; i++) { // all clients
+    game->deltas[i] = NULL;
+  }
+  
+  game->playerIndex = addrindex_new(MaxPlayers);
+  game->spectatorIndex = addrindex_new(MaxSpectators);
+  if (game->playerIndex == NULL || game->spectatorIndex == NULL) {
+    fprintf(stderr, "error: out of memory for games.\n");
+    exit(1);
+  }
+  game->numSpectators = 0;
+  game->playerCount = 0;
+  game->playerID = 'A'; // starting player's ID
+  game->numDirty = 0;
+  game->allDirty = false;
+  game->frameVersion = 1; // newer than any spectator has seen
+  game->spectatorFrame = NULL;
+  game->spectatorFrameVersion = 0;
+  game->playerFrame = NULL;
+  game->over = false;
+  return game;
+}
+
+/************ parseArgs *************/
+/* Takes the user provided arguments and makes them into usable values for the
+ * program.
+ *
+ * Caller provides:
+ *  Number of arguments
+ *  Arguments array
+ *  Pointer to mapFilename: pointer to valid pathname to a map file
+ *  Pointer to seed: pointer to a number for randomization
+ *
+ * We do:
+ *  Assign values to mapFilename and seed, and apply any options.
+ *
+ * We return:
+ *  0 if successful
+ *  Non-zero if not successful
+ */
+static int
+parseArgs(const int argc, char* argv[], char** mapFilename, int* seed)
+{
+  // separate options (and their values) from the map filename and seed
+  char* args[2];  // the map filename and seed, in order
+  int numArgs = 0;
+  for (int i = 1; i < argc; i++) { // loops through arguments
+    if (strncmp(argv[i], "--", strlen("--")) == 0) { // check if option
+      if (i + 1 == argc || !parseOption(argv[i], argv[i + 1])) {
+        usage(argv[0]);
+        exit(1);
+      }
+      i++; // skip the option's value
+    } else if (numArgs < 2) {
+      args[numArgs++] = argv[i];
+    } else { // runs if too many arguments provided
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  FILE* fp = NULL;
+  if (numArgs == 1) { // check if only map filename provided
+    *mapFilename = args[0];
+    if ((fp=fopen(*mapFilename, "r")) == NULL) { // check if map file readable
+      fprintf(stderr, "error: invalid map filename.\n");
+      exit(1);
+    }
+    *seed = getpid(); // recorded, if recording, so a replay gets it too
+    srand(*seed);
     fclose(fp);
+  } else if (numArgs == 2) { // check if map filename and seed provided
+    *mapFilename = args[0];
+    if ((fp=fopen(*mapFilename, "r")) == NULL) { // check if map file readable
+      fprintf(stderr, "error: invalid map filename.\n");
+      exit(1);
+    }
+    fclose(fp);
+
+    // check if convert argument into seed integer successful
+    if (str2int(args[1], seed)) {
+      if (*seed>0){
+        srand(*seed);
+      } else { // provided seed is an integer but not positive
+        fprintf(stderr, "error: invalid seed. must be positive integer.\n");
+        exit(1);
+      }
+      
+    } else { // provided seed is not an integer
+      fprintf(stderr, "error: invalid seed. must be positive integer.\n");
+      exit(1);
+    }
+    
+  } else { // runs if invalid number of arguments provided
+    usage(argv[0]);
+    exit(1);
+  }
+  return 0;
+}
+
+/************ parseOption *************/
+/* Applies one command-line option.
+ *
+ * Caller provides:
+ *  option: the option name, including the leading "--"
+ *  value: the argument following the option
+ *
+ * We return:
+ *  true if the option and its value are valid
+ *  false otherwise
+ */
+static bool
+parseOption(const char* option, const char* value)
+{
+  if (strcmp(option, "--vis") == 0) { // check if visibility engine option
+    if (strcmp(value, "rays") == 0) {
+      grid_setVisEngine(visRays);
+    } else if (strcmp(value, "shadow") == 0) {
+      grid_setVisEngine(visShadow);
+    } else { // runs if unknown engine
+      return false;
+    }
+    return true;
+  }
+  if (strcmp(option, "--batch") == 0) { // check if batching option
+    return str2int(value, &serverState.batchSize)
+           && message_setBatching(serverState.batchSize);
+  }
+  if (strcmp(option, "--tick-hz") == 0) { // check if tick rate option
+    return str2int(value, &serverState.tickHz)
+           && serverState.tickHz > 0 && serverState.tickHz <= MaxTickHz;
+  }
+  if (strcmp(option, "--games") == 0) { // check if game count option
+    return str2int(value, &serverState.numGames)
+           && serverState.numGames > 0 && serverState.numGames <= MaxGames;
+  }
+  if (strcmp(option, "--async-log") == 0) { // check if async log option
+    return str2int(value, &serverState.asyncLogKB)
+           && serverState.asyncLogKB > 0
+           && serverState.asyncLogKB <= MaxAsyncLogKB;
+  }
+  if (strcmp(option, "--threads") == 0) { // check if thread count option
+    return str2int(value, &serverState.numThreads)
+           && serverState.numThreads > 0 && serverState.numThreads <= MaxThreads;
+  }
+  if (strcmp(option, "--event-log") == 0) { // check if event log option
+    serverState.eventLogPath = value;
+    return true;
+  }
+  if (strcmp(option, "--record") == 0) { // check if record option
+    serverState.recordPath = value;
+    return true;
+  }
+  if (strcmp(option, "--replay") == 0) { // check if replay option
+    serverState.replayPath = value;
+    return true;
+  }
+  if (strcmp(option, "--stats-port") == 0) { // check if STATS port option
+    return str2int(value, &serverState.statsPort)
+           && serverState.statsPort >= MinStatsPort
+           && serverState.statsPort <= MaxStatsPort;
+  }
+  return false; // runs if unknown option
+}
+
+/************ usage *************/
+/* Prints the command-line usage of the server to stderr.
+ */
+static void
+usage(const char* program)
+{
+  fprintf(stderr, "usage: %s map.txt [seed] [--vis rays|shadow] [--batch n]\n"
+          "       [--tick-hz n] [--games n] [--threads n] [--async-log kb]\n"
+          "       [--event-log path] [--record path] [--replay path]\n"
+          "       [--stats-port n]\n",
+          program);
+}
+
+/************ openReplay *************/
+/* Opens a recording made with --record, applies the options the recorded
+ * run was started with, and seeds the random numbers the way it was seeded.
+ *
+ * Caller provides:
+ *  fp: the recording, open for reading
+ *
+ * We do:
+ *  Set the game count, visibility engine, tick rate and batch size from the
+ *  recording, overriding any given on the command line, as the seed does.
+ *
+ * We return:
+ *  a reader positioned at the first input after the seed
+ *  NULL if the file is not a recording
+ */
+static eventreader_t*
+openReplay(FILE* fp)
+{
+  eventreader_t* reader = eventlog_openReader(fp);
+  logevent_t event;
+  while (reader != NULL && eventlog_read(reader, &event)) { // reads options
+    if (event.kind == EventSeed) { // check if the options have ended
+      srand(event.value);
+      return reader;
+    } else if (event.kind == EventGames && event.value > 0
+               && event.value <= MaxGames) {
+      serverState.numGames = event.value;
+    } else if (event.kind == EventVis
+               && (event.value == visRays || event.value == visShadow)) {
+      grid_setVisEngine(event.value);
+    } else if (event.kind == EventTickHz && event.value >= 0
+               && event.value <= MaxTickHz) {
+      serverState.tickHz = event.value;
+    } else if (event.kind == EventBatch && message_setBatching(event.value)) {
+      serverState.batchSize = event.value;
+    } else { // runs if anything else comes before the seed
+      break;
+    }
+  }
+  eventlog_closeReader(reader);
+  return NULL;
+}
+
+/************ replayInput *************/
+/* Feeds a recording to the server, as fast as possible and without sockets.
+ *
+ * Caller provides:
+ *  reader: a recording, opened by openReplay
+ *
+ * We do:
+ *  Hand each recorded message to handleMessage, from the address it came
+ *  from, and call handleTick and handleSignal where the recorded server
+ *  ticked or was signalled, until the recording ends or the games do.
+ *  Print how many messages and ticks were replayed, and how fast.
+ *
+ * We return:
+ *  true if the recording was replayed to its end (or to the end of the games)
+ *  false if it is cut short or corrupt
+ */
+static bool
+replayInput(eventreader_t* reader)
+{
+  struct timespec start, end;
+  timespec_get(&start, TIME_UTC);
+  int messages = 0, ticks = 0;
+  bool done = false;
+  logevent_t event;
+  while (! done && eventlog_read(reader, &event)) { // loops through inputs
+    if (event.kind == EventRecv) {
+      done = message_deliver(NULL, handleMessage, event.peer, event.text);
+      messages++;
+    } else if (event.kind == EventTick) {
+      done = handleTick(NULL);
+      ticks++;
+    } else if (event.kind == EventSignal) {
+      done = handleSignal(NULL, event.value);
+    }
+    message_flush(); // "sends" anything the handlers queued
+  }
+  timespec_get(&end, TIME_UTC);
+
+  double seconds = (end.tv_sec - start.tv_sec)
+                   + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("replayed %d messages and %d ticks in %.3f seconds "
+         "(%.0f messages a second)\n", messages, ticks, seconds,
+         seconds > 0 ? messages / seconds : 0.0);
+  if (eventlog_readError(reader) != NULL) { // check if replay ended early
+    fprintf(stderr, "error: replay: %s\n", eventlog_readError(reader));
+    return false;
+  }
+  return true;
+}
+
+/************ openStats *************/
+/* Opens the socket that answers STATS requests, when running with
+ * --stats-port.
+ *
+ * Caller provides:
+ *  port: the port to answer on
+ *
+ * We do:
+ *  Bind a UDP socket to the port of the loopback address, so only programs
+ *  on this machine can ask, and watch it from the message loop.
+ *
+ * We return:
+ *  true if the socket is ready
+ *  false otherwise
+ */
+static bool
+openStats(int port)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  addr_t local = message_noAddr();
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  local.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr*) &local, sizeof(local)) < 0
+      || ! message_watch(fd, handleStats)) {
+    close(fd);
+    return false;
+  }
+  serverState.statsFd = fd;
+  return true;
+}
+
+/************ handleStats *************/
+/* Answers one request on the STATS socket.
+ *
+ * Caller provides:
+ *  fd: the STATS socket, with a datagram waiting
+ *
+ * We do:
+ *  Reply to "STATS" with a snapshot of the counters (see formatStats), and
+ *  to anything else with an error. The requests are not logged, nor
+ *  counted with the game's messages.
+ *
+ * We return:
+ *  false, to keep the message loop going
+ */
+static bool
+handleStats(void* arg, int fd)
+{
+  char request[64];
+  addr_t from;
+  socklen_t fromLength = sizeof(from);
+  int nbytes = recvfrom(fd, request, sizeof(request) - 1, 0,
+                        (struct sockaddr*) &from, &fromLength);
+  if (nbytes < 0) {
+    return false;
+  }
+  while (nbytes > 0 && isspace(request[nbytes - 1])) { // trim the newline
+    nbytes--;
+  }
+  request[nbytes] = '\0';
+
+  char reply[MaxStatsBytes];
+  int length;
+  if (strcmp(request, "STATS") == 0) { // check if a known request
+    length = formatStats(reply, sizeof(reply));
+  } else {
+    length = snprintf(reply, sizeof(reply), "ERROR unknown request");
+  }
+  sendto(fd, reply, length, 0, (struct sockaddr*) &from, fromLength);
+  return false;
+}
+
+/************ formatStats *************/
+/* Formats the STATS reply: a snapshot of the server's counters, one line
+ * each after the first:
+ *   STATS
+ *   uptime <seconds>
+ *   loops <turns of the message loop> <turns per second since last STATS>
+ *   players <active> <quit>
+ *   heap <blocks allocated with the mem module and not yet freed>
+ *   vis <passes> <average cells scanned per pass>
+ *   in <type> <messages> <bytes>     for each type received
+ *   out <type> <messages> <bytes>    for each type sent
+ * Every counter the worker threads update is atomic, so this thread can
+ * read it while they run: the player counts, the mem module's counts behind
+ * heap, and the grid and message modules' counts. Only the loop itself
+ * counts its turns.
+ *
+ * Caller provides:
+ *  buf, size: where to put the reply
+ *
+ * We return:
+ *  the length of the reply
+ */
+static int
+formatStats(char* buf, int size)
+{
+  uint64_t now = histo_now();
+  unsigned long loops = message_loopCount();
+  double interval = (now - serverState.lastStatsTime) / 1e9;
+  unsigned long passes, cells;
+  grid_getVisCounts(&passes, &cells);
+
+  int length = snprintf(buf, size,
+      "STATS\nuptime %.3f\nloops %lu %.1f\nplayers %d %d\nheap %d\n"
+      "vis %lu %.1f",
+      (now - serverState.startTime) / 1e9, loops,
+      interval > 0 ? (loops - serverState.lastLoops) / interval : 0.0,
+      atomic_load(&serverState.activePlayers),
+      atomic_load(&serverState.quitPlayers), mem_net(),
+      passes, passes > 0 ? (double)cells / passes : 0.0);
+  for (int direction = 0; direction < 2; direction++) { // in, then out
+    for (int type = 0; type < NumTypes; type++) { // loops through types
+      msgcount_t counts[2];
+      message_getCounts(type, &counts[0], &counts[1]);
+      if (counts[direction].messages > 0 && length < size) {
+        length += snprintf(buf + length, size - length, "\n%s %s %lu %lu",
+                           direction == 0 ? "in" : "out",
+                           eventlog_typeName(type),
+                           counts[direction].messages,
+                           counts[direction].bytes);
+      }
+    }
+  }
+  serverState.lastStatsTime = now;
+  serverState.lastLoops = loops;
+  return length < size ? length : size - 1;
+}
+
+/************ handleMessage **************/
+/* Takes a message from a client and passes it to the client's game, on this
+ * thread or on the worker thread that runs the game.
+ *
+ * Caller provides:
+ *  optional arg: if needed
+ *  from: the address of the client who made the request
+ *  message: the request from the client
+ *
+ * We do:
+ *  Route the client to a game (see routeClient), then have the game handle
+ *  the message.
+ *
+ * We return:
+ *  false if any game is still going
+ *  true once every game is over
+ */
+static bool
+handleMessage(void* arg, const addr_t from, const char* message)
+{
+  eventlog_record(serverState.recording, EventRecv, from, message);
+  int index = routeClient(from, message);
+  if (index < 0) { // check if message was for the server itself
+    return false;
+  }
+  if (serverState.numThreads > 1) { // check if a worker runs the game
+    postEvent(&serverState.shards[index % serverState.numThreads],
+              eventMessage, index, from, message);
+    return false;
+  }
+  if (handleGameMessage(serverState.games[index], from, message)) {
+    return finishGame(index);
+  }
+  return false;
+}
+
+/************ routeClient **************/
+/* Finds the game a client's messages go to, handling JOIN along the way.
+ *
+ * Caller provides:
+ *  from: the address of the client
+ *  message: the message from the client
+ *
+ * We do:
+ *  Look the client up; a client seen for the first time joins the game it
+ *  names with "JOIN n", or the first game with room otherwise, and is told
+ *  "JOINED n" if it asked. Only JOIN, PLAY and SPECTATE bring in a new
+ *  client. Each PLAY or SPECTATE takes a seat in the client's game, which
+ *  the game gives back if it turns the client away (see releaseSeat).
+ *
+ * We return:
+ *  the index of the client's game
+ *  -1 if the message has been dealt with (JOIN, or an error)
+ */
+static int
+routeClient(const addr_t from, const char* message)
+{
+  bool join = strcmp(message, "JOIN") == 0
+              || strncmp(message, "JOIN ", strlen("JOIN ")) == 0;
+  bool spectate = strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0;
+  bool play = ! spectate && strncmp(message, "PLAY ", strlen("PLAY ")) == 0;
+  int slot = addrindex_find(serverState.clientIndex, from);
+  if (slot >= 0) { // check if client is already in a game
+    client_t* client = &serverState.clients[slot];
+    if (join) {
+      message_send(from, "ERROR already joined a game");
+      return -1;
+    }
+    if (play || spectate) { // check if asking for another seat
+      takeSeat(client, spectate);
+    }
+    return client->game;
+  }
+  if (! join && ! play && ! spectate) { // check if not a way in
+    message_send(from, "ERROR you must PLAY or SPECTATE first");
+    return -1;
+  }
+
+  // a new client: pick its game
+  int index = -1;
+  if (strncmp(message, "JOIN ", strlen("JOIN ")) == 0) { // check if named
+    if (! str2int(message + strlen("JOIN "), &index) || index < 0
+        || index >= serverState.numGames || serverState.over[index]) {
+      message_send(from, "ERROR no such game");
+      return -1;
+    }
+  } else if ((index = openGame(spectate)) < 0) { // check if all are full
+    message_send(from, "QUIT Sorry - every game is full.");
+    return -1;
+  }
+  if (serverState.numClients == MaxClients) { // check if table is full
+    message_send(from, "QUIT Sorry - the server is full.");
+    return -1;
+  }
+
+  client_t* client = &serverState.clients[serverState.numClients];
+  client->addr = from;
+  client->game = index;
+  client->seats = 0;
+  addrindex_set(serverState.clientIndex, from, serverState.numClients++);
+  if (join) { // check if client asked to join
+    message_sendf(from, "JOINED %d", index);
+    return -1;
+  }
+  takeSeat(client, spectate);
+  return index;
+}
+
+/************ openGame **************/
+/* Finds the first game still going that has a free seat.
+ *
+ * Caller provides:
+ *  spectate: true if the client wants to watch, and false if to play
+ *
+ * We return:
+ *  the index of the game
+ *  -1 if there is none
+ */
+static int
+openGame(const bool spectate)
+{
+  for (int i = 0; i < serverState.numGames; i++) { // loops through games
+    if (! serverState.over[i]
+        && (spectate ? serverState.watching[i] < MaxSpectators
+            : serverState.playing[i] < MaxPlayers)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/************ takeSeat **************/
+/* Counts a seat for a client in its game, before the game has seen the
+ * PLAY or SPECTATE asking for it, so that openGame sends no more clients to
+ * a game than it can seat.
+ *
+ * Caller provides:
+ *  client: the client, in the table
+ *  spectate: true for a spectator's seat, and false for a player's
+ */
+static void
+takeSeat(client_t* client, const bool spectate)
+{
+  if (spectate) {
+    serverState.watching[client->game]++;
+  } else {
+    serverState.playing[client->game]++;
+  }
+  client->seats++;
+}
+
+/************ freeSeat **************/
+/* Gives back a seat taken by takeSeat, on the thread running the message
+ * loop.
+ *
+ * Caller provides:
+ *  index: the index of the game
+ *  from: the address of the client
+ *  spectate: true for a spectator's seat, and false for a player's
+ *
+ * We do:
+ *  Uncount the seat; a client left with no seat is forgotten, so that any
+ *  further message from it is routed as from a new client. Seats of a game
+ *  that has ended were given back by finishGame, and are ignored.
+ */
+static void
+freeSeat(int index, const addr_t from, const bool spectate)
+{
+  int slot = addrindex_find(serverState.clientIndex, from);
+  if (slot < 0 || serverState.clients[slot].game != index) {
+    return; // game over, and the client forgotten with it
+  }
+  if (spectate) {
+    serverState.watching[index]--;
+  } else {
+    serverState.playing[index]--;
+  }
+  client_t* client = &serverState.clients[slot];
+  if (--client->seats > 0) { // check if the client still has a seat
+    return;
+  }
+
+  // forget the client, moving the last one into its slot
+  addrindex_remove(serverState.clientIndex, from);
+  serverState.numClients--;
+  if (slot < serverState.numClients) {
+    *client = serverState.clients[serverState.numClients];
+    addrindex_set(serverState.clientIndex, client->addr, slot);
+  }
+}
+
+/************ releaseSeat **************/
+/* Gives back the seat a client took with PLAY or SPECTATE, from the thread
+ * running its game, once the game has turned the client away.
+ *
+ * Caller provides:
+ *  game: the client's game
+ *  from: the address of the client
+ *  spectate: true for a spectator's seat, and false for a player's
+ *
+ * We do:
+ *  Call freeSeat here if the games run on the loop's thread; otherwise
+ *  report the seat on the pipe for the loop to free.
+ */
+static void
+releaseSeat(game_t* game, const addr_t from, const bool spectate)
+{
+  if (serverState.numThreads == 1) { // check if this is the loop's thread
+    freeSeat(game->index, from, spectate);
+    return;
+  }
+  report_t report = { spectate ? reportSpectator : reportPlayer,
+                      game->index, from };
+  write(serverState.reportFds[1], &report, sizeof(report));
+}
+
+/************ finishGame **************/
+/* Records that a game has ended, on the thread running the message loop.
+ *
+ * Caller provides:
+ *  index: the index of the game, which endGame has already ended
+ *
+ * We do:
+ *  Forget the game's clients, so that any further message from them is
+ *  routed as from a new client.
+ *
+ * We return:
+ *  true if every game is now over
+ *  false otherwise
+ */
+static bool
+finishGame(int index)
+{
+  if (! serverState.over[index]) { // check if not already recorded
+    serverState.over[index] = true;
+    serverState.gamesOver++;
+  }
+
+  // drop the game's clients from the table, keeping the others in order
+  int kept = 0;
+  for (int i = 0; i < serverState.numClients; i++) { // loops through clients
+    client_t* client = &serverState.clients[i];
+    if (client->game == index) {
+      addrindex_remove(serverState.clientIndex, client->addr);
+    } else {
+      if (kept < i) { // check if the client moves down
+        serverState.clients[kept] = *client;
+        addrindex_set(serverState.clientIndex, client->addr, kept);
+      }
+      kept++;
+    }
+  }
+  serverState.numClients = kept;
+  serverState.playing[index] = 0;
+  serverState.watching[index] = 0;
+
+  return serverState.gamesOver == serverState.numGames;
+}
+
+/************ handleGameMessage **************/
+/* Takes the message from a client of one game and reads it to delegate
+ * actions to helper functions, whether it be to create a spectator or
+ * player or move a player.
+ *
+ * Caller provides:
+ *  game: the client's game
+ *  from: the address of the client who made the request
+ *  message: the request from the client
+ *
+ * We do:
+ *  Depending on the request from the client pick the right function calls,
+ *  and time them by message type (see finishTiming).
+ *
+ * We return:
+ *  false if game not over
+ *  true if game over
+ */
+static bool
+handleGameMessage(game_t* game, const addr_t from, const char* message)
+{
+  uint64_t start = startTiming();
+  timing_t type = timeOther;
+  if (strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0) {
+    // run if client requests spectate
+    type = timeSpectate;
+    handleSpectate(game, from);
+  } else if (strncmp(message, "PLAY ", strlen("PLAY ")) == 0) {
+    // run if client requests play
+    type = timePlay;
+    const char* content = message + strlen("PLAY ");
+    handlePlay(game, from, content);
+  } else if (strncmp(message, "KEY ", strlen("KEY ")) == 0) {
+    // run if client requests key
+    type = timeKey;
+    const char* content = message + strlen("KEY ");
+    if (serverState.tickHz > 0 && queueKey(game, from, content)) {
+      finishTiming(type, start);
+      return false; // applied at the next tick
+    }
+    handleKey(game, from, content);
+  } else if (strcmp(message, "DELTA") == 0) {
+    // run if client asks for DELTA messages
+    handleDelta(game, from);
+  } else if (strncmp(message, "ACK ", strlen("ACK ")) == 0) {
+    // run if client acknowledges a DELTA frame
+    const char* content = message + strlen("ACK ");
+    handleAck(game, from, content);
+  } else { // runs if client request invalid
+    message_send(from, "ERROR invalid action provided");
+  }
+
+  if (serverState.tickHz == 0) { // check if not waiting for the tick
+    reposPlayers(game); // updates each player's grid
+  }
+
+  bool over = gold_nuggetsLeft(game->gold) == 0;
+  if (over) {
+    endGame(game); // sends game summary and frees the game
+  }
+  finishTiming(type, start);
+  return over;
+}
+
+/************* handleTick *************/
+/* Handles one tick of the game clock, when running with --tick-hz.
+ *
+ * We do:
+ *  Tick every game still going, here or, with worker threads, on the
+ *  thread that runs it.
+ *
+ * We return:
+ *  true once every game is over
+ *  false otherwise
+ */
+static bool
+handleTick(void* arg)
+{
+  eventlog_recordValue(serverState.recording, EventTick, 0);
+  if (serverState.numThreads > 1) { // check if workers run the games
+    for (int i = 0; i < serverState.numThreads; i++) { // loops through shards
+      postEvent(&serverState.shards[i], eventTick, 0, message_noAddr(), NULL);
+    }
+    return false;
+  }
+  for (int i = 0; i < serverState.numGames; i++) { // loops through games
+    if (! serverState.over[i] && tickGame(serverState.games[i])
+        && finishGame(i)) { // check if that was the last game
+      return true;
+    }
+  }
+  return false;
+}
+
+/************* tickGame *************/
+/* Runs one tick of a game.
+ *
+ * Caller provides:
+ *  game: a game still going
+ *
+ * We do:
+ *  Apply every key queued since the last tick, player by player in the
+ *  order each sent them, then send each client at most one display for
+ *  all of the changes together. However fast keys arrive, displays go out
+ *  at most tickHz times a second.
+ *
+ * We return:
+ *  true if the game is over
+ *  false otherwise
+ */
+static bool
+tickGame(game_t* game)
+{
+  uint64_t start = startTiming();
+  char key[2] = "";
+  for (int i = 0; i < game->playerCount; i++) { // loops through players
+    player_t* player = game->players[i];
+    for (int k = 0; k < game->numKeys[i] && ! player_getQuit(player);
+         k++) { // loops through keys until the player quits
+      key[0] = game->keys[i][k];
+      handleKey(game, player_getAddress(player), key);
+    }
+    game->numKeys[i] = 0;
+  }
+
+  reposPlayers(game); // one update for everything that happened this tick
+
+  bool over = gold_nuggetsLeft(game->gold) == 0;
+  if (over) {
+    endGame(game); // sends game summary and frees the game
+  }
+  finishTiming(timeTick, start);
+  return over;
+}
+
+/************* queueKey *************/
+/* Queues a player's keystroke for the next tick.
+ *
+ * Caller provides:
+ *  from: the address of the client who sent the key
+ *  content: the keystroke
+ *
+ * We return:
+ *  true if the key is queued, or dropped because the player has already
+ *  queued MaxQueuedKeys keys this tick
+ *  false if it is not a single key from a player, and should be handled
+ *  now (spectators, errors)
+ */
+static bool
+queueKey(game_t* game, addr_t from, const char* content)
+{
+  int index = findClient(game, from);
+  if (index < 0 || index >= MaxPlayers || strlen(content) != 1) {
+    return false;
+  }
+  if (game->numKeys[index] < MaxQueuedKeys) { // check if room left
+    game->keys[index][game->numKeys[index]++] = content[0];
+  }
+  return true;
+}
+
+/************* handleSignal *************/
+/* Handles SIGINT or SIGTERM sent to the server.
+ *
+ * Caller provides:
+ *  signum: the signal received
+ *
+ * We do:
+ *  End every game early, as if the gold had run out. Games run by worker
+ *  threads are ended by stopShards once the loop stops.
+ *
+ * We return:
+ *  true, to stop the message loop
+ */
+static bool
+handleSignal(void* arg, int signum)
+{
+  eventlog_recordValue(serverState.recording, EventSignal, signum);
+  fprintf(stderr, "server: signal %d, ending game\n", signum);
+  if (serverState.numThreads == 1) { // check if games run on this thread
+    for (int i = 0; i < serverState.numGames; i++) { // loops through games
+      if (! serverState.over[i]) {
+        endGame(serverState.games[i]);
+        finishGame(i);
+      }
+    }
+  }
+  return true;
+}
+
+/************* handleDump *************/
+/* Handles SIGUSR1 sent to the server.
+ *
+ * We do:
+ *  Print the latency histograms to stderr: how many of each message type
+ *  and phase were timed, and their mean, p50, p99, p99.9 and maximum.
+ *  Worker threads go on adding to them meanwhile.
+ *
+ * We return:
+ *  false, to keep the message loop going
+ */
+static bool
+handleDump(void* arg, int signum)
+{
+  fprintf(stderr, "server: latency since the server started\n");
+  histo_printHeader(stderr);
+  for (int i = 0; i < NumTimings; i++) { // loops through histograms
+    histo_print(serverState.timings[i], stderr);
+  }
+  return false;
+}
+
+/************* startTiming *************/
+/* Starts timing a message or tick on this thread.
+ *
+ * We return:
+ *  the time it started, for finishTiming
+ */
+static uint64_t
+startTiming(void)
+{
+  phaseNs[timeVisibility] = 0;
+  phaseNs[timeSerialize] = 0;
+  phaseNs[timeSend] = 0;
+  return histo_now();
+}
+
+/************* finishTiming *************/
+/* Records how long a message or tick took.
+ *
+ * Caller provides:
+ *  type: the histogram of its message type (or timeTick)
+ *  start: what startTiming returned
+ *
+ * We do:
+ *  Add the whole time to the type's histogram, the time spent in each phase
+ *  to that phase's histogram (if any was), and the rest, the game logic, to
+ *  the logic histogram.
+ */
+static void
+finishTiming(timing_t type, uint64_t start)
+{
+  uint64_t total = histo_now() - start;
+  histo_add(serverState.timings[type], total);
+  uint64_t phases = 0;
+  for (int i = timeVisibility; i <= timeSend; i++) { // loops through phases
+    if (phaseNs[i] > 0) {
+      histo_add(serverState.timings[i], phaseNs[i]);
+      phases += phaseNs[i];
+    }
+  }
+  histo_add(serverState.timings[timeLogic],
+            total > phases ? total - phases : 0);
+}
+
+/************* startShards *************/
+/* Starts the worker threads, when running with --threads.
+ *
+ * We do:
+ *  Start one worker per shard; game i belongs to shard i % numThreads. Open
+ *  the pipe on which workers report the games that end and the seats they
+ *  give back, and watch it from the message loop.
+ */
+static void
+startShards(void)
+{
+  if (pipe(serverState.reportFds) != 0
+      || ! message_watch(serverState.reportFds[0], handleReport)) {
+    fprintf(stderr, "error: cannot start worker threads.\n");
+    exit(1);
+  }
+  serverState.shards = calloc(serverState.numThreads, sizeof(shard_t));
+  if (serverState.shards == NULL) {
+    fprintf(stderr, "error: out of memory for worker threads.\n");
     exit(1);
   }
-
-  fclose(fp);
-  return 0;
+  for (int i = 0; i < serverState.numThreads; i++) { // loops through shards
+    shard_t* shard = &serverState.shards[i];
+    shard->index = i;
+    shard->head = 0;
+    shard->count = 0;
+    pthread_mutex_init(&shard->lock, NULL);
+    pthread_cond_init(&shard->ready, NULL);
+    pthread_cond_init(&shard->room, NULL);
+    if (pthread_create(&shard->thread, NULL, runShard, shard) != 0) {
+      fprintf(stderr, "error: cannot start worker threads.\n");
+      exit(1);
+    }
+  }
+}
+
+/************* stopShards *************/
+/* Stops the worker threads.
+ *
+ * We do:
+ *  Tell each worker to end the games it still runs and exit, wait for them
+ *  all, then free the shards and close the pipe.
+ */
+static void
+stopShards(void)
+{
+  for (int i = 0; i < serverState.numThreads; i++) { // loops through shards
+    postEvent(&serverState.shards[i], eventStop, 0, message_noAddr(), NULL);
+  }
+  for (int i = 0; i < serverState.numThreads; i++) { // loops through shards
+    shard_t* shard = &serverState.shards[i];
+    pthread_join(shard->thread, NULL);
+    pthread_mutex_destroy(&shard->lock);
+    pthread_cond_destroy(&shard->ready);
+    pthread_cond_destroy(&shard->room);
+  }
+  free(serverState.shards);
+  serverState.shards = NULL;
+  message_unwatch(serverState.reportFds[0]);
+  close(serverState.reportFds[0]);
+  close(serverState.reportFds[1]);
 }
 
-/*********** initGameState **************/
-/* Initializes all variables to be used by the game throughout the program run.
+/************* postEvent *************/
+/* Queues an event for a worker thread.
  *
  * Caller provides:
- *  mapFilename: valid pathname to a map file
+ *  shard: the worker's shard
+ *  type: what the worker should do
+ *  game, from, message: for eventMessage, the game and the client's message
  *
  * We do:
- *  Load the necessary maps and starting values for count and ID.
+ *  Copy the event into the shard's queue, waiting for room if the worker has
+ *  fallen ShardQueueSize events behind, and wake the worker.
  */
 static void
-initGameState(char* mapFilename)
+postEvent(shard_t* shard, eventType_t type, int game,
+          const addr_t from, const char* message)
 {
-  gameState.staticGrid = grid_load(mapFilename); // load initial map
-  gameState.liveGrid = grid_load(mapFilename); // load initial map
-   // drop gold piles in live grid
-  gameState.numPiles = grid_setGold(gameState.liveGrid,
-                                    GoldMinNumPiles, GoldMaxNumPiles);
-  
-  // initialize each player in the array of players
-  for (int i = 0; i < MaxPlayers + 1; i++) { // loops through all players
-    gameState.players[i] = NULL;
+  pthread_mutex_lock(&shard->lock);
+  while (shard->count == ShardQueueSize) { // wait for the worker to catch up
+    pthread_cond_wait(&shard->room, &shard->lock);
   }
-  
-  gameState.spectatorAddr = message_noAddr();
-  gameState.playerCount = 0;
-  gameState.playerID = 'A'; // starting player's ID
-  gameState.nuggetsLeft = GoldTotal; // nuggets left is total at start
+  event_t* event = &shard->events[(shard->head + shard->count) % ShardQueueSize];
+  event->type = type;
+  event->game = game;
+  event->from = from;
+  event->text[0] = '\0';
+  if (message != NULL) {
+    // longer messages are cut short; no valid one comes close
+    strncat(event->text, message, MaxEventBytes - 1);
+  }
+  shard->count++;
+  pthread_cond_signal(&shard->ready);
+  pthread_mutex_unlock(&shard->lock);
 }
 
-/************ parseArgs *************/
-/* Takes the user provided arguments and makes them into usable values for the
- * program.
+/************* runShard *************/
+/* The body of a worker thread.
  *
  * Caller provides:
- *  Number of arguments
- *  Arguments array
- *  Pointer to mapFilename: pointer to valid pathname to a map file
- *  Pointer to seed: pointer to a number for randomization
+ *  arg: the worker's shard
  *
  * We do:
- *  Assign values to mapFilename and seed.
- *
- * We return:
- *  0 if successful
- *  Non-zero if not successful
+ *  Take events from the shard's queue in order and apply them to the
+ *  shard's games, until told to stop; report each game that ends on the
+ *  pipe, after any seats it gave back (see releaseSeat). Before waiting for
+ *  more, send anything this thread queued.
  */
-static int
-parseArgs(const int argc, char* argv[], char** mapFilename, int* seed)
+static void*
+runShard(void* arg)
 {
-  FILE* fp = NULL;
-  if (argc == 2) { // check if two arguments provided
-    *mapFilename = argv[1];
-    if ((fp=fopen(*mapFilename, "r")) == NULL) { // check if map file readable
-      fprintf(stderr, "error: invalid map filename.\n");
-      exit(1);
+  shard_t* shard = arg;
+  bool stop = false;
+  while (! stop) {
+    pthread_mutex_lock(&shard->lock);
+    if (shard->count == 0) { // check if about to wait
+      pthread_mutex_unlock(&shard->lock);
+      message_flush(); // send anything queued with --batch
+      pthread_mutex_lock(&shard->lock);
+      while (shard->count == 0) {
+        pthread_cond_wait(&shard->ready, &shard->lock);
+      }
     }
-    srand(getpid());
-    fclose(fp);
-  } else if (argc == 3) { // check if three arguments provided
-    *mapFilename = argv[1];
-    if ((fp=fopen(*mapFilename, "r")) == NULL) { // check if map file readable
-      fprintf(stderr, "error: invalid map filename.\n");
-      exit(1);
+    event_t event = shard->events[shard->head];
+    shard->head = (shard->head + 1) % ShardQueueSize;
+    shard->count--;
+    pthread_cond_signal(&shard->room);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (event.type == eventMessage) { // check if a client's message
+      game_t* game = serverState.games[event.game];
+      if (! game->over && handleGameMessage(game, event.from, event.text)) {
+        report_t report = { reportDone, event.game };
+        write(serverState.reportFds[1], &report, sizeof(report));
+      }
+      continue;
     }
-    fclose(fp);
 
-    // check if convert argument into seed integer successful
-    if (str2int(argv[2], seed)) {
-      if (*seed>0){
-        srand(*seed);
-      } else { // provided seed is an integer but not positive
-        fprintf(stderr, "error: invalid seed. must be positive integer.\n");
-        exit(1);
+    // ticks and stops apply to every game of the shard
+    for (int i = shard->index; i < serverState.numGames;
+         i += serverState.numThreads) { // loops through the shard's games
+      game_t* game = serverState.games[i];
+      if (game->over) {
+        continue;
+      }
+      if (event.type == eventStop) { // check if stopping
+        endGame(game);
+      } else if (tickGame(game)) { // check if the game ended this tick
+        report_t report = { reportDone, i };
+        write(serverState.reportFds[1], &report, sizeof(report));
       }
-      
-    } else { // provided seed is not an integer
-      fprintf(stderr, "error: invalid seed. must be positive integer.\n");
-      exit(1);
     }
-    
-  } else { // runs if invalid number of arguments provided
-    fprintf(stderr, "usage: %s map.txt [seed]\n", argv[0]);
-    exit(1);
+    stop = event.type == eventStop;
   }
-  return 0;
+  message_flush();
+  return NULL;
 }
 
-/************ handleMessage **************/
-/* Takes the message from the server and reads it to delegate actions to helper
- * functions, whether it be to create a spectator or player or move a player.
+/************* handleReport *************/
+/* Handles a worker's report that one of its games has ended, or has given
+ * back a client's seat.
  *
  * Caller provides:
- *  optional arg: if needed
- *  from: the address of the client who made the request
- *  message: the request from the client
- *
- * We do:
- *  Depending on the request from the client pick the right function calls.
+ *  fd: the read end of the pipe
  *
  * We return:
- *  false if game not over
- *  true if game over
+ *  true once every game is over, to stop the message loop
+ *  false otherwise
  */
 static bool
-handleMessage(void* arg, const addr_t from, const char* message)
+handleReport(void* arg, int fd)
 {
-  if (strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0) {
-    // run if client requests spectate
-    handleSpectate(from);
-  } else if (strncmp(message, "PLAY ", strlen("PLAY ")) == 0) {
-    // run if client requests play
-    const char* content = message + strlen("PLAY ");
-    handlePlay(from, content);
-  } else if (strncmp(message, "KEY ", strlen("KEY ")) == 0) {
-    // run if client requests key
-    const char* content = message + strlen("KEY ");
-    handleKey(from, content);
-  } else { // runs if client request invalid
-    message_send(from, "ERROR invalid action provided");
+  report_t report;
+  if (read(fd, &report, sizeof(report)) != sizeof(report)) {
+    return false;
   }
+  if (report.type != reportDone) { // check if a seat was given back
+    freeSeat(report.game, report.from, report.type == reportSpectator);
+    return false;
+  }
+  return finishGame(report.game);
+}
 
-  reposPlayers(); // updates each player's grid
-
-  if (gameState.nuggetsLeft == 0) {
-    sendSummaryMsg(); // sends game summary to all players
+/************* endGame *************/
+/* Ends a game.
+ *
+ * We do:
+ *  Send the game summary to every client, then delete all players, the
+ *  spectators, the delta states and the live grid, and mark the game over.
+ *  The static grid is shared, and deleted when the server exits.
+ */
+static void
+endGame(game_t* game)
+{
+  sendSummaryMsg(game); // sends game summary to all players
 
-    // deletes all players
-    for (int i = 0; i < gameState.playerCount; i++) { // loops through players
-      player_delete(gameState.players[i]);
+  // deletes all players
+  for (int i = 0; i < game->playerCount; i++) { // loops through players
+    if (! player_getQuit(game->players[i])) { // no longer active either
+      atomic_fetch_sub(&serverState.activePlayers, 1);
     }
+    player_delete(game->players[i]);
+  }
 
-    player_deleteSpect(gameState.players[MaxPlayers]);
-    grid_delete(gameState.staticGrid); // delete game static grid
-    grid_delete(gameState.liveGrid); // delete game live grid
-    return true;
+  for (int i = 0; i < MaxSpectators; i++) { // loops through spectators
+    player_deleteSpect(game->spectators[i]);
   }
-  return false;
+  for (int i = 0; i < MaxPlayers + MaxSpectators; i++) { // delta states
+    delta_delete(game->deltas[i]);
+  }
+  free(game->spectatorFrame);
+  free(game->playerFrame);
+  grid_delete(game->liveGrid); // delete game live grid
+  addrindex_delete(game->playerIndex);
+  addrindex_delete(game->spectatorIndex);
+  gold_delete(game->gold);
+  game->over = true;
 }
 
 /************* handleSpectate ***************/
@@ -244,23 +1636,54 @@ handleMessage(void* arg, const addr_t from, const char* message)
  *  from: the address of the client who made the request
  *
  * We do:
- *  Create a new spectator (also replace the old one if applicable).
+ *  Add a new spectator, who is sent the live grid with the next update;
+ *  a client already watching starts over, keeping the seat it had. Turn the
+ *  client away if MaxSpectators are already watching.
  */
 static void
-handleSpectate(addr_t from)
+handleSpectate(game_t* game, addr_t from)
 {
-  player_t* spectator = player_newSpect(gameState.liveGrid, from);
-  // check if spectator exists
-  if (! message_eqAddr(gameState.spectatorAddr, message_noAddr())) {
-    player_deleteSpect(gameState.players[MaxPlayers]); // delete old spectator
-    message_send(gameState.spectatorAddr,
-                  "QUIT You have been replaced by a new spectator.");
+  int slot = addrindex_find(game->spectatorIndex, from);
+  if (slot >= 0) { // check if watching already
+    releaseSeat(game, from, true); // starts over in the seat it has
+  } else if (game->numSpectators == MaxSpectators) {
+    message_send(from, "QUIT Game is full: no more spectators can watch.");
+    releaseSeat(game, from, true);
+    return;
+  } else {
+    for (slot = 0; game->spectators[slot] != NULL; slot++) {
+      // finds the first free slot
+    }
+    game->spectators[slot] = player_newSpect(from);
+    addrindex_set(game->spectatorIndex, from, slot);
+    game->numSpectators++;
   }
-  gameState.players[MaxPlayers] = spectator; // add new spectator
-  gameState.spectatorAddr = from; // save spectator's address
-  sendGridMsg(from, grid_getRows(gameState.staticGrid),
-              grid_getCols(gameState.staticGrid));
-  sendGoldMsg(from, 0, 0, gameState.nuggetsLeft);
+  delta_delete(game->deltas[MaxPlayers + slot]); // spectator starts over
+  game->deltas[MaxPlayers + slot] = NULL;
+  game->spectatorSeen[slot] = 0; // needs a display
+  sendGridMsg(from, grid_getRows(game->staticGrid),
+              grid_getCols(game->staticGrid));
+  sendGoldMsg(from, 0, 0, gold_nuggetsLeft(game->gold));
+}
+
+/************* removeSpectator ***************/
+/* Stops sending the game to a spectator, and gives back their seat so that
+ * another spectator can be routed to the game.
+ *
+ * Caller provides:
+ *  slot: the spectator's slot in the spectators array
+ */
+static void
+removeSpectator(game_t* game, int slot)
+{
+  addr_t from = player_getAddress(game->spectators[slot]);
+  addrindex_remove(game->spectatorIndex, from);
+  releaseSeat(game, from, true);
+  player_deleteSpect(game->spectators[slot]);
+  game->spectators[slot] = NULL;
+  delta_delete(game->deltas[MaxPlayers + slot]);
+  game->deltas[MaxPlayers + slot] = NULL;
+  game->numSpectators--;
 }
 
 /************* handlePlay **************/
@@ -270,13 +1693,14 @@ handleSpectate(addr_t from)
  *  from: the address of the client who made the request
  *
  * We do:
- *  Create a new player and place them at a random place on the grid.
+ *  Create a new player and place them at a random place on the grid. A
+ *  client turned away gets its seat back (see releaseSeat).
  */
 static void
-handlePlay(addr_t from, const char* content)
+handlePlay(game_t* game, addr_t from, const char* content)
 {
   // check if max player count has not been exceeded
-  if (gameState.playerCount < MaxPlayers) {
+  if (game->playerCount < MaxPlayers) {
     int length = MaxNameLength;
 
     // check if provided name is shorter than maximum
@@ -287,48 +1711,45 @@ handlePlay(addr_t from, const char* content)
     // allocates memory for new player's name
     char* name = calloc((length + 1), sizeof(char));
 
-    if (formatName(content, length, name)) { // check if name is valid
-      char id = gameState.playerID;
+    int col = 0;
+    int row = 0;
 
-      // get nr and nc from live grid to generate random player location
-      int numRows = grid_getRows(gameState.liveGrid);
-      int numCols = grid_getCols(gameState.liveGrid);
+    if (! grid_randomFree(game->liveGrid, &row, &col)) {
+      // check if there is a free room spot for the player
+      message_send(from, "QUIT Game is full: no room for more players.");
+      releaseSeat(game, from, false);
+      free(name);
+    } else if (formatName(content, length, name)) { // check if name is valid
+      char id = game->playerID;
 
-      bool validPos = false; // false until calculated player location is valid
-      int col = 0;
-      int row = 0;
-
-      while (!validPos) { // runs until a valid position is found
-        col = rand() % numCols;
-        row = rand() % numRows;
-        char pos = grid_getChar(gameState.liveGrid, row, col);
-
-        if (pos == roomSpot) { // check if player location is room spot
-          validPos = true;
-        }
-      }
+      // create new player at the random free room spot, having seen nothing
+      gridview_t* view = grid_newView(game->staticGrid);
+      player_t* player = player_newPlayer(id, from, name, col, row, view);
+      updateVisGrid(game, player); // update player's view with visibility
+      markDirty(game, row, col); // other players may see the new player
 
-      // create new player
-      grid_t* playerGrid = grid_new(numRows, numCols);
-      grid_update(gameState.staticGrid, gameState.liveGrid, playerGrid,
-                  id, row, col); // update player's grid with visibility
-      player_t* player = player_newPlayer(id, from, name, col, row, playerGrid);
-      
       // insert new player into the array of players
-      gameState.players[gameState.playerCount] = player;
-      gameState.playerCount++; // increment player count
-      gameState.playerID++; // move onto the next available player ID
+      game->players[game->playerCount] = player;
+      if (addrindex_find(game->playerIndex, from) < 0) { // first PLAY wins
+        addrindex_set(game->playerIndex, from, game->playerCount);
+      }
+      game->playerCount++; // increment player count
+      atomic_fetch_add(&serverState.activePlayers, 1);
+      game->playerID++; // move onto the next available player ID
 
       sendOkMsg(from, id);
-      sendGridMsg(from, grid_getRows(gameState.staticGrid),
-                  grid_getCols(gameState.staticGrid));
-      sendGoldMsg(from, 0, 0, gameState.nuggetsLeft);
-      reposPlayers(); // updates the positions of all players and visibility
+      sendGridMsg(from, grid_getRows(game->staticGrid),
+                  grid_getCols(game->staticGrid));
+      sendGoldMsg(from, 0, 0, gold_nuggetsLeft(game->gold));
+      reposPlayers(game); // updates the positions of all players and visibility
     } else { // runs if name is invalid
       message_send(from, "QUIT Sorry - you must provide player's name.");
+      releaseSeat(game, from, false);
+      free(name);
     }
   } else { // runs if game is at maximum player capacity
     message_send(from, "QUIT Game is full: no more players can join.");
+    releaseSeat(game, from, false);
   }
 }
 
@@ -342,66 +1763,125 @@ handlePlay(addr_t from, const char* content)
  *  Either quit or move the player depending on the keystroke.
  */
 static void
-handleKey(addr_t from, const char* content)
+handleKey(game_t* game, addr_t from, const char* content)
 {
-  player_t* player = NULL;
-
   // finds the player based on address
-  for (int i = 0; i < gameState.playerCount; i++) { // loops through players
-    player_t* temp = gameState.players[i];
-    // checks if addresses are equal
-    if (message_eqAddr(from, player_getAddress(temp))) {
-      player = temp;
-      break;
-    }
-  }
+  int index = addrindex_find(game->playerIndex, from);
+  player_t* player = index < 0 ? NULL : game->players[index];
 
   if (strcmp("Q", content) == 0) { // quits
-    // checks address is spectator's address
-    if (message_eqAddr(from, gameState.spectatorAddr)) {
+    int slot = addrindex_find(game->spectatorIndex, from);
+    if (slot >= 0) { // check if a spectator quit
       message_send(from, "QUIT Thanks for watching!");
-      gameState.spectatorAddr = message_noAddr();
+      removeSpectator(game, slot);
     } else { // runs if not a spectator
       message_send(from, "QUIT Thanks for playing!");
     }
+    if (player != NULL) { // check if a player quit
+      addrindex_remove(game->playerIndex, from); // later keys are ignored
+      atomic_fetch_sub(&serverState.activePlayers, 1);
+      atomic_fetch_add(&serverState.quitPlayers, 1);
+    }
     player_quit(player);
   } else if (strcmp("h", content) == 0) { // moves left
-    moveHelper(player, -1, 0);
+    moveHelper(game, player, -1, 0);
   } else if (strcmp("H", content) == 0) { // moves far left
-    while (moveHelper(player, -1, 0)) {}
+    slideHelper(game, player, -1, 0);
   } else if (strcmp("l", content) == 0) { // moves right
-    moveHelper(player, 1, 0);
+    moveHelper(game, player, 1, 0);
   } else if (strcmp("L", content) == 0) { // moves far right
-    while (moveHelper(player, 1, 0)) {}
+    slideHelper(game, player, 1, 0);
   } else if (strcmp("j", content) == 0) { // moves down
-    moveHelper(player, 0, 1);
+    moveHelper(game, player, 0, 1);
   } else if (strcmp("J", content) == 0) { // moves far down
-    while (moveHelper(player, 0, 1)) {}
+    slideHelper(game, player, 0, 1);
   } else if (strcmp("k", content) == 0) { // moves up
-    moveHelper(player, 0, -1);
+    moveHelper(game, player, 0, -1);
   } else if (strcmp("K", content) == 0) { // moves far up
-    while (moveHelper(player, 0, -1)) {}
+    slideHelper(game, player, 0, -1);
   } else if (strcmp("y", content) == 0) { // moves diagonally up, left
-    moveHelper(player, -1, -1);
+    moveHelper(game, player, -1, -1);
   } else if (strcmp("Y", content) == 0) { // moves far diagonally up, left
-    while (moveHelper(player, -1, -1)) {}
+    slideHelper(game, player, -1, -1);
   } else if (strcmp("u", content) == 0) { // moves diagonally up, right
-    moveHelper(player, 1, -1);
+    moveHelper(game, player, 1, -1);
   } else if (strcmp("U", content) == 0) { // moves far diagonally up, right
-    while (moveHelper(player, 1, -1)) {}
+    slideHelper(game, player, 1, -1);
   } else if (strcmp("b", content) == 0) { // moves diagonally down, left
-    moveHelper(player, -1, 1);
+    moveHelper(game, player, -1, 1);
   } else if (strcmp("B", content) == 0) { // moves far diagonally down, left
-    while (moveHelper(player, -1, 1)) {}
+    slideHelper(game, player, -1, 1);
   } else if (strcmp("n", content) == 0) { // moves diagonally down, right
-    moveHelper(player, 1, 1);
+    moveHelper(game, player, 1, 1);
   } else if (strcmp("N", content) == 0) { // moves far diagonally down, right
-    while (moveHelper(player, 1, 1)) {}
+    slideHelper(game, player, 1, 1);
   } else {
     message_send(from, "ERROR unknown keystroke");
   }
 }
 
+/************* handleDelta *************/
+/* Handles the request from a client to receive DELTA messages instead of
+ * DISPLAY messages.
+ *
+ * Caller provides:
+ *  from: the address of the client who made the request
+ *
+ * We do:
+ *  Start a delta state for the player or spectator at that address and send
+ *  them a keyframe of their current grid.
+ */
+static void
+handleDelta(game_t* game, addr_t from)
+{
+  int index = findClient(game, from);
+  if (index < 0) { // check if client has not joined
+    message_send(from, "ERROR you must PLAY or SPECTATE before DELTA");
+    return;
+  }
+  if (game->deltas[index] == NULL) { // check if not yet opted in
+    game->deltas[index] = delta_new();
+    if (game->deltas[index] == NULL) {
+      message_send(from, "ERROR cannot send DELTA messages");
+      return;
+    }
+  }
+
+  // the first frame is always a keyframe
+  const char* gridStr = index >= MaxPlayers ? grid_getText(game->liveGrid)
+                        : composeFrame(game, game->players[index]);
+  if (gridStr == NULL) {
+    return;
+  }
+  sendFrame(game, index, from, gridStr);
+  if (index >= MaxPlayers) { // check if a spectator, now up to date
+    game->spectatorSeen[index - MaxPlayers] = game->frameVersion;
+  }
+}
+
+/************* handleAck *************/
+/* Handles a client's acknowledgement of a DELTA frame.
+ *
+ * Caller provides:
+ *  from: the address of the client who made the request
+ *  content: the frame number
+ *
+ * We do:
+ *  Let later DELTA messages to the client build on that frame.
+ */
+static void
+handleAck(game_t* game, addr_t from, const char* content)
+{
+  int index = findClient(game, from);
+  int frame;
+  if (index < 0 || game->deltas[index] == NULL
+      || !str2int(content, &frame)) { // check if ACK makes sense
+    message_send(from, "ERROR invalid ACK");
+    return;
+  }
+  delta_ack(game->deltas[index], frame); // stale ACKs are ignored
+}
+
 /************* moveHelper *************/
 /* 
  *
@@ -411,91 +1891,163 @@ handleKey(addr_t from, const char* content)
  *  row: change in y direction along rows
  *
  * We do:
+ *  Move the player one spot (see stepHelper), then put the moved players
+ *  back on the live grid and update their grids.
+ *
+ * We return:
+ *  false if the movement is invalid
+ *  true if the movement is valid
+ */
+static bool
+moveHelper(game_t* game, player_t* player, int col, int row)
+{
+  uint64_t start = histo_now();
+  player_t* swapped = NULL; // player displaced by this move, if any
+  bool moved = stepHelper(game, player, col, row, &swapped);
+  if (moved) {
+    if (swapped != NULL) {
+      updateVisGrid(game, swapped);
+    }
+    updateVisGrid(game, player);
+  }
+  histo_add(serverState.timings[timeMove], histo_now() - start);
+  return moved;
+}
+
+/************* slideHelper *************/
+/* 
+ *
+ * Caller provides:
+ *  player: player being moved
+ *  col: change in x direction along columns
+ *  row: change in y direction along rows
+ *
+ * We do:
+ *  Step the player in the direction until the move is invalid, collecting
+ *  gold and switching spots with players on the way. Each spot passed
+ *  through only has its view marked as seen (grid_reveal); the player's
+ *  grid is updated once, at the spot where the player stops. The result
+ *  is the same as calling moveHelper until it returns false.
+ */
+static void
+slideHelper(game_t* game, player_t* player, int col, int row)
+{
+  uint64_t start = histo_now();
+  bool moved = false;       // whether the player has left its first spot
+  int passedRow = 0, passedCol = 0; // spot before the current one
+  player_t* swapped = NULL; // player displaced by the last step, if any
+
+  while (stepHelper(game, player, col, row, &swapped)) {
+    if (moved) { // the spot it just left was only passed through
+      uint64_t revealStart = histo_now();
+      grid_reveal(game->staticGrid, player_getView(player),
+                  passedRow, passedCol);
+      phaseNs[timeVisibility] += histo_now() - revealStart;
+    }
+    if (swapped != NULL) { // rare; update the displaced player right away
+      updateVisGrid(game, swapped);
+    }
+    moved = true;
+    passedRow = player_getRow(player);
+    passedCol = player_getCol(player);
+  }
+  if (moved) {
+    updateVisGrid(game, player);
+  }
+  histo_add(serverState.timings[timeSlide], histo_now() - start);
+}
+
+/************* stepHelper *************/
+/* 
+ *
+ * Caller provides:
+ *  player: player being moved
+ *  col: change in x direction along columns
+ *  row: change in y direction along rows
+ *  swapped: where to store the player displaced by the move, if any
+ *
+ * We do:
  *  Check the destination spot.
  *  If it is a gold pile collect gold, another player switch spots, and
- *  room/passage spot move.
+ *  room/passage spot move. The player is taken off its old spot in the live
+ *  grid; the caller puts the moved players back with grid_update.
  *
  * We return:
  *  false if the movement is invalid
  *  true if the movement is valid
  */
 static bool
-moveHelper(player_t* player, int col, int row)
+stepHelper(game_t* game, player_t* player, int col, int row,
+           player_t** swapped)
 {
+  *swapped = NULL;
+  if (player == NULL) { // check if key came from an unknown client
+    return false;
+  }
+
   int tempCol = player_getCol(player) + col; // destination column location
   int tempRow = player_getRow(player) + row; // destination row location
   
-  if (gameState.nuggetsLeft == 0) { // check if game is over
+  if (gold_nuggetsLeft(game->gold) == 0) { // check if game is over
     return false;
   }
 
   // check if destination location is in bounds of grid
-  if (tempCol >= 0 && tempRow >= 0 && tempCol < grid_getCols(gameState.staticGrid)
-      && tempRow < grid_getRows(gameState.staticGrid)) {
+  if (tempCol >= 0 && tempRow >= 0 && tempCol < grid_getCols(game->staticGrid)
+      && tempRow < grid_getRows(game->staticGrid)) {
     // gets character at destination location
-    char spot = grid_getChar(gameState.liveGrid, tempRow, tempCol);
+    char spot = grid_getChar(game->liveGrid, tempRow, tempCol);
     
     // check if destination location is not wall spot
     if (spot != horiBound && spot != vertBound && spot != cornerBound && spot != solidRock) {
-      resetLiveGrid(); // removes all players temporarily from live grid
-      if (spot == goldPile) { // check if destination location is gold pile
-
-        // calculate random number of gold nuggets for pile
-        gameState.numPiles -= 1;
-        int nuggetsInPile = 0;
-        bool validNum = false;
-        while (!validNum) { // runs until valid number of gold calculated
-          nuggetsInPile = rand() % gameState.nuggetsLeft + 1;
-          if (gameState.numPiles != 0) { // check if piles left is not zero
-            // check if at least one gold in pile
-            if (((gameState.nuggetsLeft - nuggetsInPile)/gameState.numPiles) > 0) {
-              validNum = true;
-            }
-          } else { // runs if no gold piles left
-            validNum = true;
-          }
-        }
+      // takes the player off its old spot in the live grid
+      grid_remove(game->staticGrid, game->liveGrid,
+                  player_getView(player),
+                  player_getRow(player), player_getCol(player));
+      markDirty(game, player_getRow(player), player_getCol(player));
+      markDirty(game, tempRow, tempCol);
+
+      if (gold_at(game->gold, tempRow, tempCol) > 0) {
+        // check if destination location is gold pile; its size was set
+        // when the gold was dropped
+        int nuggetsInPile = gold_pickup(game->gold, tempRow, tempCol);
         player_addGold(player, nuggetsInPile);
-        gameState.nuggetsLeft -= nuggetsInPile;
         
         player_move(player, col, row);
 
         sendGoldMsg(player_getAddress(player), nuggetsInPile,
-                    player_getGold(player), gameState.nuggetsLeft);
+                    player_getGold(player), gold_nuggetsLeft(game->gold));
 
         // loop through players + send gold message to other players in server
-        for (int i = 0; i < gameState.playerCount; i++) {
+        for (int i = 0; i < game->playerCount; i++) {
           // check if player is not same as one at current index
-          if (gameState.players[i] != player) {
-            sendGoldMsg(player_getAddress(gameState.players[i]), 0,
-                        player_getGold(gameState.players[i]),
-                        gameState.nuggetsLeft);
+          if (game->players[i] != player) {
+            sendGoldMsg(player_getAddress(game->players[i]), 0,
+                        player_getGold(game->players[i]),
+                        gold_nuggetsLeft(game->gold));
           }
         }
 
-        // check if spectator exists
-        if (! message_eqAddr(gameState.spectatorAddr, message_noAddr())) {
-          sendGoldMsg(gameState.spectatorAddr, 0, 0, gameState.nuggetsLeft);
+        // and to every spectator
+        for (int i = 0; i < MaxSpectators; i++) { // loops through spectators
+          if (game->spectators[i] != NULL) {
+            sendGoldMsg(player_getAddress(game->spectators[i]), 0, 0,
+                        gold_nuggetsLeft(game->gold));
+          }
         }
       } else if (isalpha(spot) != 0) {
         // check if destination spot is player
         // flip the positions of the two players
-        player_t* temp = findPlayer(spot);
+        *swapped = findPlayer(game, spot);
+        grid_remove(game->staticGrid, game->liveGrid,
+                    player_getView(*swapped), tempRow, tempCol);
         player_move(player, col, row);
-        player_move(temp, col*-1, row*-1);
+        player_move(*swapped, col*-1, row*-1);
       } else if (spot == roomSpot || spot == passageSpot) {
         // check if destination is room/passage spot
         player_move(player, col, row);
       }
       
-      // loop through players + update the grids of all players
-      for (int i = 0; i < gameState.playerCount; i++) {
-        player_t* playerTemp = gameState.players[i];
-        grid_update(gameState.staticGrid, gameState.liveGrid,
-                    player_getVisGrid(playerTemp), player_getID(playerTemp),
-                    player_getRow(playerTemp), player_getCol(playerTemp));
-      }
-
       return true;
     } else { // runs if destination location is wall spot
       return false;
@@ -505,51 +2057,163 @@ moveHelper(player_t* player, int col, int row)
 }
 
 /************ reposPlayers ***************/
-/* Updates each player's grids and sends the message to the clients.
+/* Updates the grids of the players who can see a change and sends the
+ * message to the clients.
  *
  * We do:
- *  Loop through all players and update their grids (visibility included) and
- *  send it off to the clients.
+ *  Loop through all players; for each one who can see a spot changed since
+ *  the last call, update their grid (visibility included) and send it off to
+ *  the client. If anything changed, the live grid has a new version; send
+ *  it to each spectator who has not seen it (see sendSpectatorFrames).
  */
 static void
-reposPlayers(void)
+reposPlayers(game_t* game)
 {
-  // updates the grids of all players and sends grids to players
-  for (int i = 0; i < gameState.playerCount; i++) { // loops through players
-    player_t* playerTemp = gameState.players[i];
-    grid_update(gameState.staticGrid, gameState.liveGrid,
-                player_getVisGrid(playerTemp), player_getID(playerTemp),
-                player_getRow(playerTemp), player_getCol(playerTemp));
-    char* gridStr = grid_toString(player_getVisGrid(playerTemp));
-    sendDisplayMsg(player_getAddress(playerTemp), gridStr);
-    free(gridStr);
+  uint64_t start = histo_now();
+  // updates the views of affected players and sends their grids to them
+  for (int i = 0; i < game->playerCount; i++) { // loops through players
+    player_t* playerTemp = game->players[i];
+    uint64_t seesStart = histo_now();
+    bool sees = seesChange(game, playerTemp);
+    phaseNs[timeVisibility] += histo_now() - seesStart;
+    if (sees) { // check if player can see any change
+      updateVisGrid(game, playerTemp);
+      const char* gridStr = composeFrame(game, playerTemp);
+      if (gridStr != NULL) {
+        sendFrame(game, i, player_getAddress(playerTemp), gridStr);
+      }
+    }
+  }
+
+  if (game->numDirty > 0 || game->allDirty) { // check if anything changed
+    game->frameVersion++;
   }
+  sendSpectatorFrames(game);
 
-  // check if spectator exists
-  if (! message_eqAddr(gameState.spectatorAddr, message_noAddr())) {
-    char* gridStr = grid_toString(gameState.liveGrid);
-    // send the live grid to spectator
-    sendDisplayMsg(gameState.spectatorAddr, gridStr);
-    free(gridStr);
+  // every change has now been sent
+  game->numDirty = 0;
+  game->allDirty = false;
+  histo_add(serverState.timings[timeRepos], histo_now() - start);
+}
+
+/************ sendSpectatorFrames ***************/
+/* Sends the live grid to every spectator who has not seen its version.
+ *
+ * We do:
+ *  Make the DISPLAY message once per version of the live grid, and send
+ *  the same message to every spectator who takes DISPLAY messages; a
+ *  spectator who asked for DELTA messages gets a delta from the last frame
+ *  they acknowledged (see sendFrame).
+ */
+static void
+sendSpectatorFrames(game_t* game)
+{
+  const char* gridStr = grid_getText(game->liveGrid);
+  for (int i = 0; i < MaxSpectators; i++) { // loops through spectators
+    player_t* spectator = game->spectators[i];
+    if (spectator == NULL || game->spectatorSeen[i] == game->frameVersion) {
+      continue; // no spectator, or already up to date
+    }
+    if (game->deltas[MaxPlayers + i] != NULL) { // check if wants DELTA
+      sendFrame(game, MaxPlayers + i, player_getAddress(spectator), gridStr);
+    } else {
+      if (game->spectatorFrameVersion != game->frameVersion) { // check if old
+        uint64_t start = histo_now();
+        if (game->spectatorFrame == NULL) { // the grid's size never changes
+          game->spectatorFrame = malloc(strlen("DISPLAY\n")
+                                        + strlen(gridStr) + 1);
+          if (game->spectatorFrame == NULL) {
+            return;
+          }
+        }
+        strcpy(game->spectatorFrame, "DISPLAY\n");
+        strcat(game->spectatorFrame, gridStr);
+        game->spectatorFrameVersion = game->frameVersion;
+        phaseNs[timeSerialize] += histo_now() - start;
+      }
+      uint64_t start = histo_now();
+      message_send(player_getAddress(spectator), game->spectatorFrame);
+      phaseNs[timeSend] += histo_now() - start;
+    }
+    game->spectatorSeen[i] = game->frameVersion;
   }
 }
 
-/************ resetLiveGrid ***************/
-/* Cleans off all player IDs off the live grid.
+/************ updateVisGrid ***************/
+/* Updates a player's view with what they see from where they stand, and
+ * puts them on the live grid (see grid_update).
  *
  * We do:
- *  Loop through all players and take their ID symbol off of the live grid.
+ *  Time the update, as one grid_update call and as visibility work of the
+ *  message being handled.
  */
 static void
-resetLiveGrid(void)
+updateVisGrid(game_t* game, player_t* player)
 {
-  // removes all players from the live grid
-  for (int i = 0; i < gameState.playerCount; i++) { // loops through players
-    player_t* playerTemp = gameState.players[i];
-    grid_remove(gameState.staticGrid, gameState.liveGrid,
-                player_getVisGrid(playerTemp),
-                player_getRow(playerTemp), player_getCol(playerTemp));
+  uint64_t start = histo_now();
+  grid_update(game->staticGrid, game->liveGrid,
+              player_getView(player), player_getID(player),
+              player_getRow(player), player_getCol(player));
+  uint64_t elapsed = histo_now() - start;
+  histo_add(serverState.timings[timeGridUpdate], elapsed);
+  phaseNs[timeVisibility] += elapsed;
+}
+
+/************ markDirty ***************/
+/* Records that a spot of the live grid changed, so that reposPlayers
+ * refreshes the players who can see it.
+ *
+ * Caller provides:
+ *  row, col: the position of the spot that changed
+ *
+ * We do:
+ *  Add the spot to the list of changed spots, unless it is the last one
+ *  added; if the list is full, treat every spot as changed.
+ */
+static void
+markDirty(game_t* game, int row, int col)
+{
+  int last = game->numDirty - 1;
+  if (last >= 0 && game->dirtyRows[last] == row
+      && game->dirtyCols[last] == col) { // check if just recorded
+    return;
+  }
+  if (game->numDirty == MaxDirty) { // check if list is full
+    game->allDirty = true;
+    return;
+  }
+  game->dirtyRows[game->numDirty] = row;
+  game->dirtyCols[game->numDirty] = col;
+  game->numDirty++;
+}
+
+/************ seesChange ***************/
+/* Tells whether a player can see any spot changed since the last update.
+ *
+ * Caller provides:
+ *  player: a player in the game
+ *
+ * We return:
+ *  true if a changed spot is visible from the player's position
+ *  false otherwise
+ *
+ * Note:
+ *  each player's view is updated whenever they move, so the spots visible
+ *  at their last update are the ones visible from where they stand.
+ */
+static bool
+seesChange(game_t* game, player_t* player)
+{
+  if (game->allDirty) { // check if every spot counts as changed
+    return true;
+  }
+  for (int i = 0; i < game->numDirty; i++) { // loops through changes
+    if (grid_viewCanSee(player_getView(player),
+                        game->dirtyRows[i], game->dirtyCols[i])) {
+      return true;
+    }
   }
+  return false;
 }
 
 /************ formatName **************/
@@ -595,18 +2259,18 @@ formatName(const char* name, int length, char* result)
  *  sending to clients later.
  */
 static void
-sendSummaryMsg(void)
+sendSummaryMsg(game_t* game)
 {
   char* msgType = "QUIT GAME OVER:\n";
   int goldDigits = calcDigits(GoldTotal) + 1;
    // +2 for new line and character
-  int maxLength = strlen(msgType) + (gameState.playerCount * (2 + goldDigits + MaxNameLength));
+  int maxLength = strlen(msgType) + (game->playerCount * (2 + goldDigits + MaxNameLength));
   char* summary = calloc(maxLength + 1, sizeof(char));
   sprintf(summary, "%s", msgType);
 
   // appends player stats to running summary string
-  for (int i = 0; i < gameState.playerCount; i++) { // loops through players
-    player_t* player = gameState.players[i];
+  for (int i = 0; i < game->playerCount; i++) { // loops through players
+    player_t* player = game->players[i];
     // +4 for the character and white spaces
     int statLength = goldDigits + strlen(player_getName(player)) + 4;
     char* tempStats = calloc(statLength + 1, sizeof(char));
@@ -617,15 +2281,16 @@ sendSummaryMsg(void)
   }
   
   // send summary to all players
-  for (int i = 0; i < gameState.playerCount; i++) { // loops through players
-    player_t* player = gameState.players[i];
+  for (int i = 0; i < game->playerCount; i++) { // loops through players
+    player_t* player = game->players[i];
     message_send(player_getAddress(player), summary);
   }
 
-  // check if spectator exists
-  if (! message_eqAddr(gameState.spectatorAddr, message_noAddr())) {
-    // send summary to spectator
-    message_send(gameState.spectatorAddr, summary);
+  // send summary to all spectators
+  for (int i = 0; i < MaxSpectators; i++) { // loops through spectators
+    if (game->spectators[i] != NULL) {
+      message_send(player_getAddress(game->spectators[i]), summary);
+    }
   }
   free(summary);
 }
@@ -646,16 +2311,7 @@ sendSummaryMsg(void)
 static void
 sendGoldMsg(addr_t from, int n1, int n2, int n3)
 {
-  // takes number of digits of all numbers to allocate memory
-  int length = strlen("GOLD");
-  int d1 = calcDigits(n1) + 1; // +1 accounts for space
-  int d2 = calcDigits(n2) + 1;
-  int d3 = calcDigits(n3) + 1;
-  length += d1 + d2 + d3 + 1; // +1 accounts for NULL terminator
-  char* result = calloc(length, sizeof(char*));
-  sprintf(result, "%s %d %d %d", "GOLD", n1, n2, n3);
-  message_send(from, result); // send message to client
-  free(result);
+  message_sendf(from, "GOLD %d %d %d", n1, n2, n3); // send message to client
 }
 
 /************ sendGridMsg **************/
@@ -673,15 +2329,7 @@ sendGoldMsg(addr_t from, int n1, int n2, int n3)
 static void
 sendGridMsg(addr_t from, int n1, int n2)
 {
-  // takes number of digits of all numbers to allocate memory
-  int length = strlen("GRID");
-  int d1 = calcDigits(n1) + 1; // +1 accounts for space
-  int d2 = calcDigits(n2) + 1;
-  length += d1 + d2 + 1;
-  char* result = calloc(length, sizeof(char*));
-  sprintf(result, "%s %d %d", "GRID", n1, n2);
-  message_send(from, result); // send message to client
-  free(result);
+  message_sendf(from, "GRID %d %d", n1, n2); // send message to client
 }
 
 /************ sendDisplayMsg **************/
@@ -692,19 +2340,13 @@ sendGridMsg(addr_t from, int n1, int n2)
  *  gridStr: the string version of the grid
  *
  * We do:
- *  Take the grid string and append it onto the message to send to clients.
+ *  Send the grid string behind the DISPLAY header as one message.
  */
 static void
-sendDisplayMsg(addr_t from, char* gridStr)
+sendDisplayMsg(addr_t from, const char* gridStr)
 {
-  // takes a string version of entire grid to allocate memory
-  int length = strlen("DISPLAY\n");
-  int gridLength = strlen(gridStr);
-  length += gridLength + 1;
-  char* result = calloc(length, sizeof(char*));
-  sprintf(result, "%s%s", "DISPLAY\n", gridStr);
-  message_send(from, result); // send message to client
-  free(result);
+  // the grid string goes out behind the header without being copied
+  message_sendParts(from, "DISPLAY\n", gridStr); // send message to client
 }
 
 /************ sendOkMsg **************/
@@ -720,12 +2362,7 @@ sendDisplayMsg(addr_t from, char* gridStr)
 static void
 sendOkMsg(addr_t from, char c)
 {
-  // takes player ID to allocate memory
-  int length = strlen("OK ") + 2; // +2 for char and NULL terminator
-  char* result = calloc(length, sizeof(char*)); 
-  sprintf(result, "%s %c", "OK", c);
-  message_send(from, result); // send message to client
-  free(result);
+  message_sendf(from, "OK %c", c); // send message to client
 }
 
 /************ calcDigits ************/
@@ -752,6 +2389,72 @@ calcDigits(int n)
   return digits;
 }
 
+/************ sendFrame **************/
+/* Sends a grid to a client as a DELTA message if the client asked for them,
+ * and as a DISPLAY message otherwise.
+ *
+ * Caller provides:
+ *  index: the client's index in deltas (see findClient)
+ *  to: the address of the client
+ *  gridStr: a string version of the grid
+ *
+ * We do:
+ *  Time the encoding of a DELTA as serialization, and the handing of the
+ *  message to the message module as sending.
+ */
+static void
+sendFrame(game_t* game, int index, addr_t to, const char* gridStr)
+{
+  uint64_t start = histo_now();
+  const char* message = NULL;
+  if (game->deltas[index] != NULL) { // check if client wants DELTA
+    message = delta_encode(game->deltas[index], gridStr);
+    uint64_t encoded = histo_now();
+    phaseNs[timeSerialize] += encoded - start;
+    start = encoded;
+    if (message == NULL) {
+      return;
+    }
+  }
+  if (message == NULL) { // a DISPLAY; the grid string is already laid out
+    sendDisplayMsg(to, gridStr);
+  } else {
+    message_send(to, message); // send message to client
+  }
+  phaseNs[timeSend] += histo_now() - start;
+}
+
+/************ composeFrame ************/
+/* Composes a player's grid from their view, to send to them.
+ *
+ * Caller provides:
+ *  player: a player in the game
+ *
+ * We do:
+ *  Write the grid into the game's frame buffer, made the first time, since
+ *  the grid's size never changes; time it as serializing.
+ *
+ * We return:
+ *  the player's grid, valid until the next call
+ *  NULL if the buffer cannot be made
+ */
+static const char*
+composeFrame(game_t* game, player_t* player)
+{
+  uint64_t start = histo_now();
+  if (game->playerFrame == NULL) { // check if not yet made
+    game->playerFrame = malloc(strlen(grid_getText(game->staticGrid)) + 1);
+    if (game->playerFrame == NULL) {
+      return NULL;
+    }
+  }
+  const char* gridStr = grid_composeView(game->staticGrid, game->liveGrid,
+                                         player_getView(player),
+                                         game->playerFrame);
+  phaseNs[timeSerialize] += histo_now() - start;
+  return gridStr;
+}
+
 /************ findPlayer ************/
 /* Finds the player based on their player ID.
  *
@@ -759,21 +2462,43 @@ calcDigits(int n)
  *  c: the player ID character
  *
  * We do:
- *  Loops through all players and then returns the player if found.
+ *  IDs are handed out in order from 'A', so the ID gives the player's slot
+ *  in the players array directly.
  *
  * We return:
  *  the player with the given ID
  *  NULL if player not found
  */
 static player_t*
-findPlayer(char c)
+findPlayer(game_t* game, char c)
 {
-  for (int i = 0; i < gameState.playerCount; i++) { // loops through players
-    if (player_getID(gameState.players[i]) == c) { // check if ID found
-      return gameState.players[i]; // return found player
-    }
+  int index = c - 'A';
+  if (index < 0 || index >= game->playerCount) { // check if ID handed out
+    return NULL;
   }
-  return NULL;
+  return game->players[index];
+}
+
+/************ findClient ************/
+/* Finds a client based on their address.
+ *
+ * Caller provides:
+ *  from: the address of the client
+ *
+ * We return:
+ *  the client's index in deltas: their slot in the players array for a
+ *  player, and MaxPlayers plus their slot in the spectators array for a
+ *  spectator
+ *  -1 if no player still playing, or spectator, has that address
+ */
+static int
+findClient(game_t* game, addr_t from)
+{
+  int slot = addrindex_find(game->spectatorIndex, from);
+  if (slot >= 0) { // check spectator
+    return MaxPlayers + slot;
+  }
+  return addrindex_find(game->playerIndex, from); // -1 if not found
 }
 
 /* ***************** str2int ********************** */
@@ -0,0 +1,108 @@
+/*
+ * eventdump - turn a binary event log back into text
+ *
+ * Reads an event log written by the message module (see message_setEventLog
+ * and eventlog.h), and prints each message sent or received exactly as the
+ * message module would have logged it as text:
+ *   message_send: TO 129.170.212.1:12345
+ *   message_send: 1 lines:
+ *   OK A
+ * With -t, each such entry is preceded by the time it was recorded.
+ * Other events (such as the seed in a replay file) are not printed.
+ *
+ * usage: eventdump [-t] eventlog
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "eventlog.h"
+
+/**************** file-local functions ****************/
+static void printEvent(const logevent_t* event, bool showTime);
+static int numLines(const char* string);
+
+/***************** main *******************************/
+int
+main(const int argc, char* argv[])
+{
+  // check arguments
+  const char* program = argv[0];
+  bool showTime = argc == 3 && strcmp(argv[1], "-t") == 0;
+  if (argc != 2 && !showTime) {
+    fprintf(stderr, "usage: %s [-t] eventlog\n", program);
+    return 1; // bad commandline
+  }
+  const char* path = argv[argc - 1];
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "%s: cannot read %s\n", program, path);
+    return 2;
+  }
+  eventreader_t* reader = eventlog_openReader(fp);
+  if (reader == NULL) {
+    fprintf(stderr, "%s: %s is not an event log\n", program, path);
+    fclose(fp);
+    return 3;
+  }
+
+  logevent_t event;
+  while (eventlog_read(reader, &event)) {
+    if (event.kind == EventSend || event.kind == EventRecv) {
+      printEvent(&event, showTime);
+    }
+  }
+  const char* error = eventlog_readError(reader);
+  if (error != NULL) {
+    fprintf(stderr, "%s: %s: %s\n", program, path, error);
+  }
+  eventlog_closeReader(reader);
+  fclose(fp);
+  return error == NULL ? 0 : 4;
+}
+
+/**************** printEvent ****************/
+/* Print one message as message_send or message_loop logs it.
+ */
+static void
+printEvent(const logevent_t* event, bool showTime)
+{
+  const char* who = event->kind == EventSend ? "message_send" : "message_loop";
+  if (showTime) {
+    printf("[%llu.%09llu]\n", (unsigned long long)(event->time / 1000000000),
+           (unsigned long long)(event->time % 1000000000));
+  }
+  printf("%s: %s %s:%05d\n", who, event->kind == EventSend ? "TO" : "FROM",
+         inet_ntoa(event->peer.sin_addr), ntohs(event->peer.sin_port));
+  printf("%s: %d lines:\n", who, numLines(event->text));
+  printf("%s\n", event->text);
+}
+
+/**************** numLines ****************/
+/*
+ * Return number of lines needed to print the string, as message.c counts
+ * them: the newline characters, plus 1 if the string does not end with one;
+ * 0 if the string is empty.
+ */
+static int
+numLines(const char* string)
+{
+  if (*string == '\0') {
+    return 0;
+  }
+  int n = 0;
+  const char* p;
+  for (p = string; *p != '\0'; p++) {
+    if (*p == '\n') {
+      n++;
+    }
+  }
+  if (*(p-1) != '\n') {
+    n++;
+  }
+  return n;
+}
@@ -0,0 +1,633 @@
+/*
+ * eventlog.c - 'eventlog' module
+ *
+ * see eventlog.h for more documentation
+ *
+ * The writer keeps a table from packed address to peer id, and the last
+ * DISPLAY sent to each peer; the reader keeps the same frames, rebuilt from
+ * the events it decodes, so that references and deltas mean the same thing
+ * to both.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#define _POSIX_C_SOURCE 200809L   // for clock_gettime under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include "eventlog.h"
+
+/**************** file-local constants ****************/
+#define MaxText 65507         // message_MaxBytes; longest message recorded
+static const int MinSlots = 64;   // smallest peer table; a power of 2
+static const int RunHead = 4;     // bytes before each run of a delta
+static const int PeerBytes = 6;   // payload of a PEER event
+static const int ValueBytes = 4;  // payload of a SEED, TICK or SIGNAL event
+
+/* the first word of each type of message, indexed by msgtype_t */
+static const char* typeNames[NumTypes] = {
+  "other", "OK", "GRID", "GOLD", "DISPLAY", "DELTA", "QUIT",
+  "ERROR", "JOINED", "PLAY", "SPECTATE", "KEY", "JOIN", "ACK"
+};
+
+/**************** file-local types ****************/
+/* the last DISPLAY sent to a peer */
+typedef struct frame {
+  char* text;       // NULL until the peer is sent one
+  int length;
+  int size;         // bytes allocated for text
+} frame_t;
+
+typedef struct eventlog {
+  FILE* fp;
+  pthread_mutex_t lock;     // held while an event is written
+  uint64_t* keys;           // packed address in each slot of the table
+  int* ids;                 // peer id in each slot; -1 if unused
+  int numSlots;             // a power of 2, at least twice numPeers
+  int numPeers;
+  frame_t* frames;          // indexed by peer id
+  int framesSize;           // entries allocated in frames
+  int lastFramePeer;        // peer sent the latest DISPLAY; -1 if none
+  char delta[MaxText];      // where a delta is built
+} eventlog_t;
+
+typedef struct eventreader {
+  FILE* fp;
+  addr_t* peers;            // indexed by peer id
+  frame_t* frames;          // indexed by peer id
+  int numPeers;
+  int peersSize;            // entries allocated in peers and frames
+  const char* error;        // why the last read failed; NULL if at the end
+  char payload[MaxText];
+  char text[MaxText + 1];   // the decoded message
+} eventreader_t;
+
+/**************** file-local functions ****************/
+static uint64_t now(void);
+static uint64_t packAddr(const addr_t addr);
+static int peerSlot(uint64_t key, int numSlots);
+static int findPeer(eventlog_t* log, const addr_t addr, uint64_t time);
+static bool growPeers(eventlog_t* log);
+static bool growFrames(frame_t** frames, int* size, int needed);
+static bool saveFrame(frame_t* frame, const char* text, int length);
+static int encodeDelta(const frame_t* base, const char* text, int length,
+                       char* out);
+static bool decodeDelta(const frame_t* base, const char* payload,
+                        int length, char* text, int textLength);
+static bool readFail(eventreader_t* reader, const char* error);
+
+/**************** eventlog_new() ****************/
+/* see eventlog.h for description */
+eventlog_t*
+eventlog_new(FILE* fp)
+{
+  if (fp == NULL) {
+    return NULL;
+  }
+  eventlog_t* log = calloc(1, sizeof(eventlog_t));
+  if (log == NULL) {
+    return NULL;
+  }
+  log->fp = fp;
+  log->lastFramePeer = -1;
+  if (!growPeers(log)) {
+    free(log);
+    return NULL;
+  }
+  pthread_mutex_init(&log->lock, NULL);
+
+  eventfile_t header;
+  memcpy(header.magic, eventlog_Magic, sizeof(header.magic));
+  header.version = eventlog_Version;
+  header.byteOrder = eventlog_ByteOrder;
+  fwrite(&header, sizeof(header), 1, fp);
+  return log;
+}
+
+/**************** eventlog_record() ****************/
+/* see eventlog.h for description */
+void
+eventlog_record(eventlog_t* log, int kind, const addr_t peer,
+                const char* message)
+{
+  if (log == NULL || message == NULL) {
+    return;
+  }
+  int length = strlen(message);
+  if (length > MaxText) {
+    return;
+  }
+  eventhead_t head;
+  memset(&head, 0, sizeof(head));
+  head.time = now();
+  head.kind = kind;
+  head.type = eventlog_typeOf(message);
+  head.encoding = EncodeText;
+  head.textLength = length;
+  head.length = length;
+  const char* payload = message;
+
+  pthread_mutex_lock(&log->lock);
+  int id = findPeer(log, peer, head.time);
+  if (id < 0) {
+    pthread_mutex_unlock(&log->lock); // out of memory: the event is lost
+    return;
+  }
+  head.peer = id;
+
+  if (kind == EventSend && head.type == TypeDisplay) {
+    frame_t* own = &log->frames[id];
+    frame_t* latest = log->lastFramePeer < 0 ? NULL
+                                             : &log->frames[log->lastFramePeer];
+    uint32_t source = id;
+    if (own->text != NULL && own->length == length
+        && memcmp(own->text, message, length) == 0) {
+      head.encoding = EncodeRef;    // the same frame as last time
+    } else if (latest != NULL && latest->length == length
+               && memcmp(latest->text, message, length) == 0) {
+      head.encoding = EncodeRef;    // the same frame another peer was sent
+      source = log->lastFramePeer;
+    } else if (own->text != NULL) {
+      int deltaLength = encodeDelta(own, message, length, log->delta);
+      if (deltaLength >= 0) {
+        head.encoding = EncodeDelta;
+        head.length = deltaLength;
+        payload = log->delta;
+      }
+    }
+    if (head.encoding == EncodeRef) {
+      memcpy(log->delta, &source, sizeof(source));
+      head.length = sizeof(source);
+      payload = log->delta;
+    }
+    fwrite(&head, sizeof(head), 1, log->fp);
+    fwrite(payload, 1, head.length, log->fp);
+    if (saveFrame(own, message, length)) {
+      log->lastFramePeer = id;
+    }
+  } else {
+    fwrite(&head, sizeof(head), 1, log->fp);
+    fwrite(payload, 1, head.length, log->fp);
+  }
+  pthread_mutex_unlock(&log->lock);
+}
+
+/**************** eventlog_recordValue() ****************/
+/* see eventlog.h for description */
+void
+eventlog_recordValue(eventlog_t* log, int kind, int value)
+{
+  if (log == NULL) {
+    return;
+  }
+  eventhead_t head;
+  memset(&head, 0, sizeof(head));
+  head.time = now();
+  head.kind = kind;
+  head.length = ValueBytes;
+  int32_t payload = value;
+  pthread_mutex_lock(&log->lock);
+  fwrite(&head, sizeof(head), 1, log->fp);
+  fwrite(&payload, ValueBytes, 1, log->fp);
+  pthread_mutex_unlock(&log->lock);
+}
+
+/**************** eventlog_delete() ****************/
+/* see eventlog.h for description */
+void
+eventlog_delete(eventlog_t* log)
+{
+  if (log != NULL) {
+    fflush(log->fp);
+    for (int i = 0; i < log->numPeers; i++) {
+      free(log->frames[i].text);
+    }
+    free(log->frames);
+    free(log->keys);
+    free(log->ids);
+    pthread_mutex_destroy(&log->lock);
+    free(log);
+  }
+}
+
+/**************** eventlog_openReader() ****************/
+/* see eventlog.h for description */
+eventreader_t*
+eventlog_openReader(FILE* fp)
+{
+  eventfile_t header;
+  if (fp == NULL || fread(&header, sizeof(header), 1, fp) != 1
+      || memcmp(header.magic, eventlog_Magic, sizeof(header.magic)) != 0
+      || header.version != eventlog_Version
+      || header.byteOrder != eventlog_ByteOrder) {
+    return NULL;
+  }
+  eventreader_t* reader = calloc(1, sizeof(eventreader_t));
+  if (reader == NULL) {
+    return NULL;
+  }
+  reader->fp = fp;
+  return reader;
+}
+
+/**************** eventlog_read() ****************/
+/* see eventlog.h for description */
+bool
+eventlog_read(eventreader_t* reader, logevent_t* event)
+{
+  if (reader == NULL || event == NULL) {
+    return false;
+  }
+  while (true) {
+    eventhead_t head;
+    size_t got = fread(&head, 1, sizeof(head), reader->fp);
+    if (got == 0 && feof(reader->fp)) {
+      reader->error = NULL;
+      return false;     // the end of the log
+    }
+    if (got != sizeof(head) || head.length > MaxText
+        || head.textLength > MaxText) {
+      return readFail(reader, "event head cut short or corrupt");
+    }
+    if (fread(reader->payload, 1, head.length, reader->fp) != head.length) {
+      return readFail(reader, "event payload cut short");
+    }
+
+    if (head.kind == EventPeer) {
+      if (head.peer != reader->numPeers || head.length != PeerBytes) {
+        return readFail(reader, "peer event out of order");
+      }
+      if (reader->numPeers == reader->peersSize) {
+        int size = reader->peersSize;
+        addr_t* peers = realloc(reader->peers,
+                                2 * (size + 1) * sizeof(addr_t));
+        if (peers == NULL) {
+          return readFail(reader, "out of memory");
+        }
+        reader->peers = peers;
+        if (!growFrames(&reader->frames, &size, 2 * (size + 1))) {
+          return readFail(reader, "out of memory");
+        }
+        reader->peersSize = size;
+      }
+      addr_t* addr = &reader->peers[reader->numPeers++];
+      memset(addr, 0, sizeof(*addr));
+      addr->sin_family = AF_INET;
+      memcpy(&addr->sin_addr.s_addr, reader->payload, 4);
+      memcpy(&addr->sin_port, reader->payload + 4, 2);
+      continue;
+    }
+
+    if (head.kind >= EventSeed && head.kind <= EventBatch) {
+      if (head.length != ValueBytes) {
+        return readFail(reader, "value event of the wrong length");
+      }
+      int32_t value;
+      memcpy(&value, reader->payload, ValueBytes);
+      memset(event, 0, sizeof(*event));
+      event->time = head.time;
+      event->kind = head.kind;
+      event->type = TypeOther;
+      event->text = reader->text;
+      event->value = value;
+      reader->text[0] = '\0';
+      return true;
+    }
+
+    if ((head.kind != EventSend && head.kind != EventRecv)
+        || head.peer >= reader->numPeers || head.type >= NumTypes) {
+      return readFail(reader, "event of unknown kind, type or peer");
+    }
+    frame_t* own = &reader->frames[head.peer];
+    int length = head.textLength;
+    if (head.encoding == EncodeText && head.length == head.textLength) {
+      memcpy(reader->text, reader->payload, length);
+    } else if (head.encoding == EncodeRef && head.length == sizeof(uint32_t)) {
+      uint32_t source;
+      memcpy(&source, reader->payload, sizeof(source));
+      if (source >= reader->numPeers || reader->frames[source].text == NULL
+          || reader->frames[source].length != length) {
+        return readFail(reader, "reference to an unknown frame");
+      }
+      memcpy(reader->text, reader->frames[source].text, length);
+    } else if (head.encoding == EncodeDelta) {
+      if (own->text == NULL
+          || !decodeDelta(own, reader->payload, head.length,
+                          reader->text, length)) {
+        return readFail(reader, "delta does not fit its frame");
+      }
+    } else {
+      return readFail(reader, "event of unknown encoding");
+    }
+    reader->text[length] = '\0';
+    if (head.kind == EventSend && head.type == TypeDisplay
+        && !saveFrame(own, reader->text, length)) {
+      return readFail(reader, "out of memory");
+    }
+
+    event->time = head.time;
+    event->kind = head.kind;
+    event->type = head.type;
+    event->peer = reader->peers[head.peer];
+    event->text = reader->text;
+    event->textLength = length;
+    event->value = 0;
+    return true;
+  }
+}
+
+/**************** eventlog_readError() ****************/
+/* see eventlog.h for description */
+const char*
+eventlog_readError(eventreader_t* reader)
+{
+  return reader == NULL ? "no reader" : reader->error;
+}
+
+/**************** eventlog_closeReader() ****************/
+/* see eventlog.h for description */
+void
+eventlog_closeReader(eventreader_t* reader)
+{
+  if (reader != NULL) {
+    for (int i = 0; i < reader->numPeers; i++) {
+      free(reader->frames[i].text);
+    }
+    free(reader->frames);
+    free(reader->peers);
+    free(reader);
+  }
+}
+
+/**************** eventlog_typeName() ****************/
+/* see eventlog.h for description */
+const char*
+eventlog_typeName(msgtype_t type)
+{
+  return type < NumTypes ? typeNames[type] : typeNames[TypeOther];
+}
+
+/**************** eventlog_typeOf() ****************/
+/* see eventlog.h for description */
+msgtype_t
+eventlog_typeOf(const char* message)
+{
+  size_t word = strcspn(message, " \n");
+  for (int type = TypeOther + 1; type < NumTypes; type++) {
+    if (strlen(typeNames[type]) == word
+        && strncmp(message, typeNames[type], word) == 0) {
+      return type;
+    }
+  }
+  return TypeOther;
+}
+
+/**************** now() **************** /
+ * returns the time in nanoseconds since the epoch.
+ */
+static uint64_t
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**************** packAddr() **************** /
+ * packs the IP address and port of an address into one key.
+ */
+static uint64_t
+packAddr(const addr_t addr)
+{
+  return ((uint64_t)ntohl(addr.sin_addr.s_addr) << 16) | ntohs(addr.sin_port);
+}
+
+/**************** peerSlot() **************** /
+ * returns the slot of a table of numSlots (a power of 2) where probing for
+ * a key starts: the top bits of the key times 2^64 divided by the golden
+ * ratio.
+ */
+static int
+peerSlot(uint64_t key, int numSlots)
+{
+  return (int)(((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (numSlots - 1));
+}
+
+/**************** findPeer() **************** /
+ * returns the id of a peer, first giving it one and writing its PEER event
+ * if it is new; -1 if out of memory. The caller holds the lock.
+ */
+static int
+findPeer(eventlog_t* log, const addr_t addr, uint64_t time)
+{
+  uint64_t key = packAddr(addr);
+  int mask = log->numSlots - 1;
+  int slot = peerSlot(key, log->numSlots);
+  while (log->ids[slot] >= 0) {
+    if (log->keys[slot] == key) {
+      return log->ids[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  // a new peer: make room for it, and name it in the log
+  if (2 * (log->numPeers + 1) > log->numSlots) {
+    if (!growPeers(log)) {
+      return -1;
+    }
+    return findPeer(log, addr, time);
+  }
+  if (log->numPeers == log->framesSize
+      && !growFrames(&log->frames, &log->framesSize, 2 * log->framesSize)) {
+    return -1;
+  }
+  int id = log->numPeers++;
+  log->keys[slot] = key;
+  log->ids[slot] = id;
+
+  eventhead_t head;
+  memset(&head, 0, sizeof(head));
+  head.time = time;
+  head.peer = id;
+  head.kind = EventPeer;
+  head.length = PeerBytes;
+  fwrite(&head, sizeof(head), 1, log->fp);
+  fwrite(&addr.sin_addr.s_addr, 1, 4, log->fp);
+  fwrite(&addr.sin_port, 1, 2, log->fp);
+  return id;
+}
+
+/**************** growPeers() **************** /
+ * doubles the peer table (or makes the first one), moving every peer to its
+ * slot in the new one; returns false if out of memory, leaving it as it was.
+ */
+static bool
+growPeers(eventlog_t* log)
+{
+  int numSlots = log->numSlots == 0 ? MinSlots : 2 * log->numSlots;
+  uint64_t* keys = malloc(numSlots * sizeof(uint64_t));
+  int* ids = malloc(numSlots * sizeof(int));
+  if (keys == NULL || ids == NULL
+      || (log->frames == NULL
+          && !growFrames(&log->frames, &log->framesSize, MinSlots / 2))) {
+    free(keys);
+    free(ids);
+    return false;
+  }
+  for (int i = 0; i < numSlots; i++) {
+    ids[i] = -1;
+  }
+  for (int i = 0; i < log->numSlots; i++) {
+    if (log->ids[i] >= 0) {
+      int slot = peerSlot(log->keys[i], numSlots);
+      while (ids[slot] >= 0) {
+        slot = (slot + 1) & (numSlots - 1);
+      }
+      keys[slot] = log->keys[i];
+      ids[slot] = log->ids[i];
+    }
+  }
+  free(log->keys);
+  free(log->ids);
+  log->keys = keys;
+  log->ids = ids;
+  log->numSlots = numSlots;
+  return true;
+}
+
+/**************** growFrames() **************** /
+ * grows an array of *size frames to 'needed', the new ones empty; returns
+ * false if out of memory, leaving it as it was.
+ */
+static bool
+growFrames(frame_t** frames, int* size, int needed)
+{
+  frame_t* grown = realloc(*frames, needed * sizeof(frame_t));
+  if (grown == NULL) {
+    return false;
+  }
+  memset(grown + *size, 0, (needed - *size) * sizeof(frame_t));
+  *frames = grown;
+  *size = needed;
+  return true;
+}
+
+/**************** saveFrame() **************** /
+ * copies text into a peer's frame; returns false if out of memory, leaving
+ * the peer without a frame.
+ */
+static bool
+saveFrame(frame_t* frame, const char* text, int length)
+{
+  if (frame->size < length + 1) {
+    char* grown = realloc(frame->text, length + 1);
+    if (grown == NULL) {
+      free(frame->text);
+      frame->text = NULL;
+      frame->size = 0;
+      return false;
+    }
+    frame->text = grown;
+    frame->size = length + 1;
+  }
+  memcpy(frame->text, text, length);
+  frame->length = length;
+  return true;
+}
+
+/**************** encodeDelta() **************** /
+ * writes text as a delta against a peer's last frame into out; returns the
+ * length of the delta, or -1 if it would not be smaller than the text.
+ * Runs of fewer than RunHead equal bytes are sent as new bytes, since a run
+ * head would cost more.
+ */
+static int
+encodeDelta(const frame_t* base, const char* text, int length, char* out)
+{
+  int used = 0;
+  int pos = 0;
+  while (pos < length) {
+    // bytes the frame already has
+    int start = pos;
+    while (pos < length && pos < base->length && text[pos] == base->text[pos]) {
+      pos++;
+    }
+    if (pos == length) {
+      break;            // the rest is kept
+    }
+    uint16_t keep = pos - start;
+
+    // new bytes, up to the next run worth keeping
+    int first = pos;
+    while (pos < length) {
+      int same = 0;
+      while (pos + same < length && pos + same < base->length
+             && text[pos + same] == base->text[pos + same] && same < RunHead) {
+        same++;
+      }
+      if (same == RunHead || pos + same == length) {
+        break;
+      }
+      pos += same + 1;  // the equal bytes, and the one that differs
+    }
+    uint16_t count = pos - first;
+    if (used + RunHead + count >= length) {
+      return -1;
+    }
+    memcpy(out + used, &keep, 2);
+    memcpy(out + used + 2, &count, 2);
+    memcpy(out + used + RunHead, text + first, count);
+    used += RunHead + count;
+  }
+  return used < length ? used : -1;
+}
+
+/**************** decodeDelta() **************** /
+ * rebuilds textLength bytes of text from a delta against a peer's last
+ * frame; returns false if the delta does not fit the frame.
+ */
+static bool
+decodeDelta(const frame_t* base, const char* payload, int length,
+            char* text, int textLength)
+{
+  int pos = 0;
+  int used = 0;
+  while (used < length) {
+    uint16_t keep, count;
+    if (used + RunHead > length) {
+      return false;
+    }
+    memcpy(&keep, payload + used, 2);
+    memcpy(&count, payload + used + 2, 2);
+    used += RunHead;
+    if (pos + keep > base->length || pos + keep + count > textLength
+        || used + count > length) {
+      return false;
+    }
+    memcpy(text + pos, base->text + pos, keep);
+    pos += keep;
+    memcpy(text + pos, payload + used, count);
+    pos += count;
+    used += count;
+  }
+  if (pos < textLength && textLength > base->length) {
+    return false;       // kept bytes beyond the end of the frame
+  }
+  memcpy(text + pos, base->text + pos, textLength - pos);
+  return true;
+}
+
+/**************** readFail() **************** /
+ * notes why a read failed, and returns false.
+ */
+static bool
+readFail(eventreader_t* reader, const char* error)
+{
+  reader->error = error;
+  return false;
+}
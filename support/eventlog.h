@@ -0,0 +1,190 @@
+/*
+ * eventlog - a compact binary record of the messages a program sends and
+ * receives, as an alternative to logging them as text.
+ *
+ * The file starts with a header (eventfile_t), followed by a sequence of
+ * events. Each event is a fixed-size eventhead_t followed by 'length' bytes
+ * of payload. Numbers are in the byte order of the machine that wrote the
+ * file; the header lets a reader check it.
+ *
+ * Peers are not named in every event: the first event involving an address
+ * is a PEER event giving it an id (its payload is the 4-byte IP address and
+ * the 2-byte port, in network byte order), and later events carry the id.
+ *
+ * The payload of a SEND or RECV event is the message text, without its null
+ * character, unless the message is a DISPLAY sent to a peer that was sent a
+ * DISPLAY before. Such a frame is stored as either
+ *   a reference (EncodeRef): the payload is the 4-byte id of a peer whose
+ *     last DISPLAY is the same text, often the peer itself; or
+ *   a delta (EncodeDelta): the payload is a sequence of runs against that
+ *     peer's last DISPLAY, each a 2-byte count of bytes to keep, a 2-byte
+ *     count of new bytes, and the new bytes. Bytes after the last run are
+ *     kept, up to 'textLength'.
+ * whichever is smaller than the text itself.
+ *
+ * Besides messages, a log may hold SEED, TICK and SIGNAL events, which a
+ * program records so that its input can be replayed exactly (see the
+ * server's --record and --replay); their payload is one 4-byte value.
+ *
+ * See eventdump.c for a program that turns such a file back into the text
+ * that message.c would have logged.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#ifndef _EVENTLOG_H_
+#define _EVENTLOG_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "message.h"
+
+/**************** global constants ****************/
+#define eventlog_Magic "NUGEVLOG"     // first 8 bytes of every file
+static const uint32_t eventlog_Version = 1;
+static const uint32_t eventlog_ByteOrder = 0x01020304;
+
+/* kinds of event */
+enum { EventPeer = 1, EventSend = 2, EventRecv = 3,
+       EventSeed = 4, EventTick = 5, EventSignal = 6,
+       EventGames = 7, EventVis = 8, EventTickHz = 9, EventBatch = 10 };
+
+/* how a SEND or RECV payload is encoded */
+enum { EncodeText = 0, EncodeRef = 1, EncodeDelta = 2 };
+
+/* message types, from the first word of the message */
+typedef enum {
+  TypeOther, TypeOk, TypeGrid, TypeGold, TypeDisplay, TypeDelta, TypeQuit,
+  TypeError, TypeJoined, TypePlay, TypeSpectate, TypeKey, TypeJoin, TypeAck,
+  NumTypes
+} msgtype_t;
+
+/**************** global types ****************/
+/* the file header */
+typedef struct eventfile {
+  char magic[8];          // eventlog_Magic, without its null character
+  uint32_t version;       // eventlog_Version
+  uint32_t byteOrder;     // eventlog_ByteOrder, as the writer stored it
+} eventfile_t;
+
+/* the fixed-size head of every event; 24 bytes */
+typedef struct eventhead {
+  uint64_t time;          // nanoseconds since the epoch
+  uint32_t peer;          // id of the peer the message went to or came
+                          // from; 0 for events that are not messages
+  uint32_t length;        // bytes of payload following the head
+  uint32_t textLength;    // bytes of message text, once decoded
+  uint8_t kind;           // EventPeer, EventSend, ...
+  uint8_t type;           // an msgtype_t
+  uint8_t encoding;       // EncodeText, EncodeRef or EncodeDelta
+  uint8_t unused;         // zero
+} eventhead_t;
+
+/* one event, as returned by eventlog_read */
+typedef struct logevent {
+  uint64_t time;
+  int kind;               // any kind but EventPeer
+  msgtype_t type;
+  addr_t peer;            // where the message went or came from
+  const char* text;       // the message ("" if none); valid until next read
+  int textLength;
+  int value;              // the seed, signal number, ...; 0 for messages
+} logevent_t;
+
+typedef struct eventlog eventlog_t;         // a writer; opaque
+typedef struct eventreader eventreader_t;   // a reader; opaque
+
+/**************** functions ****************/
+
+/**************** eventlog_new ****************/
+/* Start an event log.
+ *
+ * Caller provides:
+ *   a file open for writing (in binary mode, where that matters).
+ * We return:
+ *   pointer to a new eventlog_t; NULL if fp is NULL, or on error.
+ * We do:
+ *   write the file header.
+ * Caller is responsible for:
+ *   later calling eventlog_delete, and then closing the file.
+ */
+eventlog_t* eventlog_new(FILE* fp);
+
+/**************** eventlog_record ****************/
+/* Record a message sent to, or received from, a peer.
+ *
+ * Caller provides:
+ *   valid pointer to an eventlog_t,
+ *   EventSend or EventRecv,
+ *   the peer's address and the message.
+ * We do:
+ *   write a PEER event first if the address is new, then the message, as a
+ *   reference or delta if it is a DISPLAY and that is smaller. Threads may
+ *   record at once; their events are written one at a time.
+ *   The file is not flushed; eventlog_delete does that.
+ */
+void eventlog_record(eventlog_t* log, int kind, const addr_t peer,
+                     const char* message);
+
+/**************** eventlog_recordValue ****************/
+/* Record an event that is not a message: the seed of a run (EventSeed), a
+ * clock tick (EventTick), or a signal (EventSignal), with a value such as
+ * the seed or the signal number; or one of the options a run was started
+ * with (EventGames, EventVis, EventTickHz, EventBatch), with its value.
+ */
+void eventlog_recordValue(eventlog_t* log, int kind, int value);
+
+/**************** eventlog_delete ****************/
+/* Flush the file and free the writer; NULL is ignored. The file stays open.
+ */
+void eventlog_delete(eventlog_t* log);
+
+/**************** eventlog_openReader ****************/
+/* Start reading an event log.
+ *
+ * Caller provides:
+ *   a file open for reading, positioned at the start of an event log.
+ * We return:
+ *   pointer to a new eventreader_t; NULL if the file does not start with
+ *   a header this version can read, or on error.
+ * Caller is responsible for:
+ *   later calling eventlog_closeReader, and then closing the file.
+ */
+eventreader_t* eventlog_openReader(FILE* fp);
+
+/**************** eventlog_read ****************/
+/* Read the next event, other than a PEER event, from an event log.
+ *
+ * We return:
+ *   true, having filled in *event, if there was one;
+ *   false at the end of the file, or if the file is cut short or corrupt
+ *   (see eventlog_readError).
+ * We do:
+ *   take in any PEER events on the way, and decode references and deltas.
+ */
+bool eventlog_read(eventreader_t* reader, logevent_t* event);
+
+/**************** eventlog_readError ****************/
+/* Return a description of why eventlog_read returned false, or NULL if it
+ * simply reached the end of the file.
+ */
+const char* eventlog_readError(eventreader_t* reader);
+
+/**************** eventlog_closeReader ****************/
+/* Free the reader; NULL is ignored. The file stays open.
+ */
+void eventlog_closeReader(eventreader_t* reader);
+
+/**************** eventlog_typeOf ****************/
+/* Return the type of a message, from its first word; TypeOther if the word
+ * is not one the protocol uses.
+ */
+msgtype_t eventlog_typeOf(const char* message);
+
+/**************** eventlog_typeName ****************/
+/* Return the first word of messages of a type ("DISPLAY", ...), or "other".
+ */
+const char* eventlog_typeName(msgtype_t type);
+
+#endif // _EVENTLOG_H_
@@ -0,0 +1,422 @@
+/*
+ * loadgen - a headless load generator for the nuggets server
+ *
+ * Simulates many clients from one process, each with its own UDP socket
+ * (and so its own address, as far as the server can tell). Each client
+ * joins as a player, or as a spectator, and then sends KEY messages at a
+ * steady rate: random moves, or a scripted pattern of keys. A player sends
+ * its next key only once the last one is answered by a DISPLAY (or DELTA),
+ * or has gone unanswered too long.
+ *
+ * At the end it reports throughput, and the round-trip latency from each
+ * KEY to the first DISPLAY that follows it, as percentiles. That DISPLAY is
+ * usually the one the key triggered, but may be one another player's move
+ * triggered first; keys that hit a wall trigger none, and are counted as
+ * unanswered.
+ *
+ * usage: loadgen hostname port [--clients n] [--spectators n] [--rate n]
+ *                [--seconds n] [--keys pattern] [--timeout ms] [--seed n]
+ *
+ * A join that goes unanswered is sent again. A server routes 27 players and
+ * 16 spectators to each game; run it with enough --games for the number of
+ * clients, or the rest are refused.
+ *
+ * Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
+ */
+
+#define _POSIX_C_SOURCE 200809L   // for clock_gettime under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "message.h"
+
+/**************** file-local constants ****************/
+static const int MaxClients = 1000;     // fewer than message_watch can hold
+static const char* RandomKeys = "hjklyubn";
+
+/**************** file-local types ****************/
+typedef struct client {
+  int fd;                 // the client's own socket
+  bool spectator;
+  bool playing;           // told OK (or, for a spectator, sent a GRID)
+  bool done;              // told QUIT: refused, or the game is over
+  int64_t joinSent;       // when PLAY or SPECTATE was last sent
+  int64_t keySent;        // when the unanswered key was sent; 0 if none
+  uint32_t random;        // state of the client's random keys
+  int next;               // position in the key pattern
+} client_t;
+
+static struct {
+  addr_t server;
+  client_t* clients;
+  int numClients;
+  int numSpectators;
+  client_t** clientAt;    // client owning each file descriptor, or NULL
+  int maxFd;
+  int rate;               // keys a second per player
+  int seconds;            // length of the run
+  const char* keys;       // pattern of keys; NULL if random
+  int64_t timeout;        // how long a key may go unanswered, in ns
+  int64_t start;          // when the first keys went out
+  int64_t end;            // when the run stops
+
+  long joinsResent;       // joins sent again, having gone unanswered
+  long keysSent;
+  long unanswered;
+  long received;          // messages received, of any kind
+  long receivedBytes;
+  long displays;          // DISPLAY and DELTA messages received
+  int numPlaying;
+  int numRefused;
+  int numDone;
+  int64_t* latencies;     // ns from each answered key to its DISPLAY
+  long numLatencies;
+  long latenciesSize;
+} gen;
+
+/**************** file-local functions ****************/
+static bool parseArgs(const int argc, char* argv[]);
+static bool startClients(void);
+static bool handleTick(void* arg);
+static bool handleClient(void* arg, int fd);
+static void sendJoin(client_t* client, int index);
+static void sendTo(client_t* client, const char* message);
+static char nextKey(client_t* client);
+static void addLatency(int64_t latency);
+static void report(void);
+static int compareLatencies(const void* a, const void* b);
+static int64_t now(void);
+
+/***************** main *******************************/
+int
+main(const int argc, char* argv[])
+{
+  // initialize the message module (without logging)
+  if (message_init(NULL) == 0) {
+    return 2; // failure to initialize message module
+  }
+  if (!parseArgs(argc, argv)) {
+    fprintf(stderr, "usage: %s hostname port [--clients n] [--spectators n]"
+            " [--rate n]\n       [--seconds n] [--keys pattern]"
+            " [--timeout ms] [--seed n]\n", argv[0]);
+    return 3; // bad commandline
+  }
+  if (!startClients()) {
+    fprintf(stderr, "%s: cannot start %d clients\n", argv[0], gen.numClients);
+    return 4;
+  }
+
+  // each tick, every player that is not waiting for a reply sends a key
+  gen.start = now();
+  gen.end = gen.start + (int64_t)gen.seconds * 1000000000;
+  message_watchTimer(1.0 / gen.rate, handleTick);
+  bool ok = message_loopEpoll(NULL, 0, NULL, NULL, NULL);
+  int64_t stop = now();
+
+  // let the server free the players' spots
+  for (int i = 0; i < gen.numClients; i++) {
+    if (gen.clients[i].playing && !gen.clients[i].done) {
+      sendTo(&gen.clients[i], "KEY Q");
+    }
+  }
+  gen.end = stop;
+  report();
+
+  message_done();
+  for (int i = 0; i < gen.numClients; i++) {
+    close(gen.clients[i].fd);
+  }
+  free(gen.clients);
+  free(gen.clientAt);
+  free(gen.latencies);
+  return ok ? 0 : 1;
+}
+
+/**************** parseArgs ****************/
+/* Read the server's address and the options; return false if any is bad.
+ */
+static bool
+parseArgs(const int argc, char* argv[])
+{
+  if (argc < 3 || !message_setAddr(argv[1], argv[2], &gen.server)) {
+    return false;
+  }
+  gen.numClients = 100;
+  gen.rate = 10;
+  gen.seconds = 10;
+  int timeoutMs = 250;
+  unsigned seed = 1;
+  for (int i = 3; i < argc; i += 2) {
+    if (i + 1 == argc) {
+      return false; // an option without its value
+    }
+    const char* option = argv[i];
+    const char* value = argv[i + 1];
+    int number = atoi(value);
+    if (strcmp(option, "--clients") == 0) {
+      gen.numClients = number;
+    } else if (strcmp(option, "--spectators") == 0) {
+      gen.numSpectators = number;
+    } else if (strcmp(option, "--rate") == 0) {
+      gen.rate = number;
+    } else if (strcmp(option, "--seconds") == 0) {
+      gen.seconds = number;
+    } else if (strcmp(option, "--keys") == 0) {
+      gen.keys = value;
+    } else if (strcmp(option, "--timeout") == 0) {
+      timeoutMs = number;
+    } else if (strcmp(option, "--seed") == 0) {
+      seed = number;
+    } else {
+      return false;
+    }
+  }
+  gen.timeout = (int64_t)timeoutMs * 1000000;
+  srand(seed);
+  return gen.numClients > 0 && gen.numClients <= MaxClients
+         && gen.numSpectators >= 0 && gen.numSpectators <= gen.numClients
+         && gen.rate > 0 && gen.rate <= 1000 && gen.seconds > 0
+         && timeoutMs > 0 && (gen.keys == NULL || gen.keys[0] != '\0');
+}
+
+/**************** startClients ****************/
+/* Open a socket for each client, watch it, and join the game: the first
+ * numSpectators clients as spectators, the rest as players.
+ * Return false on error.
+ */
+static bool
+startClients(void)
+{
+  gen.clients = calloc(gen.numClients, sizeof(client_t));
+  if (gen.clients == NULL) {
+    return false;
+  }
+  for (int i = 0; i < gen.numClients; i++) {
+    client_t* client = &gen.clients[i];
+    client->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (client->fd < 0) {
+      return false;
+    }
+    client->spectator = i < gen.numSpectators;
+    client->random = rand() | 1;  // xorshift state must not be 0
+    client->next = i;             // so that scripted clients differ
+    if (client->fd > gen.maxFd) {
+      gen.maxFd = client->fd;
+    }
+  }
+  gen.clientAt = calloc(gen.maxFd + 1, sizeof(client_t*));
+  if (gen.clientAt == NULL) {
+    return false;
+  }
+  for (int i = 0; i < gen.numClients; i++) {
+    client_t* client = &gen.clients[i];
+    gen.clientAt[client->fd] = client;
+    if (!message_watch(client->fd, handleClient)) {
+      return false;
+    }
+    sendJoin(client, i);
+  }
+  return true;
+}
+
+/**************** handleTick ****************/
+/* Send a key from every player that is not waiting for an answer, giving
+ * up on answers that are overdue. Return true once the run is over.
+ */
+static bool
+handleTick(void* arg)
+{
+  int64_t time = now();
+  if (time >= gen.end) {
+    return true;
+  }
+  for (int i = 0; i < gen.numClients; i++) {
+    client_t* client = &gen.clients[i];
+    if (!client->playing && !client->done
+        && time - client->joinSent >= gen.timeout) {
+      sendJoin(client, i); // the join or its answer was lost
+      gen.joinsResent++;
+    }
+    if (client->spectator || !client->playing || client->done) {
+      continue;
+    }
+    if (client->keySent != 0) {
+      if (time - client->keySent < gen.timeout) {
+        continue; // still waiting
+      }
+      gen.unanswered++;
+    }
+    char key[8];
+    sprintf(key, "KEY %c", nextKey(client));
+    sendTo(client, key);
+    client->keySent = time;
+    gen.keysSent++;
+  }
+  return false;
+}
+
+/**************** handleClient ****************/
+/* A client's socket is ready: take every waiting message from it.
+ * Return true once every client has been told QUIT.
+ */
+static bool
+handleClient(void* arg, int fd)
+{
+  client_t* client = gen.clientAt[fd];
+  char buf[message_MaxBytes];
+  int nbytes;
+  while ((nbytes = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT)) >= 0) {
+    buf[nbytes] = '\0';
+    gen.received++;
+    gen.receivedBytes += nbytes;
+    if (strncmp(buf, "DISPLAY", strlen("DISPLAY")) == 0
+        || strncmp(buf, "DELTA", strlen("DELTA")) == 0) {
+      gen.displays++;
+      if (client->keySent != 0) {
+        addLatency(now() - client->keySent);
+        client->keySent = 0;
+      }
+    } else if (strncmp(buf, "OK", strlen("OK")) == 0
+               || (client->spectator && !client->playing
+                   && strncmp(buf, "GRID", strlen("GRID")) == 0)) {
+      if (!client->playing) {
+        client->playing = true;
+        gen.numPlaying++;
+      }
+    } else if (strncmp(buf, "QUIT", strlen("QUIT")) == 0 && !client->done) {
+      client->done = true;
+      gen.numDone++;
+      if (!client->playing) {
+        gen.numRefused++;
+      }
+    }
+  }
+  return gen.numDone == gen.numClients;
+}
+
+/**************** sendJoin ****************/
+/* Ask to join as a spectator or as player "lg<index>".
+ */
+static void
+sendJoin(client_t* client, int index)
+{
+  char join[32];
+  if (client->spectator) {
+    strcpy(join, "SPECTATE");
+  } else {
+    sprintf(join, "PLAY lg%d", index);
+  }
+  sendTo(client, join);
+  client->joinSent = now();
+}
+
+/**************** sendTo ****************/
+/* Send a message to the server from a client's socket.
+ */
+static void
+sendTo(client_t* client, const char* message)
+{
+  if (sendto(client->fd, message, strlen(message), 0,
+             (struct sockaddr*) &gen.server, sizeof(gen.server)) < 0) {
+    perror("loadgen: sendto");
+  }
+}
+
+/**************** nextKey ****************/
+/* Return the client's next key: the next in the pattern, if there is one,
+ * or else a random move (xorshift, so each client has its own sequence).
+ */
+static char
+nextKey(client_t* client)
+{
+  if (gen.keys != NULL) {
+    char key = gen.keys[client->next % strlen(gen.keys)];
+    client->next++;
+    return key;
+  }
+  uint32_t x = client->random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  client->random = x;
+  return RandomKeys[x % strlen(RandomKeys)];
+}
+
+/**************** addLatency ****************/
+/* Keep one KEY to DISPLAY latency.
+ */
+static void
+addLatency(int64_t latency)
+{
+  if (gen.numLatencies == gen.latenciesSize) {
+    long size = gen.latenciesSize == 0 ? 4096 : 2 * gen.latenciesSize;
+    int64_t* grown = realloc(gen.latencies, size * sizeof(int64_t));
+    if (grown == NULL) {
+      return; // out of memory: the sample is lost
+    }
+    gen.latencies = grown;
+    gen.latenciesSize = size;
+  }
+  gen.latencies[gen.numLatencies++] = latency;
+}
+
+/**************** report ****************/
+/* Print the clients, throughput and latency percentiles to stdout.
+ */
+static void
+report(void)
+{
+  double seconds = (gen.end - gen.start) / 1e9;
+  printf("clients: %d (%d spectators), %d joined, %d refused, %d quit; "
+         "%ld joins resent\n", gen.numClients, gen.numSpectators,
+         gen.numPlaying, gen.numRefused, gen.numDone - gen.numRefused,
+         gen.joinsResent);
+  printf("run: %.2f seconds\n", seconds);
+  printf("keys sent: %ld (%.0f a second), %ld unanswered\n",
+         gen.keysSent, gen.keysSent / seconds, gen.unanswered);
+  printf("received: %ld messages (%.0f a second), %ld displays, %.2f MB\n",
+         gen.received, gen.received / seconds, gen.displays,
+         gen.receivedBytes / 1e6);
+  if (gen.numLatencies == 0) {
+    printf("KEY to DISPLAY latency: no samples\n");
+    return;
+  }
+  qsort(gen.latencies, gen.numLatencies, sizeof(int64_t), compareLatencies);
+  const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  printf("KEY to DISPLAY latency (ms) over %ld samples: min %.3f",
+         gen.numLatencies, gen.latencies[0] / 1e6);
+  for (int i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+    long rank = (long)(percentiles[i] * (gen.numLatencies - 1));
+    printf(", p%g %.3f", percentiles[i] * 100, gen.latencies[rank] / 1e6);
+  }
+  printf(", max %.3f\n", gen.latencies[gen.numLatencies - 1] / 1e6);
+}
+
+/**************** compareLatencies ****************/
+/* qsort comparison of two latencies.
+ */
+static int
+compareLatencies(const void* a, const void* b)
+{
+  int64_t x = *(const int64_t*)a;
+  int64_t y = *(const int64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/**************** now ****************/
+/* Return a monotonic time in nanoseconds.
+ */
+static int64_t
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -1,15 +1,62 @@
 /* 
  * log module - a simple way to log messages to a file
  * 
+ * The asynchronous backend keeps entries in a ring of bytes. Each entry is
+ * an 8-byte header holding its length (0 until the entry is complete),
+ * then its text, padded to a multiple of 8 bytes. An entry never wraps
+ * around the end of the ring: one that would is preceded by a skip entry
+ * filling the rest of the ring, so each text is contiguous. A producer
+ * claims room by advancing 'reserved' with compare-and-swap, formats its
+ * text straight into that room, then publishes the length; the writer
+ * thread writes complete entries in order, zeroes them, and advances
+ * 'released' to give the room back. Neither side ever takes a lock or
+ * allocates, and a producer that finds no room drops its entry.
+ *
  * David Kotz, May 2019
+ * Asynchronous backend: Grace Wang, Neha Ramsurrun, Ryan Yong, May 2021
  */
 
+#define _POSIX_C_SOURCE 200809L  // for nanosleep under -std=c11
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/errno.h>
 #include "log.h"
 
+/**************** file-local constants ****************/
+static const size_t MinAsyncBytes = 4096;   // smallest ring
+static const size_t HeaderBytes = 8;        // length word, padded
+static const long IdleNanos = 2000000;      // writer's nap when ring empty
+static const uint32_t SkipEntry = 0x80000000u; // header flag: room to skip
+
+/**************** file-local global variables ****************/
+/* the asynchronous backend; fp is NULL unless log_asyncStart was called */
+static struct {
+  FILE* fp;                     // file whose entries go through the ring
+  unsigned char* ring;          // size bytes, a power of 2
+  size_t size;
+  _Atomic size_t reserved;      // bytes ever claimed by producers
+  _Atomic size_t released;      // bytes ever given back by the writer
+  _Atomic bool stop;            // true once the writer should finish
+  _Atomic unsigned long written;      // entries written to the file
+  _Atomic unsigned long dropped;      // entries dropped for want of room
+  _Atomic unsigned long droppedBytes; // their text, in bytes
+  pthread_t writer;
+} async;
+
+/**************** file-local functions ****************/
+static void flog_put(FILE* fp, const char* format, ...);
+static char* flog_reserve(size_t length, size_t* pos);
+static void flog_publish(size_t pos, size_t length);
+static void* flog_writer(void* arg);
+static size_t flog_drain(void);
+
 /**************** flog_init ****************/
 /* Initialize the logging module.
  */
@@ -27,9 +74,7 @@ void
 flog_s(FILE* fp, const char* format, const char* str)
 {
   if (fp != NULL && format != NULL && str != NULL) {
-    fprintf(fp, format, str);
-    fputc('\n', fp);
-    fflush(fp);
+    flog_put(fp, format, str);
   }
 }
 
@@ -42,9 +87,7 @@ void
 flog_d(FILE* fp, const char* format, const int num)
 {
   if (fp != NULL && format != NULL) {
-    fprintf(fp, format, num);
-    fputc('\n', fp);
-    fflush(fp);
+    flog_put(fp, format, num);
   }
 }
 
@@ -57,9 +100,7 @@ void
 flog_c(FILE* fp, const char* format, const char ch)
 {
   if (fp != NULL && format != NULL) {
-    fprintf(fp, format, ch);
-    fputc('\n', fp);
-    fflush(fp);
+    flog_put(fp, format, ch);
   }
 }
 
@@ -71,9 +112,7 @@ void
 flog_v(FILE* fp, const char* str)
 {
   if (fp != NULL && str != NULL) {
-    fputs(str, fp);
-    fputc('\n', fp);
-    fflush(fp);
+    flog_put(fp, "%s", str);
   }
 }
 
@@ -87,8 +126,7 @@ void
 flog_e(FILE* fp, const char* str)
 {
   if (fp != NULL && str != NULL) {
-    fprintf(fp, "%s: %s\n", str, strerror(errno));
-    fflush(fp);
+    flog_put(fp, "%s: %s", str, strerror(errno));
   }
 }
 
@@ -101,3 +139,228 @@ flog_done(FILE* fp)
 {
   flog_v(fp, "END OF LOG");
 }
+
+/**************** log_asyncStart ****************/
+/* see log.h for description */
+bool
+log_asyncStart(FILE* fp, size_t bufferSize)
+{
+  if (fp == NULL || async.fp != NULL) {
+    return false;
+  }
+  size_t size = MinAsyncBytes;
+  while (size < bufferSize) {
+    size *= 2;
+  }
+  async.ring = calloc(size, 1);
+  if (async.ring == NULL) {
+    return false;
+  }
+  async.size = size;
+  atomic_init(&async.reserved, 0);
+  atomic_init(&async.released, 0);
+  atomic_init(&async.stop, false);
+  atomic_init(&async.written, 0);
+  atomic_init(&async.dropped, 0);
+  atomic_init(&async.droppedBytes, 0);
+  async.fp = fp;
+  if (pthread_create(&async.writer, NULL, flog_writer, NULL) != 0) {
+    async.fp = NULL;
+    free(async.ring);
+    async.ring = NULL;
+    return false;
+  }
+  return true;
+}
+
+/**************** log_asyncStop ****************/
+/* see log.h for description */
+void
+log_asyncStop(void)
+{
+  if (async.fp == NULL) {
+    return;
+  }
+  atomic_store(&async.stop, true);
+  pthread_join(async.writer, NULL);
+
+  FILE* fp = async.fp;
+  async.fp = NULL;            // from here on, entries are written directly
+  fprintf(fp, "LOG: async buffer of %zu bytes wrote %lu entries, "
+          "dropped %lu entries (%lu bytes)\n", async.size,
+          atomic_load(&async.written), atomic_load(&async.dropped),
+          atomic_load(&async.droppedBytes));
+  fflush(fp);
+  free(async.ring);
+  async.ring = NULL;
+}
+
+/**************** log_asyncDropped ****************/
+/* see log.h for description */
+unsigned long
+log_asyncDropped(void)
+{
+  return atomic_load(&async.dropped);
+}
+
+/**************** flog_put ****************/
+/* 
+ * formats one entry and adds a newline; writes it to fp right away, or
+ * formats it straight into the ring if fp is the asynchronous backend's
+ * file. Entries that fit the stack buffer are formatted once and copied;
+ * longer ones, such as whole grids, are measured there and then formatted
+ * again into their room in the ring.
+ */
+static void
+flog_put(FILE* fp, const char* format, ...)
+{
+  va_list args;
+  if (fp != async.fp) {
+    va_start(args, format);
+    vfprintf(fp, format, args);
+    va_end(args);
+    fputc('\n', fp);
+    fflush(fp);
+    return;
+  }
+
+  char small[512];            // most entries fit; whole grids do not
+  va_start(args, format);
+  int length = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (length < 0) {
+    return;
+  }
+  size_t pos;
+  char* text = flog_reserve(length + 1, &pos);
+  if (text == NULL) {
+    return;                   // dropped
+  }
+  if ((size_t)length < sizeof(small)) {
+    memcpy(text, small, length);
+  } else {
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args); // its null takes the newline's place
+    va_end(args);
+  }
+  text[length] = '\n';
+  flog_publish(pos, length + 1);
+}
+
+/**************** flog_reserve ****************/
+/* 
+ * claims contiguous room in the ring for an entry of length bytes, and
+ * returns where its text goes, with the entry's position in *pos; or
+ * counts the entry as dropped and returns NULL if the ring has no room.
+ * Never waits.
+ */
+static char*
+flog_reserve(size_t length, size_t* pos)
+{
+  size_t need = HeaderBytes + ((length + 7) & ~(size_t)7);
+  size_t start = atomic_load_explicit(&async.reserved, memory_order_relaxed);
+  size_t skip;                // rest of the ring skipped so as not to wrap
+  do {
+    size_t offset = start & (async.size - 1);
+    skip = offset + need > async.size ? async.size - offset : 0;
+    size_t used = start - atomic_load_explicit(&async.released,
+                                               memory_order_acquire);
+    if (skip + need > async.size - used) {
+      atomic_fetch_add_explicit(&async.dropped, 1, memory_order_relaxed);
+      atomic_fetch_add_explicit(&async.droppedBytes, length,
+                                memory_order_relaxed);
+      return NULL;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(&async.reserved, &start,
+                                                  start + skip + need,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed));
+
+  // the room [start, start + skip + need) is ours
+  if (skip > 0) {
+    _Atomic uint32_t* header = (_Atomic uint32_t*)&async.ring[start & (async.size - 1)];
+    atomic_store_explicit(header, SkipEntry | (uint32_t)skip,
+                          memory_order_release);
+  }
+  *pos = start + skip;
+  return (char*)&async.ring[(*pos & (async.size - 1)) + HeaderBytes];
+}
+
+/**************** flog_publish ****************/
+/* 
+ * marks the entry at pos, whose text of length bytes is now in place, as
+ * complete, for the writer to take.
+ */
+static void
+flog_publish(size_t pos, size_t length)
+{
+  _Atomic uint32_t* header = (_Atomic uint32_t*)&async.ring[pos & (async.size - 1)];
+  atomic_store_explicit(header, (uint32_t)length, memory_order_release);
+}
+
+/**************** flog_writer ****************/
+/* 
+ * the writer thread: writes complete entries in batches, reports drops as
+ * they happen, and naps while the ring is empty; finishes once asked to
+ * stop and the ring is empty.
+ */
+static void*
+flog_writer(void* arg)
+{
+  unsigned long reported = 0;   // drops already reported
+  for (;;) {
+    bool stopping = atomic_load(&async.stop);
+    size_t count = flog_drain();
+    unsigned long dropped = atomic_load(&async.dropped);
+    if (dropped != reported) {
+      fprintf(async.fp, "LOG: dropped %lu entries so far; the async buffer "
+              "was full\n", dropped);
+      reported = dropped;
+      count++;
+    }
+    if (count > 0) {
+      fflush(async.fp);         // one flush per batch
+    } else if (stopping) {
+      return NULL;              // stop was asked before the ring was empty
+    } else {
+      struct timespec nap = { 0, IdleNanos };
+      nanosleep(&nap, NULL);
+    }
+  }
+}
+
+/**************** flog_drain ****************/
+/* 
+ * writes every complete entry at the front of the ring to the file and
+ * gives its room back; returns the number of entries written.
+ */
+static size_t
+flog_drain(void)
+{
+  size_t count = 0;
+  size_t pos = atomic_load_explicit(&async.released, memory_order_relaxed);
+
+  while (pos != atomic_load_explicit(&async.reserved, memory_order_acquire)) {
+    size_t offset = pos & (async.size - 1);
+    _Atomic uint32_t* header = (_Atomic uint32_t*)&async.ring[offset];
+    uint32_t word = atomic_load_explicit(header, memory_order_acquire);
+    if (word == 0) {
+      break;                    // claimed, but its producer is still writing
+    }
+    size_t need;
+    if (word & SkipEntry) {     // the end of the ring, left unused
+      need = word & ~SkipEntry;
+    } else {
+      need = HeaderBytes + ((word + 7) & ~(size_t)7);
+      fwrite(&async.ring[offset + HeaderBytes], 1, word, async.fp);
+      count++;
+    }
+
+    // zero the whole entry, so that stale text is never taken for a header
+    memset(&async.ring[offset], 0, need);
+    pos += need;
+    atomic_store_explicit(&async.released, pos, memory_order_release);
+  }
+  atomic_fetch_add_explicit(&async.written, count, memory_order_relaxed);
+  return count;
+}
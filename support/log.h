@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
 /*********** file-local global variable ****************/
 /* Here is an example of a judicious use of a global variable.
@@ -90,4 +91,32 @@ static inline void log_done(void) { flog_done(logFP); logFP = NULL; }
  * It is the caller's responsibility to close the file, if desired.
  */
 
+/*********** asynchronous logging ****************/
+/* Unlike the log_x functions, these act on a file rather than on the
+ * caller's logFP, so that every source file logging to that file is
+ * covered, and they are called once per program rather than per file.
+ */
+
+bool log_asyncStart(FILE* fp, size_t bufferSize);
+/* log_asyncStart: from now on, entries logged to fp are copied into a
+ * ring buffer of at least bufferSize bytes, and a background thread writes
+ * them to fp in batches, flushing once per batch.  Logging never waits for
+ * the disk, or for a lock: an entry that does not fit in the ring is
+ * dropped and counted, and the writer notes in the log how many entries
+ * have been dropped so far whenever that number grows.
+ * Returns false (and nothing changes) if fp is NULL, if asynchronous
+ * logging is already on, or on error.
+ */
+
+void log_asyncStop(void);
+/* log_asyncStop: write every entry still in the ring, stop the writer
+ * thread, and log a summary of entries written and dropped; entries are
+ * then written directly again.  Call it after the last thread that logs
+ * has finished, and before closing the file.
+ */
+
+unsigned long log_asyncDropped(void);
+/* log_asyncDropped: the number of entries dropped since log_asyncStart.
+ */
+
 #endif // _LOG_H_
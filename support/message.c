@@ -6,16 +6,19 @@
  * and may be reordered, but require no connection setup or teardown.
  * 
  * See message.h for detailed interface description for each function.
- * Depends on the 'log' module and thus must be linked with log.o.
+ * Depends on the 'log' and 'eventlog' modules and thus must be linked with
+ * log.o and eventlog.o.
  * 
  * Compile with -DUNIT_TEST for a standalone unit test; see below.
  *
  * David Kotz - May 2019
  */
 
+#define _GNU_SOURCE           // for recvmmsg, sendmmsg, sigprocmask under -std=c11
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -23,9 +26,18 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <math.h>
 #include "message.h"
 #include "log.h"
+#include "eventlog.h"
 
 /**************** file-local constants ****************/
 /* See message.h for other constants (shared with users of this module).
@@ -34,6 +46,33 @@
  */
 static const int MinPort = 1024;
 static const int MaxPort = 65535;
+#define OutBufferBytes 65508  // message_MaxBytes, plus a null character
+#define MaxWatches 1024       // extra file descriptors message_watch can hold
+#define MaxEvents 16          // events taken from epoll per wakeup
+#define MaxBatch 32           // most datagrams taken per wakeup when batching
+#define MaxQueued 128         // most messages waiting for message_flush
+#define QueueBytes (4 * OutBufferBytes)  // room for their contents
+
+/**************** file-local types ****************/
+/* A message waiting in the outbound queue for message_flush; its text is
+ * queueBuffer[offset .. offset+length-1], followed by a null character.
+ */
+typedef struct queued {
+  addr_t to;
+  int offset;
+  int length;
+} queued_t;
+
+/* An extra file descriptor watched by message_loopEpoll. Exactly one of the
+ * handlers is set, and says what kind of descriptor it is.
+ */
+typedef struct watch {
+  int fd;                                       // -1 if slot is free
+  int signum;                                   // signal, for signal watches
+  bool (*handleFd)(void* arg, int fd);          // any descriptor
+  bool (*handleTimer)(void* arg);               // a timerfd we made
+  bool (*handleSignal)(void* arg, int signum);  // a signalfd we made
+} watch_t;
 
 /**************** file-local global variables ****************/
 /* This is an example of a judicious use of a global variable.
@@ -48,12 +87,98 @@ static const int MaxPort = 65535;
  */
 static int ourSocket = 0;     // socket on which to receive messages
 
+/* Set by message_initOffline: there is no socket, and messages "sent" are
+ * only logged.
+ */
+static bool offline = false;
+
+/* Outbound messages are formatted here rather than in malloc'd memory.
+ * Each thread has its own, so senders in different threads do not collide.
+ */
+static _Thread_local char outBuffer[OutBufferBytes];
+
+/* Messages queued by message_sendQueued, waiting for message_flush. Each
+ * thread has its own queue, and sends it when it calls message_flush.
+ */
+static _Thread_local char queueBuffer[QueueBytes];
+static _Thread_local queued_t queue[MaxQueued];
+static _Thread_local int numQueued = 0;   // messages in the queue
+static _Thread_local int queueUsed = 0;   // bytes of queueBuffer in use
+
+/* Batched mode (see message_setBatching): the number of datagrams to take
+ * from the socket per wakeup, and buffers to receive them into. When more
+ * than 1, every send is queued, and the loops flush the queue before they
+ * wait again.
+ */
+static int batchSize = 1;
+static char* batchBuffers = NULL;   // batchSize buffers of message_MaxBytes
+
+/* The binary event log that traffic is recorded in (see
+ * message_setEventLog); NULL if it is logged as text.
+ */
+static eventlog_t* eventLog = NULL;
+
+/* Messages and bytes received and sent, by type (see message_getCounts),
+ * and the turns the loops have taken (see message_loopCount).
+ */
+static _Atomic unsigned long messagesIn[NumTypes], bytesIn[NumTypes];
+static _Atomic unsigned long messagesOut[NumTypes], bytesOut[NumTypes];
+static unsigned long loopCount = 0;
+
+/* The epoll instance used by message_loopEpoll, made when first needed,
+ * and the extra descriptors it watches besides stdin and our socket. Each
+ * descriptor is registered with its number and its slot in watches (NoSlot
+ * for stdin and the socket) packed in epoll's data, so that a ready watch
+ * is found without searching (see epollData).
+ */
+#define NoSlot MaxWatches
+static int epollFd = -1;
+static watch_t watches[MaxWatches];
+static int numWatches = 0;      // slots in use are watches[0..numWatches-1]
+
 /**************** file-local functions ****************/
 /* stringAddr: format a string representation of an address.
  * Returns pointer to static storage and thus should not be retained.
  */
 static const char* stringAddr(const addr_t addr);
 
+/* receiveMessages: read one datagram from our socket, or up to batchSize
+ * in batched mode, and hand each to handleMessage; returns true if the
+ * handler says to stop looping.
+ * deliverMessage: log one received datagram and hand it to handleMessage.
+ * logSent: log a message that was sent; countMessage counts it.
+ */
+static bool receiveMessages(void* arg,
+                            bool (*handleMessage)(void* arg,
+                                                  const addr_t from,
+                                                  const char* message));
+static bool deliverMessage(void* arg,
+                           bool (*handleMessage)(void* arg,
+                                                 const addr_t from,
+                                                 const char* message),
+                           struct sockaddr_in sender, char* buf, int nbytes);
+static void logSent(const addr_t to, const char* message);
+
+/* logReceived: log a message that was received.
+ */
+static void logReceived(const addr_t from, const char* message);
+
+/* countMessage: add a message of length bytes to the counts of its type.
+ */
+static void countMessage(_Atomic unsigned long* messages,
+                         _Atomic unsigned long* bytes, const char* message,
+                         size_t length);
+
+/* startEpoll: make the epoll instance if needed; false on error.
+ * epollData: the epoll data for a descriptor in a slot of watches.
+ * addWatch: record a watch and add its descriptor to epoll; false on error.
+ * handleWatch: service a ready watch; true if its handler says to stop.
+ */
+static bool startEpoll(void);
+static epoll_data_t epollData(const int fd, const int slot);
+static bool addWatch(watch_t watch);
+static bool handleWatch(void* arg, watch_t* watch);
+
 
 /***********************************************************************/
 /**************** message_init ****************/
@@ -109,6 +234,24 @@ message_init(FILE* logFP)
   return port;
 }
 
+/**************** message_initOffline ****************/
+/* 
+ * Start the module without a socket, so that messages are only logged.
+ * See message.h for detailed description.
+ */
+bool
+message_initOffline(FILE* logFP)
+{
+  log_init(logFP);
+  if (ourSocket != 0 || offline) {
+    log_v("message_initOffline: called again, when already initialized");
+    return false;
+  }
+  offline = true;
+  log_v("message_initOffline: no socket; messages sent are only logged");
+  return true;
+}
+
 /**************** message_noAddr ****************/
 /* 
  * Return an empty/nonexistent address.
@@ -199,13 +342,14 @@ message_setAddr(const char* hostname, const char* portString, addr_t* addr)
 /*
  * Produce a string representation of the address.
  * Returns pointer to static storage and thus should not be retained.
+ * Each thread has its own copy, so threads sending at once do not collide.
  */
 static const char*
 stringAddr(const addr_t addr)
 {
   // Maximum string length to hold an IP address and port, plus null.
   // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
+  static _Thread_local char addrString[22]; // constant appears in snprintf below
 
   snprintf(addrString, 22, "%s:%05d",
 	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
@@ -251,7 +395,7 @@ numLines(const char* string)
 void
 message_send(const addr_t to, const char* message)
 {
-  if (ourSocket == 0) {
+  if (ourSocket == 0 && !offline) {
     log_v("message_send: called before message_init");
     return; // error in usage of this function.
   }
@@ -259,16 +403,274 @@ message_send(const addr_t to, const char* message)
     log_v("message_send: called with null message");
     return; // error in usage of this function.
   }
-  if (sendto(ourSocket, message, strlen(message), 0,
+  if (batchSize > 1) {
+    message_sendQueued(to, message, NULL); // sent at the next flush
+    return;
+  }
+  if (offline) {
+    countMessage(messagesOut, bytesOut, message, strlen(message));
+    logSent(to, message); // as if it had been sent
+    return;
+  }
+  size_t length = strlen(message);
+  if (sendto(ourSocket, message, length, 0,
              (struct sockaddr *) &to, sizeof(to)) < 0) {
     log_e("message_send: error sending to datagram socket");
   } else {
-    log_s("message_send: TO %s", stringAddr(to));
-    log_d("message_send: %d lines:", numLines(message));
-    log_s("%s", message);
+    countMessage(messagesOut, bytesOut, message, length);
+    logSent(to, message);
   }
 }
 
+/**************** logSent ****************/
+/*
+ * Log a message that was sent, in the same form for every way of sending.
+ */
+static void
+logSent(const addr_t to, const char* message)
+{
+  if (eventLog != NULL) {
+    eventlog_record(eventLog, EventSend, to, message);
+    return;
+  }
+  log_s("message_send: TO %s", stringAddr(to));
+  log_d("message_send: %d lines:", numLines(message));
+  log_s("%s", message);
+}
+
+/**************** message_sendf ****************/
+/* 
+ * Format a message into this thread's buffer and send it.
+ * See message.h for detailed description.
+ */
+void
+message_sendf(const addr_t to, const char* format, ...)
+{
+  if (format == NULL) {
+    log_v("message_sendf: called with null format");
+    return; // error in usage of this function.
+  }
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(outBuffer, sizeof(outBuffer), format, args);
+  va_end(args);
+  if (length < 0 || length > message_MaxBytes) {
+    log_v("message_sendf: message too long to send");
+    return;
+  }
+  message_sendParts(to, outBuffer, NULL);
+}
+
+/**************** message_sendParts ****************/
+/* 
+ * Send the two strings as one datagram, using scatter/gather.
+ * See message.h for detailed description.
+ */
+void
+message_sendParts(const addr_t to, const char* head, const char* body)
+{
+  if (ourSocket == 0 && !offline) {
+    log_v("message_sendParts: called before message_init");
+    return; // error in usage of this function.
+  }
+  if (head == NULL) {
+    log_v("message_sendParts: called with null message");
+    return; // error in usage of this function.
+  }
+  if (batchSize > 1) {
+    message_sendQueued(to, head, body); // sent at the next flush
+    return;
+  }
+  if (offline) {
+    message_sendQueued(to, head, body); // logged as one string
+    message_flush();
+    return;
+  }
+
+  struct iovec parts[2];
+  parts[0].iov_base = (void*)head;
+  parts[0].iov_len = strlen(head);
+  parts[1].iov_base = (void*)body;
+  parts[1].iov_len = body == NULL ? 0 : strlen(body);
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = (void*)&to;
+  msg.msg_namelen = sizeof(to);
+  msg.msg_iov = parts;
+  msg.msg_iovlen = body == NULL ? 1 : 2;
+
+  if (sendmsg(ourSocket, &msg, 0) < 0) {
+    log_e("message_sendParts: error sending to datagram socket");
+    return;
+  }
+  countMessage(messagesOut, bytesOut, head,
+               parts[0].iov_len + parts[1].iov_len);
+  if (logFP != NULL || eventLog != NULL) {
+    // log the message as one string, as message_send does
+    const char* message = head;
+    if (body != NULL && head != outBuffer
+        && parts[0].iov_len + parts[1].iov_len <= message_MaxBytes) {
+      memcpy(outBuffer, head, parts[0].iov_len);
+      memcpy(outBuffer + parts[0].iov_len, body, parts[1].iov_len + 1);
+      message = outBuffer;
+    }
+    logSent(to, message);
+  }
+}
+
+/**************** message_sendQueued ****************/
+/* 
+ * Copy a message into this thread's queue, to be sent by message_flush.
+ * See message.h for detailed description.
+ */
+void
+message_sendQueued(const addr_t to, const char* head, const char* body)
+{
+  if (head == NULL) {
+    log_v("message_sendQueued: called with null message");
+    return; // error in usage of this function.
+  }
+  int headLength = strlen(head);
+  int bodyLength = body == NULL ? 0 : strlen(body);
+  int length = headLength + bodyLength;
+  if (length > message_MaxBytes) {
+    log_d("message_sendQueued: message of %d bytes is too long", length);
+    return;
+  }
+
+  // make room, sending what is queued if need be
+  if (numQueued == MaxQueued || queueUsed + length + 1 > QueueBytes) {
+    message_flush();
+  }
+  queued_t* entry = &queue[numQueued++];
+  entry->to = to;
+  entry->offset = queueUsed;
+  entry->length = length;
+  memcpy(queueBuffer + queueUsed, head, headLength);
+  memcpy(queueBuffer + queueUsed + headLength, body, bodyLength);
+  queueBuffer[queueUsed + length] = '\0';
+  queueUsed += length + 1;
+}
+
+/**************** message_flush ****************/
+/* 
+ * Send every message in this thread's queue, with as few sendmmsg calls as
+ * the kernel allows.
+ * See message.h for detailed description.
+ */
+int
+message_flush(void)
+{
+  if (numQueued == 0) {
+    return 0;
+  }
+  if (offline) {
+    // nothing goes out; log them as if it had
+    int sent = numQueued;
+    for (int i = 0; i < numQueued; i++) {
+      const char* message = queueBuffer + queue[i].offset;
+      countMessage(messagesOut, bytesOut, message, queue[i].length);
+      logSent(queue[i].to, message);
+    }
+    numQueued = queueUsed = 0;
+    return sent;
+  }
+  if (ourSocket == 0) {
+    log_v("message_flush: called before message_init");
+    numQueued = queueUsed = 0;
+    return 0; // error in usage of this function.
+  }
+
+  struct mmsghdr msgs[MaxQueued];
+  struct iovec parts[MaxQueued];
+  memset(msgs, 0, numQueued * sizeof(struct mmsghdr));
+  for (int i = 0; i < numQueued; i++) {
+    parts[i].iov_base = queueBuffer + queue[i].offset;
+    parts[i].iov_len = queue[i].length;
+    msgs[i].msg_hdr.msg_name = &queue[i].to;
+    msgs[i].msg_hdr.msg_namelen = sizeof(queue[i].to);
+    msgs[i].msg_hdr.msg_iov = &parts[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  // the kernel may send fewer than asked; keep going from where it stopped
+  int sent = 0;
+  int next = 0;
+  while (next < numQueued) {
+    int n = sendmmsg(ourSocket, &msgs[next], numQueued - next, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // skip the message that failed, and carry on with the rest
+      log_e("message_flush: error sending to datagram socket");
+      next++;
+      continue;
+    }
+    for (int i = next; i < next + n; i++) {
+      const char* message = queueBuffer + queue[i].offset;
+      countMessage(messagesOut, bytesOut, message, queue[i].length);
+      logSent(queue[i].to, message);
+    }
+    sent += n;
+    next += n;
+  }
+
+  numQueued = 0;
+  queueUsed = 0;
+  return sent;
+}
+
+/**************** message_setBatching ****************/
+/* 
+ * Choose how many datagrams the loops take per wakeup; above 1, sends are
+ * queued and flushed by the loops.
+ * See message.h for detailed description.
+ */
+bool
+message_setBatching(const int size)
+{
+  if (size < 1 || size > MaxBatch) {
+    log_d("message_setBatching: batch size must be 1 to %d", MaxBatch);
+    return false;
+  }
+  char* buffers = NULL;
+  if (size > 1) {
+    buffers = malloc(size * message_MaxBytes);
+    if (buffers == NULL) {
+      log_v("message_setBatching: out of memory");
+      return false;
+    }
+  }
+  message_flush();    // anything queued goes out before the mode changes
+  free(batchBuffers);
+  batchBuffers = buffers;
+  batchSize = size;
+  return true;
+}
+
+/**************** message_setEventLog ****************/
+/* 
+ * Start or stop recording traffic in a binary event log.
+ * See message.h for detailed description.
+ */
+bool
+message_setEventLog(FILE* fp)
+{
+  eventlog_delete(eventLog);  // flushes what it recorded
+  eventLog = NULL;
+  if (fp == NULL) {
+    return true;
+  }
+  eventLog = eventlog_new(fp);
+  if (eventLog == NULL) {
+    log_v("message_setEventLog: cannot start the event log");
+    return false;
+  }
+  return true;
+}
+
 /**************** message_loop ****************/
 /* 
  * Loop forever, calling handler functions for stdin or socket,
@@ -314,6 +716,9 @@ message_loop(void* arg, const float timeout,
 
   // loop until error or some handler indicates time to quit looping
   while (true) {
+    message_flush(); // send anything the handlers queued
+    loopCount++;
+
     // for use with select()
     fd_set rfds;        // set of file descriptors we want to read
     
@@ -368,39 +773,477 @@ message_loop(void* arg, const float timeout,
       if (FD_ISSET(ourSocket, &rfds)) {
         // socket has input ready
         log_v("message_loop: message ready on socket");
-        struct sockaddr_in sender;     // sender of this message
-        struct sockaddr *senderp = (struct sockaddr *) &sender;
-        socklen_t senderlen = sizeof(sender);  // must pass address to length
-        char buf[message_MaxBytes]; // buffer for reading data from socket
-        int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1, 
-                              0, senderp, &senderlen);
-        if (nbytes < 0) {
-          // error, ignore it
-          log_e("message_loop: receiving from socket");
-        } else {
-          buf[nbytes] = '\0';     // null terminate message string
-          // where was it from?
-          if (sender.sin_family != AF_INET) {
-            // ignore it
-            log_d("message_loop: non-Internet family %d\n", sender.sin_family);
-          } else {
-	    // record it
-	    log_s("message_loop: FROM %s", stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
-
-            // handle it
-            if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
-              break; // handler says to exit loop 
-            }
-          }
+        if (receiveMessages(arg, handleMessage)) {
+          break; // handler says to exit loop 
         }
       }
     }
   }
+  message_flush(); // send anything the last handler queued
+  return true;
+}
+
+/**************** receiveMessages ****************/
+/* 
+ * Read one datagram from our socket, or in batched mode as many as are
+ * waiting (up to batchSize) with one recvmmsg, and pass each to the handler.
+ * Return true if the handler says to exit the loop.
+ */
+static bool
+receiveMessages(void* arg,
+                bool (*handleMessage)(void* arg,
+                                      const addr_t from, const char* buf))
+{
+  if (batchSize == 1) {
+    struct sockaddr_in sender;     // sender of this message
+    struct sockaddr *senderp = (struct sockaddr *) &sender;
+    socklen_t senderlen = sizeof(sender);  // must pass address to length
+    char buf[message_MaxBytes]; // buffer for reading data from socket
+    int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1, 
+                          0, senderp, &senderlen);
+    return deliverMessage(arg, handleMessage, sender, buf, nbytes);
+  }
+
+  struct mmsghdr msgs[MaxBatch];
+  struct iovec parts[MaxBatch];
+  struct sockaddr_in senders[MaxBatch];
+  memset(msgs, 0, batchSize * sizeof(struct mmsghdr));
+  for (int i = 0; i < batchSize; i++) {
+    parts[i].iov_base = batchBuffers + i * message_MaxBytes;
+    parts[i].iov_len = message_MaxBytes - 1;
+    msgs[i].msg_hdr.msg_name = &senders[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+    msgs[i].msg_hdr.msg_iov = &parts[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int count = recvmmsg(ourSocket, msgs, batchSize, MSG_DONTWAIT, NULL);
+  if (count < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return false; // nothing (more) to read: the batch is over
+    }
+    return deliverMessage(arg, handleMessage, senders[0], NULL, -1);
+  }
+  log_d("message_loop: %d messages in batch", count);
+  for (int i = 0; i < count; i++) {
+    if (deliverMessage(arg, handleMessage, senders[i], parts[i].iov_base,
+                       msgs[i].msg_len)) {
+      return true; // handler says to exit loop; the rest are dropped
+    }
+  }
+  return false;
+}
+
+/**************** deliverMessage ****************/
+/* 
+ * Log a datagram of 'nbytes' bytes (negative if the receive failed) and pass
+ * it to the handler. Return true if the handler says to exit the loop.
+ */
+static bool
+deliverMessage(void* arg,
+               bool (*handleMessage)(void* arg,
+                                     const addr_t from, const char* buf),
+               struct sockaddr_in sender, char* buf, int nbytes)
+{
+  if (nbytes < 0) {
+    // error, ignore it
+    log_e("message_loop: receiving from socket");
+  } else {
+    buf[nbytes] = '\0';     // null terminate message string
+    // where was it from?
+    if (sender.sin_family != AF_INET) {
+      // ignore it
+      log_d("message_loop: non-Internet family %d\n", sender.sin_family);
+    } else {
+      // record it
+      logReceived(sender, buf);
+
+      // handle it
+      if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
+        return true; // handler says to exit loop 
+      }
+    }
+  }
+  return false;
+}
+
+/**************** logReceived ****************/
+/*
+ * Log a message that was received, whether from the socket or from
+ * message_deliver.
+ */
+static void
+logReceived(const addr_t from, const char* message)
+{
+  countMessage(messagesIn, bytesIn, message, strlen(message));
+  if (eventLog != NULL) {
+    eventlog_record(eventLog, EventRecv, from, message);
+    return;
+  }
+  log_s("message_loop: FROM %s", stringAddr(from));
+  log_d("message_loop: %d lines:", numLines(message));
+  log_s("%s", message);
+}
+
+/**************** countMessage ****************/
+/*
+ * Add a message to the counts of its type, which its first word gives, and
+ * its length to the bytes; relaxed, as nothing is ordered by them.
+ */
+static void
+countMessage(_Atomic unsigned long* messages, _Atomic unsigned long* bytes,
+             const char* message, size_t length)
+{
+  msgtype_t type = eventlog_typeOf(message);
+  atomic_fetch_add_explicit(&messages[type], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bytes[type], length, memory_order_relaxed);
+}
+
+/**************** message_getCounts ****************/
+/* 
+ * Read the counts of one type of message.
+ * See message.h for detailed description.
+ */
+bool
+message_getCounts(const int type, msgcount_t* in, msgcount_t* out)
+{
+  if (type < 0 || type >= NumTypes || in == NULL || out == NULL) {
+    return false;
+  }
+  in->messages = atomic_load_explicit(&messagesIn[type], memory_order_relaxed);
+  in->bytes = atomic_load_explicit(&bytesIn[type], memory_order_relaxed);
+  out->messages = atomic_load_explicit(&messagesOut[type],
+                                       memory_order_relaxed);
+  out->bytes = atomic_load_explicit(&bytesOut[type], memory_order_relaxed);
   return true;
 }
 
+/**************** message_loopCount ****************/
+/* 
+ * See message.h for detailed description.
+ */
+unsigned long
+message_loopCount(void)
+{
+  return loopCount;
+}
+
+/**************** message_deliver ****************/
+/* 
+ * Pass a message to the handler as if it had come in on the socket.
+ * See message.h for detailed description.
+ */
+bool
+message_deliver(void* arg,
+                bool (*handleMessage)(void* arg,
+                                      const addr_t from, const char* buf),
+                const addr_t from, const char* message)
+{
+  if (handleMessage == NULL || message == NULL) {
+    log_v("message_deliver: called with null handler or message");
+    return false; // error in usage of this function.
+  }
+  logReceived(from, message);
+  bool done = (*handleMessage)(arg, from, message);
+  message_flush(); // send anything the handler queued
+  return done;
+}
+
+/**************** message_watch ****************/
+/* 
+ * Watch an extra file descriptor in message_loopEpoll.
+ * See message.h for detailed description.
+ */
+bool
+message_watch(const int fd, bool (*handleFd)(void* arg, int fd))
+{
+  if (fd < 0 || handleFd == NULL) {
+    log_v("message_watch: called with bad fd or null handler");
+    return false; // error in usage of this function.
+  }
+  watch_t watch = { fd, 0, handleFd, NULL, NULL };
+  return addWatch(watch);
+}
+
+/**************** message_watchTimer ****************/
+/* 
+ * Make a periodic timerfd and watch it in message_loopEpoll.
+ * See message.h for detailed description.
+ */
+int
+message_watchTimer(const float interval, bool (*handleTimer)(void* arg))
+{
+  if (interval <= 0.0 || handleTimer == NULL) {
+    log_v("message_watchTimer: called with bad interval or null handler");
+    return -1; // error in usage of this function.
+  }
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    log_e("message_watchTimer: creating timer");
+    return -1;
+  }
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = (time_t)interval;
+  spec.it_interval.tv_nsec = (long)((interval - (time_t)interval) * 1e9);
+  spec.it_value = spec.it_interval;
+  watch_t watch = { fd, 0, NULL, handleTimer, NULL };
+  if (timerfd_settime(fd, 0, &spec, NULL) < 0 || !addWatch(watch)) {
+    log_e("message_watchTimer: starting timer");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**************** message_watchSignal ****************/
+/* 
+ * Block a signal, and deliver it through a signalfd in message_loopEpoll.
+ * See message.h for detailed description.
+ */
+int
+message_watchSignal(const int signum, bool (*handleSignal)(void* arg, int signum))
+{
+  if (signum <= 0 || handleSignal == NULL) {
+    log_v("message_watchSignal: called with bad signal or null handler");
+    return -1; // error in usage of this function.
+  }
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, signum);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+    log_e("message_watchSignal: blocking signal");
+    return -1;
+  }
+  int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0) {
+    log_e("message_watchSignal: creating signalfd");
+    return -1;
+  }
+  watch_t watch = { fd, signum, NULL, NULL, handleSignal };
+  if (!addWatch(watch)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**************** message_unwatch ****************/
+/* 
+ * Stop watching a descriptor; close it if we made it.
+ * See message.h for detailed description.
+ */
+bool
+message_unwatch(const int fd)
+{
+  for (int i = 0; i < numWatches; i++) {
+    if (watches[i].fd == fd) {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+      if (watches[i].handleFd == NULL) {
+        close(fd); // a timerfd or signalfd made by this module
+      }
+      watches[i] = watches[--numWatches];
+      if (i < numWatches) { // check if the last watch moved to this slot
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data = epollData(watches[i].fd, i);
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, watches[i].fd, &event);
+      }
+      return true;
+    }
+  }
+  log_d("message_unwatch: fd %d is not watched", fd);
+  return false;
+}
+
+/**************** startEpoll ****************/
+/* 
+ * Make the epoll instance, if not made yet.
+ */
+static bool
+startEpoll(void)
+{
+  if (epollFd < 0) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+      log_e("message: creating epoll instance");
+      return false;
+    }
+  }
+  return true;
+}
+
+/**************** epollData ****************/
+/* 
+ * Pack a descriptor and its slot in watches into epoll's data.
+ */
+static epoll_data_t
+epollData(const int fd, const int slot)
+{
+  epoll_data_t data;
+  data.u64 = ((uint64_t)(uint32_t)fd << 32) | (uint32_t)slot;
+  return data;
+}
+
+/**************** addWatch ****************/
+/* 
+ * Record a watch and add its descriptor to the epoll instance.
+ */
+static bool
+addWatch(watch_t watch)
+{
+  if (numWatches == MaxWatches) {
+    log_v("message_watch: too many watched descriptors");
+    return false;
+  }
+  if (!startEpoll()) {
+    return false;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data = epollData(watch.fd, numWatches);
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, watch.fd, &event) < 0) {
+    log_e("message_watch: adding descriptor to epoll");
+    return false;
+  }
+  watches[numWatches++] = watch;
+  return true;
+}
+
+/**************** handleWatch ****************/
+/* 
+ * A watched descriptor is ready; drain it if we made it, and call its
+ * handler. Return true if the handler says to exit the loop.
+ */
+static bool
+handleWatch(void* arg, watch_t* watch)
+{
+  if (watch->handleTimer != NULL) {
+    uint64_t expirations;   // times the timer fired since the last read
+    if (read(watch->fd, &expirations, sizeof(expirations)) < 0) {
+      return false; // nothing to read after all
+    }
+    return (*watch->handleTimer)(arg);
+  } else if (watch->handleSignal != NULL) {
+    struct signalfd_siginfo info;
+    if (read(watch->fd, &info, sizeof(info)) < 0) {
+      return false; // nothing to read after all
+    }
+    log_d("message_loopEpoll: signal %d", info.ssi_signo);
+    return (*watch->handleSignal)(arg, watch->signum);
+  } else {
+    return (*watch->handleFd)(arg, watch->fd);
+  }
+}
+
+/**************** message_loopEpoll ****************/
+/* 
+ * Loop forever, as message_loop does, but wait with epoll, and also
+ * service the descriptors registered with message_watch*.
+ * Returns false on error or true if any of the handlers return true.
+ * See message.h for detailed description.
+ */
+bool
+message_loopEpoll(void* arg, const float timeout,
+                  bool (*handleTimeout)(void* arg),
+                  bool (*handleInput)  (void* arg),
+                  bool (*handleMessage)(void* arg,
+                                        const addr_t from, const char* buf))
+{
+  // check if we're ready for messaging
+  if (ourSocket == 0) {
+    log_v("message_loopEpoll called before message_init");
+    return false; // error in usage of this function.
+  }
+
+  // check parameters
+  if (handleTimeout == NULL && handleInput == NULL && handleMessage == NULL
+      && numWatches == 0) {
+    log_v("message_loopEpoll called with all handlers null");
+    return false; // error in usage of this function.
+  }
+  if ((handleTimeout == NULL) != (timeout <= 0.0)) {
+    log_v("message_loopEpoll called with mismatched timeout and handler");
+    return false; // error in usage of this function.
+  }
+  if (!startEpoll()) {
+    return false;
+  }
+
+  // watch stdin and the socket for the length of this loop
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  if (handleInput != NULL) {
+    event.data = epollData(0, NoSlot);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, 0, &event) < 0) {
+      log_e("message_loopEpoll: watching stdin");
+      return false;
+    }
+  }
+  if (handleMessage != NULL) {
+    event.data = epollData(ourSocket, NoSlot);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, ourSocket, &event) < 0) {
+      log_e("message_loopEpoll: watching socket");
+      if (handleInput != NULL) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, 0, NULL);
+      }
+      return false;
+    }
+  }
+  int timeoutMs = timeout > 0.0 ? (int)(timeout * 1000) : -1;
+
+  // loop until error or some handler indicates time to quit looping
+  bool ok = true;
+  bool done = false;
+  while (!done) {
+    message_flush(); // send anything the handlers queued
+    loopCount++;
+
+    struct epoll_event events[MaxEvents];
+    int ready = epoll_wait(epollFd, events, MaxEvents, timeoutMs);
+
+    if (ready < 0) {
+      if (errno == EINTR) {
+        // interrupted by a signal that is not watched; wait again
+        log_e("message_loopEpoll: epoll_wait() EINTR: interrupted by signal");
+      } else {
+        log_e("message_loopEpoll: epoll_wait()");
+        ok = false; // error
+        done = true;
+      }
+    } else if (ready == 0) {
+      // timeout occurred
+      log_v("message_loopEpoll: epoll_wait() timed out");
+      done = (*handleTimeout)(arg);
+    }
+
+    for (int i = 0; i < ready && !done; i++) {
+      int fd = (int)(events[i].data.u64 >> 32);
+      int slot = (int)(events[i].data.u64 & 0xffffffff);
+      if (slot == NoSlot && fd == 0 && handleInput != NULL) {
+        log_v("message_loopEpoll: input ready on stdin");
+        done = (*handleInput)(arg);
+      } else if (slot == NoSlot && fd == ourSocket && handleMessage != NULL) {
+        log_v("message_loopEpoll: message ready on socket");
+        done = receiveMessages(arg, handleMessage);
+      } else if (slot < numWatches && watches[slot].fd == fd) {
+        done = handleWatch(arg, &watches[slot]);
+      }
+      // otherwise a handler unwatched it, or moved it to another slot,
+      // earlier in this batch; if still ready, the next wait reports it
+    }
+  }
+
+  message_flush(); // send anything the last handler queued
+
+  // stop watching stdin and the socket, so the loop can be run again
+  if (handleInput != NULL) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, 0, NULL);
+  }
+  if (handleMessage != NULL) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, ourSocket, NULL);
+  }
+  return ok;
+}
+
 /**************** message_done ****************/
 /* 
  * Clean up the message module, prior to exit.
@@ -409,10 +1252,23 @@ message_loop(void* arg, const float timeout,
 void
 message_done(void)
 {
+  message_flush(); // send anything still queued while the socket is open
   if (ourSocket != 0) {
     close(ourSocket);
     ourSocket = 0;
   }
+  while (numWatches > 0) {
+    message_unwatch(watches[0].fd);
+  }
+  if (epollFd >= 0) {
+    close(epollFd);
+    epollFd = -1;
+  }
+  free(batchBuffers);
+  batchBuffers = NULL;
+  batchSize = 1;
+  offline = false;
+  message_setEventLog(NULL);
   log_v("message_done: message module closing down.");
 }
 
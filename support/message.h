@@ -15,6 +15,13 @@
  *   message_send(serverAddress, message); // client speaks first
  *   message_loop(arg, timeout, handleTimeout, handleStdin, handleMessage);
  *   message_done();
+ * A server may use message_loopEpoll instead of message_loop; it takes the
+ * same handlers, and also services any descriptors registered beforehand:
+ *   message_init(stderr);
+ *   message_watchSignal(SIGINT, handleSignal);
+ *   message_watchTimer(1.0/30, handleTick);
+ *   message_loopEpoll(arg, timeout, handleTimeout, handleStdin, handleMessage);
+ *   message_done();
  * Note:
  *  handleTimeout may be NULL (and timeout==0) if no timers needed.
  *  handleInput may be NULL if no input expected.
@@ -64,6 +71,21 @@ static const int message_MaxBytes = 65507;
  */
 int message_init(FILE* logFP);
 
+/******************************************/
+/* message_initOffline: initialize the module without a socket.
+ * Caller provides:
+ *   file pointer(fp), passed through to log_init().  May be NULL.
+ * Function returns:
+ *   true if initialized; false if already initialized.
+ * Notes:
+ *   For replaying recorded input (see message_deliver): every message
+ *   sent is logged as if it had been sent, but nothing goes on the wire.
+ *   The loops cannot be used.
+ * Caller expectations:
+ *   call message_done() later when all messaging operations complete.
+ */
+bool message_initOffline(FILE* logFP);
+
 /******************************************/
 /* message_noAddr: return an addr_t representing "no address".
  * Logs: nothing.
@@ -118,6 +140,141 @@ bool message_setAddr(const char* hostname, const char* portStr, addr_t* addr);
  */
 void message_send(const addr_t to, const char* message);
 
+/******************************************/
+/* message_sendf: format and send a message, without allocating memory.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   a printf-style format and its arguments.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   The message is formatted into a buffer private to the calling thread,
+ *   and is not sent if longer than message_MaxBytes.
+ * Logs: as message_send; also a message too long to send.
+ */
+void message_sendf(const addr_t to, const char* format, ...);
+
+/******************************************/
+/* message_sendParts: send a message made of two strings, without copying.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   a string for the start of the message (e.g. "DISPLAY\n"),
+ *   a string for the rest of the message; may be NULL.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   The two strings go out as one datagram, gathered by the kernel, so a
+ *   large body (such as a grid) need not be copied behind its header.
+ * Logs: as message_send.
+ */
+void message_sendParts(const addr_t to, const char* head, const char* body);
+
+/******************************************/
+/* message_sendQueued: queue a message to be sent by message_flush.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   a string for the start of the message,
+ *   a string for the rest of the message; may be NULL.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   The message is copied, so the caller may reuse its strings at once.
+ *   Each thread has its own queue; if it is full, it is flushed first.
+ *   After message_setBatching(n) with n > 1, message_send, message_sendf,
+ *   and message_sendParts queue their messages this way too, and the loops
+ *   flush the queue each time they are about to wait.
+ * Logs: as message_send, when the message is flushed.
+ */
+void message_sendQueued(const addr_t to, const char* head, const char* body);
+
+/******************************************/
+/* message_flush: send every message queued by this thread.
+ * Caller provides: nothing.
+ * Function returns: the number of messages sent.
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   Messages go out in the order they were queued, as few sendmmsg system
+ *   calls as the kernel allows; a message that cannot be sent is logged
+ *   and dropped, as message_send would.
+ */
+int message_flush(void);
+
+/******************************************/
+/* message_setBatching: choose how many datagrams to handle per wakeup.
+ * Caller provides:
+ *   the batch size, 1 to 32; 1 (the default) means no batching.
+ * Function returns:
+ *   true if the size was set; false if out of range or out of memory.
+ * Notes:
+ *   With a batch size n > 1, each time the socket is ready the loops take
+ *   up to n waiting datagrams with one recvmmsg system call and pass each
+ *   to handleMessage in turn; every message sent is queued (see
+ *   message_sendQueued) and the whole queue goes out with sendmmsg before
+ *   the loop waits again. Handlers see the same messages in the same
+ *   order either way.
+ */
+bool message_setBatching(const int batchSize);
+
+/******************************************/
+/* message_setEventLog: record traffic in a binary event log, not as text.
+ * Caller provides:
+ *   a file open for writing, or NULL to stop recording.
+ * Function returns:
+ *   true if recording started (or stopped, given NULL); false on error.
+ * Notes:
+ *   From then on every message sent or received is written to fp as an
+ *   event (see eventlog.h) instead of as the TO/FROM, line count and text
+ *   entries in the log; everything else is still logged as text. The
+ *   support/eventdump program turns the events back into those entries.
+ *   Stopping (or message_done) flushes fp but does not close it.
+ *   Call it while no other thread is sending.
+ */
+bool message_setEventLog(FILE* fp);
+
+/******************************************/
+/* message_getCounts: how many messages of a type were sent and received.
+ * Caller provides:
+ *   a message type, an msgtype_t of eventlog.h (TypeKey, TypeDisplay, ...),
+ *   and where to put the counts of messages received and sent.
+ * Function returns:
+ *   true, having filled in *in and *out; false if the type is out of range.
+ * Notes:
+ *   Every message received, or sent in any way, is counted by the type of
+ *   its first word, since the program started, whether or not it is logged.
+ *   Threads may send while the counts are read.
+ */
+typedef struct msgcount {
+  unsigned long messages;
+  unsigned long bytes;        // text of the messages, without null characters
+} msgcount_t;
+
+bool message_getCounts(const int type, msgcount_t* in, msgcount_t* out);
+
+/******************************************/
+/* message_loopCount: return how many times message_loop and
+ * message_loopEpoll have gone round their loops (each wait for input, and
+ * whatever is handled after it), since the program started.
+ */
+unsigned long message_loopCount(void);
+
+/******************************************/
+/* message_deliver: hand a message to a handler as if it had just arrived.
+ * Caller provides:
+ *   arg and handleMessage, as for message_loop,
+ *   the address the message is from, and the message.
+ * Function returns:
+ *   what handleMessage returns: true if it says to stop.
+ * Notes:
+ *   The message is logged as one received by the loops, and anything the
+ *   handler queued is flushed afterwards, so that a recorded stream of
+ *   messages can be fed back to a program (usually one started with
+ *   message_initOffline) and logged just as it was the first time.
+ */
+bool message_deliver(void* arg,
+                     bool (*handleMessage)(void* arg,
+                                           const addr_t from, const char* buf),
+                     const addr_t from, const char* message);
+
 /******************************************/
 /* message_loop: loop, handling input and incoming messages.
  * Caller provides:
@@ -151,6 +308,72 @@ bool message_loop(void* arg, const float timeout,
                                         const addr_t from, 
                                         const char* message));
 
+/******************************************/
+/* message_loopEpoll: loop, as message_loop does, using epoll.
+ * Caller provides: exactly as for message_loop.
+ * Function returns: exactly as for message_loop.
+ * Handlers: as for message_loop; in addition, the handlers of every
+ *   descriptor registered with message_watch, message_watchTimer or
+ *   message_watchSignal are called when it is ready, with the same 'arg'.
+ * Notes:
+ *   Waiting costs the same however many descriptors are watched, unlike
+ *   select(). handleTimeout is called only when nothing at all is ready
+ *   for 'timeout' seconds; use message_watchTimer for a steady clock.
+ *   Linux only.
+ * Logs: as message_loop; also signals received.
+ */
+bool message_loopEpoll(void* arg, const float timeout,
+                       bool (*handleTimeout)(void* arg),
+                       bool (*handleInput)  (void* arg),
+                       bool (*handleMessage)(void* arg,
+                                             const addr_t from, 
+                                             const char* message));
+
+/******************************************/
+/* message_watch: have message_loopEpoll watch another file descriptor.
+ * Caller provides:
+ *   an open file descriptor, such as another socket,
+ *   a function to call when it is ready to read; the handler must read
+ *     from it, and returns true to terminate looping.
+ * Function returns: true if the descriptor is now watched.
+ * Notes: at most 1024 descriptors may be watched at once (enough for a
+ *   socket per simulated client in support/loadgen).
+ * Logs: errors.
+ */
+bool message_watch(const int fd, bool (*handleFd)(void* arg, int fd));
+
+/******************************************/
+/* message_watchTimer: have message_loopEpoll call a handler periodically.
+ * Caller provides:
+ *   the interval in seconds,
+ *   a function to call each time the interval passes; it returns true to
+ *     terminate looping. Missed intervals are folded into one call.
+ * Function returns: the timer's file descriptor (a timerfd); -1 on error.
+ * Logs: errors.
+ */
+int message_watchTimer(const float interval, bool (*handleTimer)(void* arg));
+
+/******************************************/
+/* message_watchSignal: have message_loopEpoll handle a signal.
+ * Caller provides:
+ *   the signal number (e.g. SIGINT),
+ *   a function to call with the signal number when the signal arrives; it
+ *     returns true to terminate looping.
+ * Function returns: the signal's file descriptor (a signalfd); -1 on error.
+ * Notes: the signal is blocked for normal delivery from now on.
+ * Logs: errors.
+ */
+int message_watchSignal(const int signum,
+                        bool (*handleSignal)(void* arg, int signum));
+
+/******************************************/
+/* message_unwatch: stop watching a descriptor.
+ * Caller provides: a descriptor passed to, or returned by, message_watch*.
+ * Function returns: true if it was watched.
+ * Notes: timer and signal descriptors are closed; others are left open.
+ */
+bool message_unwatch(const int fd);
+
 /******************************************/
 /* message_done: shut down the module.
  * Caller provides: nothing.
@@ -158,6 +381,9 @@ bool message_loop(void* arg, const float timeout,
  * Assumptions: 
  *   message_init() had been called earlier.
  *   no message() functions will be called later.
+ * We do: send any messages still queued on this thread (see message_flush),
+ *   stop watching every descriptor registered with message_watch*, and
+ *   stop any event log (see message_setEventLog).
  * Logs: a note indicating close down of message module.
  */
 void message_done(void);